@@ -0,0 +1,218 @@
+/*
+The MIT License
+
+Copyright (c) 2012 by Jorrit Tyberghein
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in
+all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+THE SOFTWARE.
+*/
+
+#ifndef __ARES_BINLEVEL_H__
+#define __ARES_BINLEVEL_H__
+
+#include "csutil/csstring.h"
+#include "csutil/csendian.h"
+#include "csgeom/vector3.h"
+
+/**
+ * The compiled (binary) level format. A compiled level starts with
+ * a magic number and a version followed by a list of sections. Every
+ * section starts with a tag and the size of the section data so that
+ * a loader can skip sections it doesn't know. All numbers are stored
+ * little endian.
+ * The XML level file remains the editable source. A compiled level
+ * is made from a loaded level with iAssetManager::CompileFile().
+ */
+#define ARES_BINLEVEL_TAG(a,b,c,d) \
+  (uint32 (a) | (uint32 (b) << 8) | (uint32 (c) << 16) | (uint32 (d) << 24))
+
+#define ARES_BINLEVEL_MAGIC ARES_BINLEVEL_TAG('A','R','L','V')
+#define ARES_BINLEVEL_VERSION 1
+
+#define ARES_BINLEVEL_META ARES_BINLEVEL_TAG('M','E','T','A')
+#define ARES_BINLEVEL_ASSETS ARES_BINLEVEL_TAG('A','S','S','T')
+#define ARES_BINLEVEL_CURVES ARES_BINLEVEL_TAG('C','U','R','V')
+#define ARES_BINLEVEL_ROOMS ARES_BINLEVEL_TAG('R','O','O','M')
+#define ARES_BINLEVEL_DYNWORLD ARES_BINLEVEL_TAG('D','Y','N','W')
+#define ARES_BINLEVEL_LOCKS ARES_BINLEVEL_TAG('L','O','C','K')
+
+/**
+ * Write binary level data to a memory buffer.
+ */
+class BinaryLevelWriter
+{
+private:
+  csString data;
+  size_t sectionStart;
+
+public:
+  BinaryLevelWriter () : sectionStart ((size_t)~0) { }
+
+  void WriteUInt32 (uint32 v)
+  {
+    v = csLittleEndian::Convert (v);
+    data.Append ((const char*)&v, sizeof (v));
+  }
+  void WriteBool (bool v) { WriteUInt32 (v ? 1 : 0); }
+  void WriteFloat (float v) { WriteUInt32 (csIEEEfloat::FromNative (v)); }
+  void WriteVector3 (const csVector3& v)
+  {
+    WriteFloat (v.x);
+    WriteFloat (v.y);
+    WriteFloat (v.z);
+  }
+  void WriteString (const char* s)
+  {
+    size_t len = s ? strlen (s) : 0;
+    WriteUInt32 (uint32 (len));
+    if (len) data.Append (s, len);
+  }
+
+  /// Write the file header.
+  void WriteHeader ()
+  {
+    WriteUInt32 (ARES_BINLEVEL_MAGIC);
+    WriteUInt32 (ARES_BINLEVEL_VERSION);
+  }
+
+  /// Start a new section. The size is filled in by EndSection().
+  void BeginSection (uint32 tag)
+  {
+    WriteUInt32 (tag);
+    sectionStart = data.Length ();
+    WriteUInt32 (0);
+  }
+  void EndSection ()
+  {
+    uint32 size = csLittleEndian::Convert (
+	uint32 (data.Length () - sectionStart - sizeof (uint32)));
+    memcpy (data.GetData () + sectionStart, &size, sizeof (size));
+    sectionStart = (size_t)~0;
+  }
+
+  const char* GetData () const { return data.GetData (); }
+  size_t GetSize () const { return data.Length (); }
+};
+
+/**
+ * Read binary level data from a memory buffer (typically the memory
+ * mapped file). Reading past the end of the data or the current section
+ * doesn't crash but marks the reader as failed. Check IsOk() after
+ * reading a section.
+ */
+class BinaryLevelReader
+{
+private:
+  const uint8* data;
+  size_t size;
+  size_t pos;
+  size_t end;
+  size_t sectionEnd;
+  bool ok;
+
+  bool Need (size_t n)
+  {
+    if (!ok || pos + n > end)
+    {
+      ok = false;
+      return false;
+    }
+    return true;
+  }
+
+public:
+  BinaryLevelReader (const void* data, size_t size) :
+    data ((const uint8*)data), size (size), pos (0), end (size),
+    sectionEnd (0), ok (true) { }
+
+  /// Return true if the buffer contains a compiled level.
+  static bool IsBinaryLevel (const void* data, size_t size)
+  {
+    if (size < 2 * sizeof (uint32)) return false;
+    uint32 magic;
+    memcpy (&magic, data, sizeof (magic));
+    return csLittleEndian::Convert (magic) == ARES_BINLEVEL_MAGIC;
+  }
+
+  bool IsOk () const { return ok; }
+
+  uint32 ReadUInt32 ()
+  {
+    if (!Need (sizeof (uint32))) return 0;
+    uint32 v;
+    memcpy (&v, data + pos, sizeof (v));
+    pos += sizeof (v);
+    return csLittleEndian::Convert (v);
+  }
+  bool ReadBool () { return ReadUInt32 () != 0; }
+  float ReadFloat () { return csIEEEfloat::ToNative (ReadUInt32 ()); }
+  csVector3 ReadVector3 ()
+  {
+    csVector3 v;
+    v.x = ReadFloat ();
+    v.y = ReadFloat ();
+    v.z = ReadFloat ();
+    return v;
+  }
+  csString ReadString ()
+  {
+    csString s;
+    uint32 len = ReadUInt32 ();
+    if (len && Need (len))
+    {
+      s.Append ((const char*)data + pos, len);
+      pos += len;
+    }
+    return s;
+  }
+  /**
+   * Read a count of items that are each at least 'itemSize' bytes.
+   * Corrupt counts are caught here before anything is allocated.
+   */
+  size_t ReadCount (size_t itemSize)
+  {
+    uint32 count = ReadUInt32 ();
+    if (!Need (size_t (count) * itemSize)) return 0;
+    return count;
+  }
+
+  /// Read the header. Returns false if this is not a supported level.
+  bool ReadHeader ()
+  {
+    if (ReadUInt32 () != ARES_BINLEVEL_MAGIC) return false;
+    return ReadUInt32 () == ARES_BINLEVEL_VERSION && ok;
+  }
+
+  /**
+   * Go to the next section. Returns false at the end of the data.
+   * Reading is restricted to the section until the next call.
+   */
+  bool NextSection (uint32& tag)
+  {
+    if (sectionEnd) pos = sectionEnd;
+    end = size;
+    if (!ok || pos >= size) return false;
+    tag = ReadUInt32 ();
+    uint32 sectionSize = ReadUInt32 ();
+    if (!Need (sectionSize)) return false;
+    end = sectionEnd = pos + sectionSize;
+    return true;
+  }
+};
+
+#endif // __ARES_BINLEVEL_H__
@@ -106,6 +106,7 @@ public:
   virtual void AllocContextHandlers (wxFrame* frame) { }
   virtual void AddContextMenu (wxMenu* contextMenu, int mouseX, int mouseY) { }
   virtual bool IsContextMenuAllowed () { return true; }
+  virtual bool IsAnimating () { return false; }
 
   virtual void Start () { started = true; }
   virtual void Stop () { started = false; }
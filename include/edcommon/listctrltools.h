@@ -138,5 +138,58 @@ public:
   static bool CheckHitList (wxListBox* list, bool& hasItem, const wxPoint& pos);
 };
 
+/**
+ * Provider for the rows of a VirtualListCtrl.
+ */
+struct VirtualListProvider
+{
+  virtual ~VirtualListProvider () { }
+
+  /**
+   * Return the row with the given index. This is only called for
+   * rows that are actually shown.
+   */
+  virtual csStringArray GetVirtualRow (wxListCtrl* list, long item) = 0;
+};
+
+/**
+ * A list control with the wxLC_VIRTUAL style. Instead of storing all
+ * rows it asks its provider for the text of the visible rows. In XRC
+ * files use this as the subclass of a wxListCtrl with style
+ * wxLC_REPORT|wxLC_VIRTUAL.
+ */
+class ARES_EDCOMMON_EXPORT VirtualListCtrl : public wxListCtrl
+{
+private:
+  VirtualListProvider* provider;
+
+  // wx asks for every column of a row in turn so the last row is cached.
+  mutable long cachedItem;
+  mutable csStringArray cachedRow;
+
+public:
+  VirtualListCtrl () : provider (0), cachedItem (-1) { }
+  VirtualListCtrl (wxWindow* parent, wxWindowID id, const wxPoint& pos,
+      const wxSize& size, long style) :
+    wxListCtrl (parent, id, pos, size, style | wxLC_VIRTUAL),
+    provider (0), cachedItem (-1) { }
+  virtual ~VirtualListCtrl () { }
+
+  void SetProvider (VirtualListProvider* provider)
+  {
+    VirtualListCtrl::provider = provider;
+    InvalidateCache ();
+  }
+  VirtualListProvider* GetProvider () const { return provider; }
+
+  /// Forget the cached row. Call this when the rows change.
+  void InvalidateCache () { cachedItem = -1; }
+
+  virtual wxString OnGetItemText (long item, long column) const;
+
+private:
+  DECLARE_DYNAMIC_CLASS (VirtualListCtrl)
+};
+
 #endif // __appares_listctrltools_h
 
@@ -126,6 +126,24 @@ struct ValueChangeListener : public csRefCount
    * Called if the value changes.
    */
   virtual void ValueChanged (Value* value) = 0;
+
+  /**
+   * Called if a child was inserted in a collection at the given index.
+   * By default this is handled as a change of the entire value.
+   */
+  virtual void ChildInserted (Value* value, size_t idx) { ValueChanged (value); }
+
+  /**
+   * Called if the child at the given index was removed from a collection.
+   * By default this is handled as a change of the entire value.
+   */
+  virtual void ChildRemoved (Value* value, size_t idx) { ValueChanged (value); }
+
+  /**
+   * Called if the child at the given index of a collection changed.
+   * By default this is handled as a change of the entire value.
+   */
+  virtual void ChildModified (Value* value, size_t idx) { ValueChanged (value); }
 };
 
 /**
@@ -192,6 +210,38 @@ public:
     if (parent) parent->ChildChanged (this);
   }
 
+  /**
+   * Notify the listeners that a child was inserted at the given index.
+   * Collections can use this (and the two functions below) instead of
+   * FireValueChanged() so that views only have to update a single row.
+   */
+  virtual void FireChildInserted (size_t idx)
+  {
+    for (size_t i = 0 ; i < listeners.GetSize () ; i++)
+      listeners[i]->ChildInserted (this, idx);
+    if (parent) parent->ChildChanged (this);
+  }
+
+  /**
+   * Notify the listeners that the child at the given index was removed.
+   */
+  virtual void FireChildRemoved (size_t idx)
+  {
+    for (size_t i = 0 ; i < listeners.GetSize () ; i++)
+      listeners[i]->ChildRemoved (this, idx);
+    if (parent) parent->ChildChanged (this);
+  }
+
+  /**
+   * Notify the listeners that the child at the given index changed.
+   */
+  virtual void FireChildModified (size_t idx)
+  {
+    for (size_t i = 0 ; i < listeners.GetSize () ; i++)
+      listeners[i]->ChildModified (this, idx);
+    if (parent) parent->ChildChanged (this);
+  }
+
   /**
    * Force a refresh of the data. The default implementation sets a dirty
    * flag and calls FireValueChanged().
@@ -314,6 +364,14 @@ public:
    */
   virtual Value* GetChild (size_t idx) { return 0; }
 
+  /**
+   * If the type of this value is VALUE_COMPOSITE or VALUE_COLLECTION then
+   * this returns the number of children. The default implementation
+   * counts them using the iterator. Collections that support GetChild()
+   * should override this so that virtual lists can use it.
+   */
+  virtual size_t GetChildCount ();
+
   /**
    * If the type of this value is VALUE_COMPOSITE then you can get
    * a child by name here.
@@ -562,6 +620,11 @@ public:
     UpdateChildren ();
     return children[idx];
   }
+  virtual size_t GetChildCount ()
+  {
+    UpdateChildren ();
+    return children.GetSize ();
+  }
   virtual csString Dump (bool verbose = false)
   {
     csString dump = "[*]";
@@ -633,6 +696,10 @@ public:
   {
     return filteredChildren[idx];
   }
+  virtual size_t GetChildCount ()
+  {
+    return filteredChildren.GetSize ();
+  }
 };
 
 /**
@@ -1149,6 +1216,18 @@ private:
     {
       view->ValueChanged (value);
     }
+    virtual void ChildInserted (Value* value, size_t idx)
+    {
+      view->ChildChanged (value, idx, CHILD_INSERTED);
+    }
+    virtual void ChildRemoved (Value* value, size_t idx)
+    {
+      view->ChildChanged (value, idx, CHILD_REMOVED);
+    }
+    virtual void ChildModified (Value* value, size_t idx)
+    {
+      view->ChildChanged (value, idx, CHILD_MODIFIED);
+    }
   };
   csRef<ViewChangeListener> changeListener;
 
@@ -1193,6 +1272,14 @@ private:
    */
   csStringArray ConstructListRow (const ListHeading& lh, Value* value);
 
+  // Rows for virtual lists are constructed when they are shown.
+  class ListProvider;
+  ListProvider* listProvider;
+  csStringArray GetVirtualRow (wxListCtrl* list, long item);
+
+  /// Disconnect a virtual list from this view.
+  void ReleaseVirtualList (wxWindow* component);
+
   // --------------------------------------------
 
   /// Called by components when they change. Will update the corresponding Value.
@@ -1204,6 +1291,18 @@ private:
   /// Called by values when they change. Will update the corresponding component.
   void ValueChanged (Value* value);
 
+  enum ChildChange
+  {
+    CHILD_INSERTED,
+    CHILD_REMOVED,
+    CHILD_MODIFIED
+  };
+  /**
+   * Called by collections when a single child changes. Lists only update
+   * the affected row. Other components update the entire value.
+   */
+  void ChildChanged (Value* value, size_t idx, ChildChange change);
+
   // Handler for wx events.
   class EventHandler : public wxEvtHandler
   {
@@ -82,6 +82,46 @@ private:
 
   csArray<SanityResult> results;
 
+  /**
+   * Caches that are built once per run. Objects by entity name (every
+   * object with that name, FindEntity() returns one of them) and the
+   * parameters wanted by every template. The index is kept up to date
+   * for the objects given to CheckModified() and RegisterRemoval().
+   */
+  csHash<iDynamicObject*,csString> entityIndex;
+  /// The name under which every object is in entityIndex.
+  csHash<csString,csPtrKey<iDynamicObject> > indexedNames;
+  bool entityIndexValid;
+  /// Names of removed objects whose users still have to be checked.
+  csSet<csString> removedNames;
+  csHash<csHash<ParameterDomain,csStringID>,csPtrKey<iCelEntityTemplate> > templateParameters;
+
+  /**
+   * Dependencies that are recorded during the checks so that
+   * CheckModified() only has to re-check the quests and objects that
+   * refer to a given entity or template name.
+   */
+  csHash<iQuestFactory*,csString> entityQuests;
+  csHash<iDynamicObject*,csString> entityObjects;
+  csHash<iQuestFactory*,csString> templateQuests;
+
+  void BuildEntityIndex ();
+  const csHash<ParameterDomain,csStringID>& GetTemplateParameters (
+      iCelEntityTemplate* tpl);
+
+  // Incremental checking.
+  void RemoveResults (iObject* resource);
+  void RemoveResults (iDynamicObject* object);
+  void UpdateEntityIndex (const csArray<iDynamicObject*>& objects,
+      csSet<csString>& changedNames);
+  bool DependsOn (iCelEntityTemplate* tpl,
+      const csSet<csPtrKey<iCelEntityTemplate> >& templates);
+  void RecheckQuest (iQuestFactory* quest);
+  void RecheckObjects (const csArray<iDynamicObject*>& objects,
+      csSet<csString>& names);
+  void RecheckEntityUsers (const csSet<csString>& names);
+  void RecheckTemplates (const csSet<csPtrKey<iCelEntityTemplate> >& templates);
+
   void CheckConflictingTypes (
     const csHash<ParameterDomain,csStringID>& paramTypes);
 
@@ -133,6 +173,13 @@ public:
 
   void ClearResults ();
 
+  /**
+   * Forget the cached entity index and template parameters. Call this
+   * when objects or templates changed between two checks. CheckAll()
+   * does this automatically.
+   */
+  void InvalidateCaches ();
+
   void Check (iCelEntityTemplate* tpl, iCelPropertyClassTemplate* pctpl);
   void Check (iCelEntityTemplate* tpl);
   void Check (iDynamicFactory* dynfact);
@@ -149,6 +196,32 @@ public:
   void CheckQuests ();
   void CheckAll ();
 
+  /**
+   * Incrementally update the results after a template, quest or
+   * factory was modified. Only the resource itself and the objects and
+   * quests that depend on it are checked again.
+   */
+  void CheckModified (iObject* resource);
+
+  /**
+   * Incrementally update the results after the given objects were
+   * modified. The users of objects removed since the last call are
+   * also checked again.
+   */
+  void CheckModified (const csArray<iDynamicObject*>& objects);
+
+  /**
+   * Drop the results of a template, quest or factory that is about to
+   * be removed.
+   */
+  void RegisterRemoval (iObject* resource);
+
+  /**
+   * Drop the results of objects that are about to be removed from the
+   * world. Only the pointers are remembered after this call.
+   */
+  void RegisterRemoval (const csArray<iDynamicObject*>& objects);
+
   const csArray<SanityResult>& GetResults () const { return results; }
 };
 
@@ -26,13 +26,44 @@ THE SOFTWARE.
 #define __transformtools_h
 
 #include "edcommon/aresextern.h"
+#include "cstypes.h"
+#include "csutil/array.h"
 
 struct iSelection;
+struct iDynamicObject;
 class csVector3;
 
 class ARES_EDCOMMON_EXPORT TransformTools
 {
 public:
+  /**
+   * Prepare the given objects for a transformation. The pivot joints of
+   * objects whose factory has joints are removed first and then the
+   * objects are made kinematic. Objects stay that way over consecutive
+   * transformations (nudges, tools and drags) until EndTransform() is
+   * called, so their bodies and joints are only restored once per edit.
+   * Only pass the objects that will actually be moved.
+   */
+  static void BeginTransform (const csArray<iDynamicObject*>& objects);
+
+  /**
+   * Finish the current edit. All objects given to BeginTransform() are
+   * synchronized again and when all of them are at their final location
+   * the pivot joints are recreated. Call this before these objects are
+   * deleted or made static or dynamic.
+   */
+  static void EndTransform ();
+
+  /**
+   * Return true if there are objects that wait for EndTransform().
+   */
+  static bool IsTransforming ();
+
+  /**
+   * Return the time of the last call to BeginTransform().
+   */
+  static csTicks GetLastTransformTime ();
+
   /**
    * Align all selected objects based on the first selected object.
    */
@@ -191,6 +191,20 @@ struct i3DView : public virtual iBase
    * Get the model repository.
    */
   virtual iModelRepository* GetModelRepository () = 0;
+
+  /**
+   * Schedule a refresh of the colliders of a dynamic object after its
+   * geometry changed. The refresh is done at most once per frame for
+   * all scheduled objects. If the 'Ares.ColliderRefresh' config option
+   * is 'release' it is only done when FlushColliders() is called.
+   */
+  virtual void ScheduleRefreshColliders (iDynamicObject* dynobj) = 0;
+
+  /**
+   * Refresh the colliders of all scheduled objects now. Call this
+   * when an edit is finished (for a drag that is when it stops).
+   */
+  virtual void FlushColliders () = 0;
 };
 
 
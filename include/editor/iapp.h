@@ -64,11 +64,38 @@ struct iAresEditor : public virtual iBase
    */
   virtual void RegisterModification (const csArray<iObject*>& resources) = 0;
 
+  /**
+   * Register that some objects in the world have been modified (or
+   * had their entity changed). This is a general modification that
+   * also tells the live checks which objects to look at again.
+   */
+  virtual void RegisterModification (const csArray<iDynamicObject*>& objects) = 0;
+
+  /**
+   * Register that a resource is about to be removed. Call this before
+   * the resource is really removed.
+   */
+  virtual void RegisterRemoval (iObject* resource) = 0;
+
+  /**
+   * Register that some objects are about to be removed from the world.
+   * Call this before the objects are deleted.
+   */
+  virtual void RegisterRemoval (const csArray<iDynamicObject*>& objects) = 0;
+
   /**
    * Set the focus to the 3d view so that keyboard commands work correctly.
    */
   virtual void SetFocus3D () = 0;
 
+  /**
+   * Request that the 3D view is rendered again. The editor only renders
+   * frames when something changed or when something is animating. After
+   * a request it keeps rendering for a short while so that physics can
+   * settle.
+   */
+  virtual void RequestRedraw () = 0;
+
   /// Set the state of the menus correctly depending on context.
   virtual void SetMenuState () = 0;
 
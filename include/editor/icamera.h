@@ -39,6 +39,12 @@ struct iEditorCamera : public virtual iBase
    */
   virtual void Frame (float elapsed, int mouseX, int mouseY) = 0;
 
+  /**
+   * Return true if the camera is still moving towards its destination
+   * or is being moved with the keyboard.
+   */
+  virtual bool IsAnimating () const = 0;
+
   /**
    * Various event functions.
    */
@@ -66,6 +66,13 @@ struct iEditingMode : public virtual iBase
    */
   virtual bool IsContextMenuAllowed () = 0;
 
+  /**
+   * Return true if this mode is animating something in the 3D view
+   * without user input (like dragging an object with physics). As long
+   * as this is true the editor keeps rendering frames.
+   */
+  virtual bool IsAnimating () = 0;
+
   /**
    * Activate the mode.
    */
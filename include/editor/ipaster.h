@@ -74,6 +74,27 @@ struct iPaster : public virtual iBase
   /// Return the number of items in the clipboard.
   virtual size_t GetClipboardSize () const = 0;
 
+  /**
+   * Paste a grid of copies of the paste buffer in one go. The columns go
+   * along the local x axis of the pasted objects and the rows along the
+   * local z axis. The copies are spaced by the size of the paste buffer.
+   * This is reset to one copy when a new paste starts.
+   */
+  virtual void SetPasteGrid (int columns, int rows) = 0;
+  /// Get the number of columns in the paste grid.
+  virtual int GetPasteColumns () const = 0;
+  /// Get the number of rows in the paste grid.
+  virtual int GetPasteRows () const = 0;
+
+  /**
+   * Toggle scatter mode. In scatter mode every copy of a grid paste
+   * gets a random position in its cell and a random rotation around
+   * the vertical axis.
+   */
+  virtual void ToggleScatterMode () = 0;
+  /// Return true if scatter mode is enabled.
+  virtual bool IsScatterModeEnabled () const = 0;
+
   /// Toggle grid movement on/off.
   virtual void ToggleGridMode () = 0;
   /// Return true if grid mode is enabled.
@@ -26,6 +26,7 @@ THE SOFTWARE.
 #define __iselection_h__
 
 #include "csutil/scf.h"
+#include "csgeom/box.h"
 #include <wx/wx.h>
 
 struct iDynamicObject;
@@ -81,9 +82,45 @@ struct iSelection : public virtual iBase
   virtual void SetCurrentObject (iDynamicObject* dynobj) = 0;
 
   /**
-   * Add an object to the selection.
+   * Add an object to the selection. If the object is already selected
+   * then it is removed from the selection instead.
    */
   virtual void AddCurrentObject (iDynamicObject* dynobj) = 0;
+
+  /**
+   * Check if an object is selected.
+   */
+  virtual bool IsSelected (iDynamicObject* dynobj) const = 0;
+
+  /**
+   * Replace the selection with the given objects. Listeners are only
+   * notified once.
+   */
+  virtual void SetObjects (const csArray<iDynamicObject*>& objects) = 0;
+
+  /**
+   * Add the given objects to the selection. Objects that are already
+   * selected remain selected. Listeners are only notified once.
+   */
+  virtual void AddObjects (const csArray<iDynamicObject*>& objects) = 0;
+
+  /**
+   * Remove the given objects from the selection. Listeners are only
+   * notified once.
+   */
+  virtual void RemoveObjects (const csArray<iDynamicObject*>& objects) = 0;
+
+  /**
+   * Get the world space bounding box of all selected objects. This is
+   * cached and only recomputed for objects that moved.
+   */
+  virtual const csBox3& GetBoundingBox () = 0;
+
+  /**
+   * Get the average of the world space centers of all selected objects.
+   * This is cached like GetBoundingBox().
+   */
+  virtual const csVector3& GetCenter () = 0;
 };
 
 
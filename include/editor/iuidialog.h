@@ -154,6 +154,11 @@ struct iUIDialog : public virtual iBase
    */
   virtual void Close () = 0;
 
+  /**
+   * Return true if the dialog is currently shown.
+   */
+  virtual bool IsOpen () const = 0;
+
   /**
    * When any button is pressed (including Ok and Cancel) this will return
    * the contents of all text controls and choices.
@@ -154,6 +154,13 @@ struct iAssetManager : public virtual iBase
    */
   virtual bool SaveFile (const char* filename) = 0;
 
+  /**
+   * Compile the current world to a binary file. A compiled level can be
+   * loaded with LoadFile() a lot faster than the XML version but it
+   * cannot be edited. The assets themselves are not compiled.
+   */
+  virtual bool CompileFile (const char* filename) = 0;
+
   /**
    * Create a new project empty project.
    */
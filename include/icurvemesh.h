@@ -28,6 +28,8 @@ THE SOFTWARE.
 #include "csutil/scf.h"
 
 class csVector3;
+class BinaryLevelWriter;
+class BinaryLevelReader;
 struct iMeshWrapper;
 
 struct iCurvedFactory : public virtual iBase
@@ -64,6 +66,33 @@ struct iCurvedFactory : public virtual iBase
    */
   virtual float GetSideHeight () const = 0;
 
+  /**
+   * Set the error tolerance for generating the geometry. Samples
+   * along the curve are only emitted where leaving them out would
+   * move the edges of the strip more than this distance. So straight
+   * parts of the curve will get few samples and tight bends will get
+   * more. A tolerance of 0 will sample the curve at a fixed rate.
+   */
+  virtual void SetTolerance (float tolerance) = 0;
+
+  /**
+   * Get the error tolerance.
+   */
+  virtual float GetTolerance () const = 0;
+
+  /**
+   * Enable a chain of lower detail versions of the generated geometry.
+   * Until 'start' the full geometry is used and at 'end' the lowest detail
+   * level (which has no side borders) is reached. Give an 'end' of 0
+   * to disable LOD. This has to be set before the geometry is generated.
+   */
+  virtual void SetLODDistances (float start, float end) = 0;
+
+  /**
+   * Get the LOD distances. 'end' is 0 if LOD is not used.
+   */
+  virtual void GetLODDistances (float& start, float& end) const = 0;
+
   /**
    * Add a point to the curve.
    * Return the index of this point.
@@ -101,6 +130,41 @@ struct iCurvedFactory : public virtual iBase
    * Get the up of a given point.
    */
   virtual const csVector3& GetUp (size_t idx) const = 0;
+
+  /**
+   * Mark the entire curve as changed so that the next generation of
+   * the geometry flattens the whole path again. Use this when the ground
+   * below the curve changed.
+   */
+  virtual void InvalidateGeometry () = 0;
+
+  /**
+   * Like iGeometryGenerator::GenerateGeometry() but only the ground
+   * below the changed part is sampled here. Fitting the path to those
+   * samples and the tessellation are done on a worker thread. The mesh
+   * keeps its old geometry until FinishGeometry() sees that the job is
+   * done. If this is called again while a job is running the new request
+   * waits until that job is finished and only the latest state is
+   * generated then. The lower detail LOD levels are not updated here.
+   * Calling GenerateGeometry() finishes everything immediately (including
+   * the LOD levels) so call it when the edit is done.
+   */
+  virtual void GenerateGeometryAsync (iMeshWrapper* mesh) = 0;
+
+  /**
+   * Call this every frame while background generation is used. If a job
+   * is finished its geometry is put in the mesh and a pending request is
+   * started. The result of a job is dropped if the curve changed so much
+   * while it was running that everything has to be generated again
+   * (points added or removed, a new width, ...). Returns true if the
+   * geometry of the mesh changed.
+   */
+  virtual bool FinishGeometry () = 0;
+
+  /**
+   * Return true if there is a background generation running.
+   */
+  virtual bool IsGeneratingGeometry () const = 0;
 };
 
 /**
@@ -113,7 +177,12 @@ struct iCurvedFactoryTemplate : public virtual iBase
   virtual const char* GetName () const = 0;
 
   /**
-   * Generic attribute system.
+   * Generic attribute system. The 'tolerance' attribute is used
+   * as the error tolerance for the factories created from this
+   * template (see iCurvedFactory::SetTolerance()). If the 'lod'
+   * attribute is 'true' the factories get LOD levels which reach
+   * the lowest detail at 'imposterradius' (or 'maxradius' if there
+   * is no imposter radius).
    */
   virtual void SetAttribute (const char* name, const char* value) = 0;
 
@@ -207,6 +276,17 @@ struct iCurvedMeshCreator : public virtual iBase
    * Return 0 on success or otherwise a string with the error.
    */
   virtual csRef<iString> Load (iDocumentNode* node) = 0;
+
+  /**
+   * Save the curved mesh factories in the compiled level format.
+   */
+  virtual void SaveBinary (BinaryLevelWriter& writer) = 0;
+
+  /**
+   * Load the curved mesh factories from a section of a compiled level.
+   * Return 0 on success or otherwise a string with the error.
+   */
+  virtual csRef<iString> LoadBinary (BinaryLevelReader& reader) = 0;
 };
 
 #endif // __ARES_CURVEMESH_H__
@@ -155,6 +155,17 @@ struct iMarkerHitArea : public virtual iBase
   virtual iMarker* GetMarker () const = 0;
   virtual MarkerSpace GetSpace () const  = 0;
   virtual const csVector3& GetCenter () const = 0;
+
+  /**
+   * Move this hit area so that it is centered around the given position.
+   * The dragging modes are kept.
+   */
+  virtual void SetCenter (const csVector3& center) = 0;
+
+  /**
+   * Change the user data of this hit area.
+   */
+  virtual void SetData (int data) = 0;
 };
 
 #define SELECTION_NONE 0
@@ -301,6 +312,29 @@ struct iMarker : public virtual iBase
    */
   virtual void Clear () = 0;
 
+  /**
+   * Get the number of drawing primitives. Primitives are numbered in
+   * the order in which they were added (with Line(), Lines(), ...).
+   */
+  virtual size_t GetPrimitiveCount () const = 0;
+
+  /**
+   * Change the endpoints of a line made with Line(). This is a lot
+   * cheaper than clearing and rebuilding the marker. Returns false if
+   * there is no primitive with this index or if it is not a line.
+   */
+  virtual bool UpdateLine (size_t idx, const csVector3& v1,
+      const csVector3& v2) = 0;
+
+  /**
+   * Change the lines of a primitive made with Lines() or Mesh(). The
+   * rendering caches are only rebuilt if the lines are really different.
+   * Returns false if there is no primitive with this index or if it is
+   * not a mesh of lines.
+   */
+  virtual bool UpdateLines (size_t idx,
+      const csArray<csPen3DCoordinatePair>& lines) = 0;
+
   /**
    * Define a hit area on this marker (this is a circular marker).
    */
@@ -318,6 +352,14 @@ struct iMarker : public virtual iBase
    * Clear all hit areas.
    */
   virtual void ClearHitAreas () = 0;
+
+  /**
+   * Get the hit areas in the order in which they were defined. Use this
+   * to move existing hit areas instead of redefining them. GetHitArea()
+   * returns 0 if there is no hit area with this index.
+   */
+  virtual size_t GetHitAreaCount () const = 0;
+  virtual iMarkerHitArea* GetHitArea (size_t idx) const = 0;
 };
 
 /**
@@ -566,6 +608,21 @@ struct iGraphView : public virtual iBase
    * Add a node activation callback.
    */
   virtual void AddNodeActivationCallback (iGraphNodeCallback* cb) = 0;
+
+  /**
+   * Calculate the layout of the nodes on a worker thread. The nodes then
+   * move one frame later but big graphs don't block the editor.
+   * Default is false.
+   */
+  virtual void SetThreadedLayout (bool t) = 0;
+  virtual bool IsThreadedLayout () const = 0;
+
+  /**
+   * Return true if the layout of this graph is still moving nodes or a
+   * layout job is still running. The graph only settles if frames keep
+   * being rendered.
+   */
+  virtual bool IsLayoutRunning () const = 0;
 };
 
 /**
@@ -577,6 +634,13 @@ struct iMarkerManager : public virtual iBase
 
   virtual void Frame2D () = 0;
   virtual void Frame3D () = 0;
+
+  /**
+   * Return true if something managed by the marker manager is animating
+   * without user input (like the layout of a visible graph view).
+   */
+  virtual bool IsAnimating () const = 0;
+
   virtual bool OnMouseDown (iEvent& ev, uint but, int mouseX, int mouseY) = 0;
   virtual bool OnMouseUp (iEvent& ev, uint but, int mouseX, int mouseY) = 0;
   virtual bool OnMouseMove (iEvent& ev, int mouseX, int mouseY) = 0;
@@ -26,8 +26,15 @@ THE SOFTWARE.
 #define __ARES_ROOMS_H__
 
 #include "csutil/scf.h"
+#include "csutil/array.h"
+#include "csutil/refarr.h"
 
 class csVector3;
+class csBox3;
+class csReversibleTransform;
+class BinaryLevelWriter;
+class BinaryLevelReader;
+struct iSector;
 struct iMeshWrapper;
 
 struct iRoomFactory : public virtual iBase
@@ -61,6 +68,43 @@ struct iRoomFactory : public virtual iBase
    * Get the number of rooms.
    */
   virtual size_t GetRoomCount () const = 0;
+
+  /**
+   * Get the box of a room.
+   */
+  virtual const csBox3& GetRoomBox (size_t idx) const = 0;
+
+  /**
+   * Find a room that contains the given point (in object space).
+   * Returns csArrayItemNotFound if the point is not in any room.
+   */
+  virtual size_t FindRoom (const csVector3& pos) = 0;
+
+  /**
+   * Find all rooms that overlap with the given box (in object space).
+   * The indices are added to the 'rooms' array.
+   */
+  virtual void FindRooms (const csBox3& box, csArray<size_t>& rooms) = 0;
+
+  /**
+   * Find all rooms that share part of a wall with the given room.
+   * The indices are added to the 'rooms' array.
+   */
+  virtual void FindAdjacentRooms (size_t idx, csArray<size_t>& rooms) = 0;
+
+  /**
+   * Instead of using one mesh for all rooms, create a sector for every
+   * room with a mesh for its walls. Where two rooms touch the wall is
+   * left open and a portal to the sector of the other room is made, so
+   * rooms that can't be seen can be culled. Rooms that overlap instead
+   * of touch are not connected.
+   * @param prefix is used for the names of the sectors and meshes.
+   * @param trans is the transform that places the rooms in the world.
+   * @param sectors the new sectors are added to this array (in the
+   * same order as the rooms).
+   */
+  virtual void CreateSectors (const char* prefix,
+      const csReversibleTransform& trans, csRefArray<iSector>& sectors) = 0;
 };
 
 /**
@@ -158,6 +202,17 @@ struct iRoomMeshCreator : public virtual iBase
    * Return 0 on success or otherwise a string with the error.
    */
   virtual csRef<iString> Load (iDocumentNode* node) = 0;
+
+  /**
+   * Save the room mesh factories in the compiled level format.
+   */
+  virtual void SaveBinary (BinaryLevelWriter& writer) = 0;
+
+  /**
+   * Load the room mesh factories from a section of a compiled level.
+   * Return 0 on success or otherwise a string with the error.
+   */
+  virtual csRef<iString> LoadBinary (BinaryLevelReader& reader) = 0;
 };
 
 #endif // __ARES_ROOMS_H__
@@ -185,6 +185,7 @@ static csStringID ID_ManageResources = csInvalidStringID;
 static csStringID ID_Open = csInvalidStringID;
 static csStringID ID_Save = csInvalidStringID;
 static csStringID ID_SaveAs = csInvalidStringID;
+static csStringID ID_Compile = csInvalidStringID;
 static csStringID ID_Exit = csInvalidStringID;
 static csStringID ID_UpdateObjects = csInvalidStringID;
 static csStringID ID_FindObjectDialog = csInvalidStringID;
@@ -220,6 +221,11 @@ AppAresEditWX::AppAresEditWX (iObjectRegistry* object_reg, int w, int h, long st
   config.AttachNew (new AresConfig (this));
   wantsFocus3D = 0;
   toolbarWithText = true;
+  lastFrameTime = 0;
+  redrawUntil = 0;
+  redrawSettleTime = 1000;
+  idleFrameInterval = 250;
+  clockSuspended = false;
 
   lastMessageSeverity = -1;
 }
@@ -262,6 +268,7 @@ void AppAresEditWX::RefreshModes ()
   SetMenuItemState ("TogglePan", aresed3d->GetCamera ()->IsPanningEnabled ());
   UpdateTitle ();
   aresed3d->GetModelRepository ()->Refresh ();
+  uiManager->GetSanityCheckerDialog ()->Refresh ();
 }
 
 void AppAresEditWX::ManageAssets (const csArray<BaseAsset>& assets)
@@ -307,6 +314,21 @@ void AppAresEditWX::SaveFile (const char* filename)
   RefreshModes ();
 }
 
+void AppAresEditWX::CompileCurrentFile ()
+{
+  if (currentFile.IsEmpty ())
+  {
+    uiManager->Error ("Please save the project before compiling it!");
+    return;
+  }
+  csString filename = currentFile + ".bin";
+  vfs->PushDir (currentPath);
+  if (!assetManager->CompileFile (filename))
+    uiManager->Error ("Error compiling file '%s' on path '%s'!", filename.GetData (),
+	currentPath.GetData ());
+  vfs->PopDir ();
+}
+
 void AppAresEditWX::ManageAssets ()
 {
   csRef<ManageAssetsCallbackImp> cb;
@@ -395,6 +417,8 @@ void AppAresEditWX::ReadConfig ()
 
   csRef<iConfigManager> cfgmgr = csQueryRegistry<iConfigManager> (object_reg);
   toolbarWithText = cfgmgr->GetBool ("Ares.ToolbarText", true);
+  redrawSettleTime = cfgmgr->GetInt ("Ares.RedrawSettleTime", 1000);
+  idleFrameInterval = cfgmgr->GetInt ("Ares.IdleFrameInterval", 250);
 }
 
 void AppAresEditWX::UpdateTitle ()
@@ -447,7 +471,11 @@ void AppAresEditWX::OnChoicebookChanged (wxChoicebookEvent& event)
 
   if (editMode != newMode)
   {
+    bool wasPlaying = IsPlaying ();
     if (editMode) editMode->Stop ();
+    // Objects may have been removed by the game while playing.
+    if (wasPlaying)
+      uiManager->GetSanityCheckerDialog ()->Refresh ();
     editMode = newMode;
     editMode->Start ();
   }
@@ -626,6 +654,7 @@ bool AppAresEditWX::Initialize ()
     ID_Open = pl->FetchStringID ("Open");
     ID_Save = pl->FetchStringID ("Save");
     ID_SaveAs = pl->FetchStringID ("SaveAs");
+    ID_Compile = pl->FetchStringID ("Compile");
     ID_Exit = pl->FetchStringID ("Exit");
     ID_UpdateObjects = pl->FetchStringID ("UpdateObjects");
     ID_FindObjectDialog = pl->FetchStringID ("FindObjectDialog");
@@ -652,6 +681,8 @@ bool AppAresEditWX::Initialize ()
 
   csRef<iConfigManager> cfgmgr = csQueryRegistry<iConfigManager> (object_reg);
   toolbarWithText = cfgmgr->GetBool ("Ares.ToolbarText", true);
+  redrawSettleTime = cfgmgr->GetInt ("Ares.RedrawSettleTime", 1000);
+  idleFrameInterval = cfgmgr->GetInt ("Ares.IdleFrameInterval", 250);
 
   if (!InitWX ())
     return false;
@@ -808,8 +839,29 @@ void AppAresEditWX::RegisterModification (const csArray<iObject*>& resources)
 	}
       }
     }
+    uiManager->GetSanityCheckerDialog ()->RegisterModification (resource);
   }
   UpdateTitle ();
+  RequestRedraw ();
+}
+
+void AppAresEditWX::RegisterModification (const csArray<iDynamicObject*>& objects)
+{
+  assetManager->RegisterModification ();
+  uiManager->GetSanityCheckerDialog ()->RegisterModification (objects);
+  UpdateTitle ();
+  RequestRedraw ();
+}
+
+void AppAresEditWX::RegisterRemoval (iObject* resource)
+{
+  assetManager->RegisterRemoval (resource);
+  uiManager->GetSanityCheckerDialog ()->RegisterRemoval (resource);
+}
+
+void AppAresEditWX::RegisterRemoval (const csArray<iDynamicObject*>& objects)
+{
+  uiManager->GetSanityCheckerDialog ()->RegisterRemoval (objects);
 }
 
 iCameraWindow* AppAresEditWX::GetCameraWindow () const
@@ -838,6 +890,7 @@ void AppAresEditWX::RegisterModification (iObject* resource)
 	iAsset* asset = av->GetObjectFromValue (assetVal);
 	assetManager->PlaceResource (resource, asset);
 	assetManager->RegisterModification (resource);
+	uiManager->GetSanityCheckerDialog ()->RegisterModification (resource);
 	UpdateTitle ();
 	return;
       }
@@ -846,7 +899,9 @@ void AppAresEditWX::RegisterModification (iObject* resource)
       assetManager->PlaceResource (resource, 0);
     }
   }
+  uiManager->GetSanityCheckerDialog ()->RegisterModification (resource);
   UpdateTitle ();
+  RequestRedraw ();
 }
 
 bool AppAresEditWX::InitResources ()
@@ -980,6 +1035,7 @@ bool AppAresEditWX::InitWX ()
 void AppAresEditWX::SetFocus3D ()
 {
   wantsFocus3D = 10;
+  RequestRedraw ();
 }
 
 void AppAresEditWX::SetStatus (const char* statusmsg, ...)
@@ -1150,6 +1206,7 @@ bool AppAresEditWX::Command (csStringID id, const csString& args, bool checked)
   else if (id == ID_Open) OpenFile ();
   else if (id == ID_Save) SaveCurrentFile ();
   else if (id == ID_SaveAs) SaveFile ();
+  else if (id == ID_Compile) CompileCurrentFile ();
   else if (id == ID_Exit) Quit ();
   else if (id == ID_UpdateObjects) aresed3d->UpdateObjects ();
   else if (id == ID_FindObjectDialog) FindObject ();
@@ -1220,6 +1277,7 @@ void AppAresEditWX::OnMenuItem (wxCommandEvent& event)
   if (editMode && !handler) handler = scfQueryInterface<iCommandHandler> (editMode);
   if (handler)
     handler->Command (mc.commandID, mc.args, event.IsChecked ());
+  RequestRedraw ();
 }
 
 void AppAresEditWX::AllocateMenuCommand (int id, const char* label,
@@ -1320,11 +1378,37 @@ void AppAresEditWX::PushFrame ()
   csRef<iVirtualClock> vc (csQueryRegistry<iVirtualClock> (object_reg));
 
   if (vc)
+  {
+    // Don't let the time we were idle count as elapsed time for the
+    // camera and the physics.
+    if (clockSuspended)
+    {
+      vc->Resume ();
+      clockSuspended = false;
+    }
     vc->Advance();
+  }
   q->Process();
+  uiManager->GetSanityCheckerDialog ()->FlushModifications ();
+  lastFrameTime = csGetTicks ();
   lock = false;
 }
 
+void AppAresEditWX::RequestRedraw ()
+{
+  redrawUntil = csGetTicks () + redrawSettleTime;
+}
+
+bool AppAresEditWX::IsAnimating () const
+{
+  if (IsPlaying ()) return true;
+  if (aresed3d->IsAutoTime ()) return true;
+  if (aresed3d->GetEditorCamera ()->IsAnimating ()) return true;
+  if (aresed3d->IsPhysicsActive ()) return true;
+  if (aresed3d->GetMarkerManager ()->IsAnimating ()) return true;
+  return editMode && editMode->IsAnimating ();
+}
+
 void AppAresEditWX::OnSize (wxSizeEvent& event)
 {
   if (!wxwindow->GetWindow ()) return;
@@ -1334,11 +1418,30 @@ void AppAresEditWX::OnSize (wxSizeEvent& event)
 
   wxwindow->GetWindow ()->SetSize (size);
   aresed3d->ResizeView (size.x, size.y);
+  RequestRedraw ();
   // TODO: ... but here the CanvasResize event has still not been catched by iGraphics3D
 }
 
 void AppAresEditWX::OnIdle (wxIdleEvent& event)
 {
+  if (!ready) return;
+
+  // Pending input is only handled when we process a frame.
+  csRef<iEventQueue> q (csQueryRegistry<iEventQueue> (object_reg));
+  if (!q->IsEmpty ()) RequestRedraw ();
+
+  csTicks now = csGetTicks ();
+  if (idleFrameInterval > 0 && now >= redrawUntil && !IsAnimating ()
+      && now - lastFrameTime < idleFrameInterval)
+  {
+    if (!clockSuspended)
+    {
+      csRef<iVirtualClock> vc (csQueryRegistry<iVirtualClock> (object_reg));
+      if (vc) vc->Suspend ();
+      clockSuspended = true;
+    }
+    return;
+  }
   PushFrame();
 }
 
@@ -1415,6 +1518,7 @@ void AppAresEditWX::SwitchToMode (const char* name)
     editMode = mode;
     editMode->Start ();
     SetMenuState ();
+    RequestRedraw ();
   }
   else
   {
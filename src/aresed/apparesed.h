@@ -133,6 +133,14 @@ private:
 
   int wantsFocus3D;
 
+  // Frame scheduling: frames are only rendered when needed.
+  csTicks lastFrameTime;
+  csTicks redrawUntil;
+  csTicks redrawSettleTime;
+  csTicks idleFrameInterval;	// 0 means render continuously.
+  bool clockSuspended;
+  bool IsAnimating () const;
+
   csRefArray<iEditorPlugin> plugins;
   csRef<iEditingMode> mainMode;
   csString mainModeName;
@@ -160,6 +168,7 @@ private:
   void ManageResources ();
   void OpenFile ();
   void SaveFile ();
+  void CompileCurrentFile ();
   void SaveCurrentFile ();
   void Quit ();
   void FindObject ();
@@ -228,6 +237,7 @@ public:
   bool InitToolbar ();
 
   void PushFrame ();
+  virtual void RequestRedraw ();
   void OnClose (wxCloseEvent& event);
   void OnIconize (wxIconizeEvent& event);
   void OnShow (wxShowEvent& event);
@@ -239,6 +249,9 @@ public:
 
   virtual void RegisterModification (iObject* resource = 0);
   virtual void RegisterModification (const csArray<iObject*>& resources);
+  virtual void RegisterModification (const csArray<iDynamicObject*>& objects);
+  virtual void RegisterRemoval (iObject* resource);
+  virtual void RegisterRemoval (const csArray<iDynamicObject*>& objects);
   bool IsCleanupAllowed ();
 
   void SwitchToMode (const char* name);
@@ -102,6 +102,7 @@ AresEdit3DView::AresEdit3DView (AppAresEditWX* app, iObjectRegistry* object_reg)
   curvedFactoryCounter = 0;
   roomFactoryCounter = 0;
   selection = 0;
+  refreshCollidersOnRelease = false;
   FocusLost = csevFocusLost (object_reg);
   modelRepository.AttachNew (new ModelRepository (this, app));
   camera.AttachNew (new Camera (this));
@@ -115,14 +116,36 @@ AresEdit3DView::~AresEdit3DView()
   delete selection;
 }
 
+void AresEdit3DView::ScheduleRefreshColliders (iDynamicObject* dynobj)
+{
+  if (pendingColliders.Find (dynobj) == csArrayItemNotFound)
+    pendingColliders.Push (dynobj);
+}
+
+void AresEdit3DView::FlushColliders ()
+{
+  for (size_t i = 0 ; i < pendingColliders.GetSize () ; i++)
+    if (pendingColliders[i])
+      pendingColliders[i]->RefreshColliders ();
+  pendingColliders.Empty ();
+}
+
 void AresEdit3DView::Frame (iEditingMode* editMode)
 {
+  if (!refreshCollidersOnRelease) FlushColliders ();
   if (paster->IsPasteSelectionActive ()) paster->PlacePasteMarker ();
 
   g3d->BeginDraw( CSDRAW_3DGRAPHICS);
   if (GetCsCamera ()->GetSector () == 0)
     g3d->GetDriver2D ()->Clear (0);
+  // Render from the sector of the room the camera is in so that rooms
+  // which can't be seen through the portals are culled.
+  iCamera* cam = GetCsCamera ();
+  iSector* cellSector = cam->GetSector ();
+  iSector* roomSector = FindRoomSector (cam->GetTransform ().GetOrigin ());
+  if (roomSector) cam->SetSector (roomSector);
   editMode->Frame3D ();
+  if (roomSector) cam->SetSector (cellSector);
   markerMgr->Frame3D ();
 
   g3d->BeginDraw (CSDRAW_2DGRAPHICS);
@@ -130,6 +153,19 @@ void AresEdit3DView::Frame (iEditingMode* editMode)
   markerMgr->Frame2D ();
 }
 
+bool AresEdit3DView::IsPhysicsActive () const
+{
+  if (!dynSys) return false;
+  for (size_t i = 0 ; i < dynSys->GetRigidBodyCount () ; i++)
+  {
+    CS::Physics::iRigidBody* body = dynSys->GetRigidBody (i);
+    if (body->GetState () != CS::Physics::STATE_DYNAMIC) continue;
+    if (body->GetLinearVelocity ().SquaredNorm () > .0001f) return true;
+    if (body->GetAngularVelocity ().SquaredNorm () > .0001f) return true;
+  }
+  return false;
+}
+
 bool AresEdit3DView::OnMouseMove (iEvent& ev)
 {
   // Save the mouse position
@@ -164,6 +200,7 @@ bool AresEdit3DView::OnMouseMove (iEvent& ev)
 
 void AresEdit3DView::SetStaticSelectedObjects (bool st)
 {
+  TransformTools::EndTransform ();
   SelectionIterator it = selection->GetIteratorInt ();
   while (it.HasNext ())
   {
@@ -179,15 +216,17 @@ void AresEdit3DView::SetStaticSelectedObjects (bool st)
         dynobj->MakeDynamic ();
     }
   }
-  app->RegisterModification ();
+  app->RegisterModification (selection->GetObjects ());
 }
 
 void AresEdit3DView::ChangeNameSelectedObject (const char* name)
 {
   if (selection->GetSize () < 1) return;
   selection->GetFirst ()->SetEntityName (name);
-  modelRepository->RefreshObjectsValue ();
-  app->RegisterModification ();
+  modelRepository->GetObjectsValueInt ()->RefreshObject (selection->GetFirst ());
+  csArray<iDynamicObject*> objects;
+  objects.Push (selection->GetFirst ());
+  app->RegisterModification (objects);
 }
 
 iEditorCamera* AresEdit3DView::GetEditorCamera () const
@@ -197,7 +236,11 @@ iEditorCamera* AresEdit3DView::GetEditorCamera () const
 
 void AresEdit3DView::SelectionChanged (const csArray<iDynamicObject*>& current_objects)
 {
-  modelRepository->GetObjectsValueInt ()->RefreshModel ();
+  ObjectsValue* objectsValue = modelRepository->GetObjectsValueInt ();
+  objectsValue->RefreshModel ();
+  // Selected objects are the ones that are usually being edited.
+  for (size_t i = 0 ; i < current_objects.GetSize () ; i++)
+    objectsValue->RefreshObject (current_objects[i]);
 
   bool curveTabEnable = false;
   if (selection->GetSize () == 1)
@@ -391,6 +434,7 @@ void AresEdit3DView::DeleteSelectedObjects ()
 {
   csArray<iDynamicObject*> objects = selection->GetObjects ();
   selection->SetCurrentObject (0);
+  app->RegisterRemoval (objects);
   SelectionIterator it = objects.GetIterator ();
   while (it.HasNext ())
   {
@@ -403,6 +447,7 @@ void AresEdit3DView::DeleteSelectedObjects ()
 void AresEdit3DView::CleanupWorld ()
 {
   selection->SetCurrentObject (0);
+  pendingColliders.Empty ();
 
   nature->CleanUp ();
 
@@ -412,6 +457,8 @@ void AresEdit3DView::CleanupWorld ()
   curvedFactoryCreators.DeleteAll ();
   roomFactoryCreators.DeleteAll ();
   static_factories.DeleteAll ();
+  roomSectorCells.DeleteAll ();
+  roomSectors.DeleteAll ();
 
   camlight = 0;
   dynworld->DeleteAll ();
@@ -469,7 +516,6 @@ void AresEdit3DView::RemoveItem (const char* category, const char* itemname)
 
 void AresEdit3DView::RemoveResources (const csSet<csPtrKey<iObject> >& resources)
 {
-  iAssetManager* assetMgr = app->GetAssetManager ();
   csSet<csPtrKey<iObject> >::GlobalIterator it = resources.GetIterator ();
   while (it.HasNext ())
   {
@@ -481,7 +527,7 @@ void AresEdit3DView::RemoveResources (const csSet<csPtrKey<iObject> >& resources
       if (!category) category = "Nodes";
       RemoveItem (category, fact->GetName ());
     }
-    assetMgr->RegisterRemoval (resource);
+    app->RegisterRemoval (resource);
     engine->RemoveObject (resource);
   }
   modelRepository->GetDynfactCollectionValue ()->Refresh ();
@@ -580,6 +626,11 @@ bool AresEdit3DView::Setup ()
   kbd = csQueryRegistry<iKeyboardDriver> (r);
   if (!kbd) return app->ReportError ("Failed to locate Keyboard Driver!");
 
+  csRef<iConfigManager> cfgmgr = csQueryRegistry<iConfigManager> (r);
+  refreshCollidersOnRelease = csString ("release") == cfgmgr->GetStr (
+      "Ares.ColliderRefresh", "frame");
+  useRoomSectors = cfgmgr->GetBool ("Ares.RoomSectors", false);
+
   pl = csQueryRegistry<iCelPlLayer> (object_reg);
   if (!pl) return app->ReportError ("CEL physical layer missing!");
 
@@ -878,6 +929,10 @@ bool AresEdit3DView::PostLoadMap ()
     sector = 0;
   }
 
+  for (size_t i = 0 ; i < roomSectorCells.GetSize () ; i++)
+    CreateRoomSectors (roomSectorCells[i]);
+  roomSectorCells.DeleteAll ();
+
   // Initialize collision objects for all loaded objects.
   csColliderHelper::InitializeCollisionWrappers (cdsys, engine);
   CS::Collisions::CollisionHelper helper;
@@ -1055,19 +1110,16 @@ csVector3 AresEdit3DView::GetBeamPosition (const char* fname)
   return newPosition;
 }
 
-iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
-    csReversibleTransform* trans)
+csString AresEdit3DView::CreateItemFactory (const char* name)
 {
   csString fname;
-  iCurvedFactory* curvedFactory = 0;
-  iRoomFactory* roomFactory = 0;
   CurvedFactoryCreator* cfc = FindFactoryCreator (name);
   RoomFactoryCreator* rfc = FindRoomFactoryCreator (name);
   if (cfc)
   {
     curvedFactoryCounter++;
-    fname.Format("%s%d", name.GetData (), curvedFactoryCounter);
-    curvedFactory = curvedMeshCreator->AddCurvedFactory (fname, name);
+    fname.Format("%s%d", name, curvedFactoryCounter);
+    iCurvedFactory* curvedFactory = curvedMeshCreator->AddCurvedFactory (fname, name);
 
     iDynamicFactory* fact = dynworld->AddFactory (fname, cfc->maxradius, cfc->imposterradius);
     csRef<iGeometryGenerator> ggen = scfQueryInterface<iGeometryGenerator> (curvedFactory);
@@ -1081,8 +1133,8 @@ iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
   else if (rfc)
   {
     roomFactoryCounter++;
-    fname.Format("%s%d", name.GetData (), roomFactoryCounter);
-    roomFactory = roomMeshCreator->AddRoomFactory (fname, name);
+    fname.Format("%s%d", name, roomFactoryCounter);
+    iRoomFactory* roomFactory = roomMeshCreator->AddRoomFactory (fname, name);
 
     iDynamicFactory* fact = dynworld->AddFactory (fname, 1.0f, -1.0f);
     csRef<iGeometryGenerator> ggen = scfQueryInterface<iGeometryGenerator> (roomFactory);
@@ -1097,7 +1149,48 @@ iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
   {
     fname = name;
   }
+  return fname;
+}
+
+iDynamicObject* AresEdit3DView::CreateItem (const char* fname,
+    const csReversibleTransform& trans, const char* tplName,
+    iCelParameterBlock* params)
+{
+  iDynamicObject* dynobj = dyncell->AddObject (fname, trans);
+  if (!dynobj)
+  {
+    app->GetUIManager ()->Error ("Could not create object for '%s'!", fname);
+    return 0;
+  }
 
+  if (tplName && *tplName)
+    dynobj->SetEntity (0, tplName, params);
+  else
+  {
+    csString defTplName = dynobj->GetFactory ()->GetDefaultEntityTemplate ();
+    if (defTplName.IsEmpty ())
+      defTplName = fname;
+    dynobj->SetEntity (defTplName == "Player" ? "Player" : 0, defTplName, 0);
+  }
+  dynworld->ForceVisible (dynobj);
+
+  if (static_factories.In (fname))
+    dynobj->MakeStatic ();
+  return dynobj;
+}
+
+void AresEdit3DView::SwitchToFactoryMode (const char* name)
+{
+  if (FindFactoryCreator (name))
+    app->SwitchToMode ("Curve");
+  else if (FindRoomFactoryCreator (name))
+    app->SwitchToMode ("Room");
+}
+
+iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
+    csReversibleTransform* trans)
+{
+  csString fname = CreateItemFactory (name);
   csVector3 newPosition = GetBeamPosition (fname);
 
   csReversibleTransform tc = GetCsCamera ()->GetTransform ();
@@ -1116,18 +1209,8 @@ iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
   paster->ConstrainTransform (tc);
   //pasteConstrainMode = CONSTRAIN_NONE;
 
-  iDynamicObject* dynobj = dyncell->AddObject (fname, tc);
-  if (!dynobj)
-  {
-    app->GetUIManager ()->Error ("Could not create object for '%s'!", fname.GetData ());
-    return 0;
-  }
-
-  csString tplName = dynobj->GetFactory ()->GetDefaultEntityTemplate ();
-  if (tplName.IsEmpty ())
-    tplName = fname;
-  dynobj->SetEntity (tplName == "Player" ? "Player" : 0, tplName, 0);
-  dynworld->ForceVisible (dynobj);
+  iDynamicObject* dynobj = CreateItem (fname, tc);
+  if (!dynobj) return 0;
 
   if (!static_factories.In (fname))
   {
@@ -1162,14 +1245,9 @@ iDynamicObject* AresEdit3DView::SpawnItem (const csString& name,
 #endif
   }
 
-  if (static_factories.In (fname))
-    dynobj->MakeStatic ();
   selection->SetCurrentObject (dynobj);
 
-  if (curvedFactory)
-    app->SwitchToMode ("Curve");
-  else if (roomFactory)
-    app->SwitchToMode ("Room");
+  SwitchToFactoryMode (name);
   return dynobj;
 }
 
@@ -1200,9 +1278,66 @@ iDynamicCell* AresEdit3DView::CreateCell (const char* name)
   ds->SetGravity (csVector3 (0.0f, -19.81f, 0.0f));
 
   iDynamicCell* cell = dynworld->AddCell (name, s, ds);
+  // The objects are not there yet. The room sectors are made after loading.
+  if (useRoomSectors)
+    roomSectorCells.Push (cell);
   return cell;
 }
 
+void AresEdit3DView::CreateRoomSectors (iDynamicCell* cell)
+{
+  size_t first = roomSectors.GetSize ();
+  for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+  {
+    iDynamicObject* dynobj = cell->GetObject (i);
+    iRoomFactory* roomFactory = roomMeshCreator->GetRoomFactory (
+	dynobj->GetFactory ()->GetName ());
+    if (!roomFactory) continue;
+    RoomSectors& rs = roomSectors.GetExtend (roomSectors.GetSize ());
+    rs.roomFactory = roomFactory;
+    rs.trans = dynobj->GetTransform ();
+    csString prefix;
+    prefix.Format ("%s_%s_%d", cell->GetName (), roomFactory->GetName (), int (i));
+    roomFactory->CreateSectors (prefix, rs.trans, rs.sectors);
+  }
+  if (first == roomSectors.GetSize ()) return;
+
+  // Other objects are rendered from the sectors of the rooms they are in.
+  csArray<size_t> rooms;
+  for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+  {
+    iDynamicObject* dynobj = cell->GetObject (i);
+    iMeshWrapper* mesh = dynobj->GetMesh ();
+    if (!mesh || roomMeshCreator->GetRoomFactory (dynobj->GetFactory ()->GetName ()))
+      continue;
+    const csBox3& box = dynobj->GetFactory ()->GetBBox ();
+    const csReversibleTransform& tr = dynobj->GetTransform ();
+    for (size_t r = first ; r < roomSectors.GetSize () ; r++)
+    {
+      RoomSectors& rs = roomSectors[r];
+      csBox3 roomBox;
+      for (int c = 0 ; c < 8 ; c++)
+	roomBox.AddBoundingVertex (rs.trans.Other2This (tr.This2Other (box.GetCorner (c))));
+      rooms.Empty ();
+      rs.roomFactory->FindRooms (roomBox, rooms);
+      for (size_t j = 0 ; j < rooms.GetSize () ; j++)
+	mesh->GetMovable ()->GetSectors ()->Add (rs.sectors[rooms[j]]);
+    }
+    mesh->GetMovable ()->UpdateMove ();
+  }
+}
+
+iSector* AresEdit3DView::FindRoomSector (const csVector3& pos)
+{
+  for (size_t i = 0 ; i < roomSectors.GetSize () ; i++)
+  {
+    RoomSectors& rs = roomSectors[i];
+    size_t idx = rs.roomFactory->FindRoom (rs.trans.Other2This (pos));
+    if (idx != csArrayItemNotFound) return rs.sectors[idx];
+  }
+  return 0;
+}
+
 bool AresEdit3DView::LoadLibrary (const char* path, const char* file)
 {
   // Set current VFS dir to the level dir, helps with relative paths in maps
@@ -196,6 +196,36 @@ private:
   /// The selection.
   Selection* selection;
 
+  /// Objects that need new colliders.
+  csWeakRefArray<iDynamicObject> pendingColliders;
+  /// Only refresh colliders in FlushColliders().
+  bool refreshCollidersOnRelease;
+
+  /// Give every room of a room object a sector of its own.
+  bool useRoomSectors;
+  /// Cells created since the last load that still need room sectors.
+  csArray<iDynamicCell*> roomSectorCells;
+  /// The sectors made for the rooms of one room object.
+  struct RoomSectors
+  {
+    iRoomFactory* roomFactory;
+    csReversibleTransform trans;
+    csRefArray<iSector> sectors;
+  };
+  csArray<RoomSectors> roomSectors;
+
+  /**
+   * Create sectors and portals for all room objects in the cell.
+   * Other objects are added to the sectors of the rooms they are in.
+   */
+  void CreateRoomSectors (iDynamicCell* cell);
+
+  /**
+   * Find the room sector that contains the given position or
+   * return 0 if there is none.
+   */
+  iSector* FindRoomSector (const csVector3& pos);
+
   /**
    * Clean up the current world.
    */
@@ -301,6 +331,12 @@ public:
   bool OnMouseUp(iEvent&);
   bool OnMouseMove (iEvent&);
 
+  /**
+   * Return true if there are dynamic bodies in the current cell that are
+   * still moving.
+   */
+  bool IsPhysicsActive () const;
+
   virtual bool IsAutoTime () const { return do_auto_time; }
   virtual void SetAutoTime (bool a) { do_auto_time = a; }
   virtual void ModifyCurrentTime (csTicks t) { currentTime += t; }
@@ -381,6 +417,30 @@ public:
   virtual iDynamicObject* SpawnItem (const csString& name,
       csReversibleTransform* trans = 0);
 
+  /**
+   * Return the name of the dynamic factory to use for objects of the
+   * given item. If the item is a curve or room factory creator a new
+   * factory is made here. Otherwise this is just the given name.
+   */
+  csString CreateItemFactory (const char* name);
+
+  /**
+   * Create an object for a dynamic factory (as returned by
+   * CreateItemFactory()) at a given world transform. Unlike SpawnItem()
+   * this doesn't look at the mouse, doesn't change the selection and
+   * doesn't switch modes so it can be used to create many objects at
+   * once. If 'tplName' is not given the default entity template of the
+   * factory is used.
+   */
+  iDynamicObject* CreateItem (const char* fname, const csReversibleTransform& trans,
+      const char* tplName = 0, iCelParameterBlock* params = 0);
+
+  /**
+   * Switch to the mode that edits objects of the given factory (curve or
+   * room mode) if there is such a mode.
+   */
+  void SwitchToFactoryMode (const char* name);
+
   /**
    * When the physical properties of a factory change or a new factory is created
    * we need to change various internal settings for this.
@@ -452,6 +512,9 @@ public:
 
   virtual iModelRepository* GetModelRepository () { return modelRepository; }
 
+  virtual void ScheduleRefreshColliders (iDynamicObject* dynobj);
+  virtual void FlushColliders ();
+
   /**
    * Final cleanup.
    */
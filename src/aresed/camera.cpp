@@ -164,6 +164,22 @@ void Camera::Pan (float rot_speed_x, float rot_speed_y, float distance)
   CamLookAtPosition (panningCenter);
 }
 
+bool Camera::IsAnimating () const
+{
+  // With gravity the collider actor can still be falling.
+  if (do_gravity) return true;
+
+  float sqdist = csSquaredDist::PointPoint (current.pos, desired.pos);
+  bool rotEqual = (current.rot.v - desired.rot.v).IsZero ()
+    && fabs (current.rot.w - desired.rot.w) < 0.00001f;
+  if (sqdist >= 0.02f || !rotEqual) return true;
+
+  iKeyboardDriver* kbd = aresed3d->GetKeyboardDriver ();
+  return kbd->GetKeyState ('w') || kbd->GetKeyState ('a')
+    || kbd->GetKeyState ('s') || kbd->GetKeyState ('d')
+    || kbd->GetKeyState (CSKEY_PGUP) || kbd->GetKeyState (CSKEY_PGDN);
+}
+
 void Camera::Frame (float elapsed_time, int mouseX, int mouseY)
 {
   if (!do_gravity)
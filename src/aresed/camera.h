@@ -81,6 +81,7 @@ public:
   virtual void DisablePanning ();
 
   virtual void Frame (float elapsed, int mouseX, int mouseY);
+  virtual bool IsAnimating () const;
   virtual bool OnMouseDown (iEvent& ev, uint but, int mouseX, int mouseY);
   virtual bool OnMouseUp (iEvent& ev, uint but, int mouseX, int mouseY);
   virtual bool OnMouseMove (iEvent& ev, int mouseX, int mouseY);
@@ -121,6 +121,7 @@ bool DynfactCollectionValue::DeleteValue (Value* child)
 	  if (o->GetFactory () == factory)
 	    toDelete.Push (o);
 	}
+	aresed3d->GetApp ()->RegisterRemoval (toDelete);
 	for (size_t i = 0 ; i < toDelete.GetSize () ; i++)
 	  cell->DeleteObject (toDelete[i]);
       }
@@ -128,8 +129,8 @@ bool DynfactCollectionValue::DeleteValue (Value* child)
     else
       return false;
   }
+  aresed3d->GetApp ()->RegisterRemoval (factory->QueryObject ());
   dynworld->RemoveFactory (factory);
-  aresed3d->GetApp ()->GetAssetManager ()->RegisterRemoval (factory->QueryObject ());
 
   aresed3d->RemoveItem (categoryValue->GetStringValue (), factoryName);
 
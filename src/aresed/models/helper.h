@@ -103,6 +103,10 @@ public:
   {
     return values[idx];
   }
+  virtual size_t GetChildCount ()
+  {
+    return values.GetSize ();
+  }
   size_t FindObject (T* obj) const
   {
     for (size_t i = 0 ; i < values.GetSize () ; i++)
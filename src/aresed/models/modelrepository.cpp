@@ -182,7 +182,7 @@ iAsset* ModelRepository::GetAssetFromAssets (Ares::Value* value)
 
 size_t ModelRepository::GetDynamicObjectIndexFromObjects (iDynamicObject* dynobj)
 {
-  return objectsValue->FindObject (dynobj);
+  return objectsValue->FindObjectRow (dynobj);
 }
 
 size_t ModelRepository::GetTemplateIndexFromTemplates (iCelEntityTemplate* tpl)
@@ -35,23 +35,101 @@ THE SOFTWARE.
 using namespace Ares;
 
 
+/**
+ * The row for a dynamic object. The strings of the row are only
+ * formatted when they are first needed (i.e. when the row is shown).
+ */
+class DynobjValue : public GenericStringArrayValue<iDynamicObject>
+{
+private:
+  AppAresEditWX* app;
+  bool formatted;
+
+  void Format ();
+
+public:
+  DynobjValue (AppAresEditWX* app, iDynamicObject* obj) :
+    GenericStringArrayValue<iDynamicObject> (obj), app (app), formatted (false) { }
+  virtual ~DynobjValue () { }
+
+  void Invalidate () { formatted = false; }
+
+  virtual const csStringArray* GetStringArrayValue ()
+  {
+    if (!formatted) Format ();
+    return &array;
+  }
+};
+
+void DynobjValue::Format ()
+{
+  formatted = true;
+  array.Empty ();
+  iDynamicObject* obj = GetObject ();
+  iCamera* camera = app->GetAresView ()->GetCsCamera ();
+  const csVector3& origin = camera->GetTransform ().GetOrigin ();
+  csString fmt;
+
+  fmt.Format ("%d", obj->GetID ());
+  array.Push (fmt);
+  array.Push (obj->GetEntityName ());
+  if (obj->GetEntityTemplate ())
+  {
+    csString tplName = obj->GetEntityTemplate ()->GetName ();
+    if (obj->GetEntityParameters ())
+      tplName += '#';
+    array.Push (tplName);
+  }
+  else
+  {
+    array.Push ("");
+  }
+  iDynamicFactory* fact = obj->GetFactory ();
+  array.Push (fact->GetName ());
+
+  const csReversibleTransform& trans = obj->GetTransform ();
+  fmt.Format ("%g", trans.GetOrigin ().x);
+  array.Push (fmt);
+  fmt.Format ("%g", trans.GetOrigin ().y);
+  array.Push (fmt);
+  fmt.Format ("%g", trans.GetOrigin ().z);
+  array.Push (fmt);
+
+  float dist = sqrt (csSquaredDist::PointPoint (trans.GetOrigin (), origin));
+  fmt.Format ("%g", dist);
+  array.Push (fmt);
+
+  if (fact->IsLogicFactory ())
+    array.Push ("Logic");
+  if (fact->IsLightFactory ())
+    array.Push ("Light");
+  else
+    array.Push ("");
+}
+
+//--------------------------------------------------------------------------
+
 static int CompareDynobjValues (
     GenericStringArrayValue<iDynamicObject>* const & v1,
     GenericStringArrayValue<iDynamicObject>* const & v2)
 {
-  const char* s1 = v1->GetStringArrayValue ()->Get (DYNOBJ_COL_FACTORY);
-  const char* s2 = v2->GetStringArrayValue ()->Get (DYNOBJ_COL_FACTORY);
-  return strcmp (s1, s2);
+  // Compare the factories directly so that the rows don't have to be formatted.
+  iDynamicObject* o1 = v1->GetObject ();
+  iDynamicObject* o2 = v2->GetObject ();
+  int rc = strcmp (o1->GetFactory ()->GetName (), o2->GetFactory ()->GetName ());
+  if (rc != 0) return rc;
+  // Objects of the same factory are ordered on pointer so that every
+  // row has a unique place.
+  if (o1 < o2) return -1;
+  if (o1 > o2) return 1;
+  return 0;
 }
 
-
 void ObjectsValue::BuildModel ()
 {
   dirty = false;
   objectsHash.DeleteAll ();
   ReleaseChildren ();
-  iCamera* camera = app->GetAresView ()->GetCsCamera ();
-  const csVector3& origin = camera->GetTransform ().GetOrigin ();
   iDynamicCell* cell = app->GetAresView ()->GetDynamicCell ();
   if (!cell)
   {
@@ -64,46 +142,7 @@ void ObjectsValue::BuildModel ()
     if (withentities && !obj->GetEntityName ()) continue;
 
     csRef<GenericStringArrayValue<iDynamicObject> > child;
-    child.AttachNew (new GenericStringArrayValue<iDynamicObject> (obj));
-    csStringArray& array = child->GetArray ();
-    csString fmt;
-
-    fmt.Format ("%d", obj->GetID ());
-    array.Push (fmt);
-    array.Push (obj->GetEntityName ());
-    if (obj->GetEntityTemplate ())
-    {
-      csString tplName = obj->GetEntityTemplate ()->GetName ();
-      if (obj->GetEntityParameters ())
-	tplName += '#';
-      array.Push (tplName);
-    }
-    else
-    {
-      array.Push ("");
-    }
-    iDynamicFactory* fact = obj->GetFactory ();
-    array.Push (fact->GetName ());
-
-    const csReversibleTransform& trans = obj->GetTransform ();
-    fmt.Format ("%g", trans.GetOrigin ().x);
-    array.Push (fmt);
-    fmt.Format ("%g", trans.GetOrigin ().y);
-    array.Push (fmt);
-    fmt.Format ("%g", trans.GetOrigin ().z);
-    array.Push (fmt);
-
-    float dist = sqrt (csSquaredDist::PointPoint (trans.GetOrigin (), origin));
-    fmt.Format ("%g", dist);
-    array.Push (fmt);
-
-    if (fact->IsLogicFactory ())
-      array.Push ("Logic");
-    if (fact->IsLightFactory ())
-      array.Push ("Light");
-    else
-      array.Push ("");
-
+    child.AttachNew (new DynobjValue (app, obj));
     objectsHash.Put (obj, child);
     values.Push (child);
   }
@@ -119,29 +158,65 @@ void ObjectsValue::RefreshModel ()
     BuildModel ();
     return;
   }
-  if (withentities)
+
+  csSet<csPtrKey<iDynamicObject> > present;
+  for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
   {
-    BuildModel ();
-    return;
+    iDynamicObject* obj = cell->GetObject (i);
+    if (withentities && !obj->GetEntityName ()) continue;
+    present.Add (obj);
   }
-  if (cell->GetObjectCount () != objectsHash.GetSize ())
+
+  // Remove the rows of deleted objects. The objects themselves may be
+  // gone already so only the pointers are compared.
+  for (size_t i = values.GetSize () ; i-- > 0 ; )
   {
-    // Refresh needed!
-    BuildModel ();
-    return;
+    iDynamicObject* obj = values[i]->GetObject ();
+    if (present.Contains (obj)) continue;
+    objectsHash.DeleteAll (obj);
+    values[i]->SetParent (0);
+    values.DeleteIndex (i);
+    FireChildRemoved (i);
   }
 
   for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
   {
     iDynamicObject* obj = cell->GetObject (i);
-    StringArrayValue* child = objectsHash.Get (obj, 0);
-    if (!child)
-    {
-      BuildModel ();
-      return;
-    }
+    if (withentities && !obj->GetEntityName ()) continue;
+    if (objectsHash.Contains (obj)) continue;
+
+    csRef<GenericStringArrayValue<iDynamicObject> > child;
+    child.AttachNew (new DynobjValue (app, obj));
+    objectsHash.Put (obj, child);
+    size_t idx = values.InsertSorted (child, CompareDynobjValues);
+    FireChildInserted (idx);
   }
 }
 
+size_t ObjectsValue::FindObjectRow (iDynamicObject* obj)
+{
+  GenericStringArrayValue<iDynamicObject>* child = objectsHash.Get (obj, 0);
+  if (!child) return csArrayItemNotFound;
 
+  // The rows are sorted on factory and object so a binary search finds
+  // the row directly.
+  size_t lo = 0, hi = values.GetSize ();
+  while (lo < hi)
+  {
+    size_t mid = (lo + hi) / 2;
+    if (CompareDynobjValues (values[mid], child) < 0) lo = mid+1;
+    else hi = mid;
+  }
+  if (lo < values.GetSize () && values[lo] == child) return lo;
+  return csArrayItemNotFound;
+}
 
+void ObjectsValue::RefreshObject (iDynamicObject* obj)
+{
+  GenericStringArrayValue<iDynamicObject>* child = objectsHash.Get (obj, 0);
+  if (!child) return;
+  static_cast<DynobjValue*> (child)->Invalidate ();
+  size_t idx = FindObjectRow (obj);
+  if (idx != csArrayItemNotFound)
+    FireChildModified (idx);
+}
@@ -43,7 +43,24 @@ public:
   virtual ~ObjectsValue () { }
 
   virtual void BuildModel ();
+
+  /**
+   * Add rows for new objects and remove the rows of deleted objects
+   * without rebuilding the other rows.
+   */
   virtual void RefreshModel ();
+
+  /**
+   * The given object changed. Its row is formatted again the next
+   * time it is shown.
+   */
+  void RefreshObject (iDynamicObject* obj);
+
+  /**
+   * Find the row of an object. This is faster than FindObject()
+   * because the rows are sorted on factory.
+   */
+  size_t FindObjectRow (iDynamicObject* obj);
 };
 
 #endif // __aresed_objects_h
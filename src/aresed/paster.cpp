@@ -40,6 +40,8 @@ Paster::Paster () : scfImplementationType (this)
   pasteConstrainMode = CONSTRAIN_NONE;
   gridMode = false;
   gridSize = 0.1;
+  pasteColumns = pasteRows = 1;
+  scatterMode = false;
 }
 
 Paster::~Paster()
@@ -76,42 +78,112 @@ void Paster::CopySelection ()
   app->SetFocus3D ();
 }
 
-void Paster::PasteSelection ()
+csBox3 Paster::GetPasteBox (const csStringArray& factNames,
+    const csReversibleTransform& base)
 {
-  if (todoSpawn.GetSize () <= 0) return;
-  app->RegisterModification ();
-  csReversibleTransform trans = todoSpawn[0].trans;
-  csArray<iDynamicObject*> newobjects;
+  // Items with a transform keep their orientation and are placed
+  // relative to the first item. Items without one use 'base' itself.
+  csBox3 box;
+  const csVector3& origin = todoSpawn[0].trans.GetOrigin ();
   for (size_t i = 0 ; i < todoSpawn.GetSize () ; i++)
   {
-    csReversibleTransform tr = todoSpawn[i].trans;
-    csReversibleTransform* transPtr = 0;
-    if (todoSpawn[i].useTransform)
+    iDynamicFactory* fact = view3d->GetDynamicWorld ()->FindFactory (
+	factNames[i]);
+    if (!fact) continue;
+    const csBox3& fbox = fact->GetBBox ();
+    if (!todoSpawn[i].useTransform)
     {
-      tr.SetOrigin (tr.GetOrigin () - trans.GetOrigin ());
-      transPtr = &tr;
-    }
-    iDynamicObject* dynobj = view3d->SpawnItem (todoSpawn[i].dynfactName, transPtr);
-    if (todoSpawn[i].useTransform)
-    {
-      if (todoSpawn[i].isStatic)
-        dynobj->MakeStatic ();
-      else
-        dynobj->MakeDynamic ();
-    }
-    if (!todoSpawn[i].tplName.IsEmpty ())
-    {
-      dynobj->SetEntity (0, todoSpawn[i].tplName, todoSpawn[i].params);
+      box += fbox;
+      continue;
     }
+    const csReversibleTransform& tr = todoSpawn[i].trans;
+    for (int c = 0 ; c < 8 ; c++)
+      box.AddBoundingVertex (base.Other2ThisRelative (
+	    tr.This2Other (fbox.GetCorner (c)) - origin));
+  }
+  return box;
+}
+
+void Paster::PasteSelection ()
+{
+  if (todoSpawn.GetSize () <= 0) return;
+
+  // Curve and room items get a new factory for every copy because their
+  // geometry is edited per factory. These are the factories of the
+  // first copy.
+  csStringArray factNames;
+  for (size_t i = 0 ; i < todoSpawn.GetSize () ; i++)
+    factNames.Push (view3d->CreateItemFactory (todoSpawn[i].dynfactName));
+
+  // Everything is placed relative to the first item at the paste marker.
+  csReversibleTransform base = GetSpawnTransformation ();
+  ConstrainTransform (base);
+  csVector3 origin = todoSpawn[0].trans.GetOrigin ();
 
-    newobjects.Push (dynobj);
+  csVector3 size (1.0f);
+  if (pasteColumns > 1 || pasteRows > 1)
+  {
+    csBox3 box = GetPasteBox (factNames, base);
+    if (!box.Empty ()) size = box.Max () - box.Min ();
   }
 
-  view3d->GetSelection ()->SetCurrentObject (0);
-  for (size_t i = 0 ; i < newobjects.GetSize () ; i++)
-    view3d->GetSelection ()->AddCurrentObject (newobjects[i]);
+  csArray<iDynamicObject*> newobjects;
+  newobjects.SetCapacity (pasteColumns * pasteRows * todoSpawn.GetSize ());
+  for (int row = 0 ; row < pasteRows ; row++)
+    for (int col = 0 ; col < pasteColumns ; col++)
+    {
+      float x = float (col);
+      float z = float (row);
+      csMatrix3 rot;
+      bool scatter = scatterMode && (pasteColumns > 1 || pasteRows > 1);
+      if (scatter)
+      {
+	x += rng.Get () - 0.5f;
+	z += rng.Get () - 0.5f;
+	rot = csYRotMatrix3 (rng.Get () * 2.0f * PI);
+      }
+      csVector3 offset = base.This2OtherRelative (
+	  csVector3 (x * size.x, 0, z * size.z));
+      bool firstCopy = row == 0 && col == 0;
+      for (size_t i = 0 ; i < todoSpawn.GetSize () ; i++)
+      {
+	const PasteContents& pc = todoSpawn[i];
+	csReversibleTransform tr = base;
+	if (pc.useTransform)
+	{
+	  tr = pc.trans;
+	  tr.SetOrigin (base.GetOrigin () + pc.trans.GetOrigin () - origin);
+	}
+	if (scatter)
+	{
+	  // Turn the whole copy around the spot of the first item.
+	  tr.SetT2O (rot * tr.GetT2O ());
+	  tr.SetOrigin (base.GetOrigin ()
+	      + rot * (tr.GetOrigin () - base.GetOrigin ()));
+	}
+	tr.SetOrigin (tr.GetOrigin () + offset);
+	csString fname = firstCopy ? csString (factNames[i])
+	  : view3d->CreateItemFactory (pc.dynfactName);
+	iDynamicObject* dynobj = view3d->CreateItem (fname, tr,
+	    pc.tplName, pc.params);
+	if (!dynobj) continue;
+	if (pc.useTransform)
+	{
+	  if (pc.isStatic)
+	    dynobj->MakeStatic ();
+	  else
+	    dynobj->MakeDynamic ();
+	}
+	newobjects.Push (dynobj);
+      }
+    }
+
+  // This also updates the objects model for the new objects.
+  view3d->GetSelection ()->SetObjects (newobjects);
+  app->RegisterModification (newobjects);
 
-  view3d->GetModelRepository ()->GetObjectsValue ()->Refresh ();
+  if (!todoSpawn[0].useTransform)
+    view3d->SwitchToFactoryMode (todoSpawn[0].dynfactName);
 }
 
 void Paster::CreatePasteMarker ()
@@ -158,6 +230,31 @@ void Paster::ToggleGridMode ()
   gridMode = !gridMode;
 }
 
+void Paster::ToggleScatterMode ()
+{
+  scatterMode = !scatterMode;
+  if (IsPasteSelectionActive ())
+    UpdatePasteStatus ();
+}
+
+void Paster::SetPasteGrid (int columns, int rows)
+{
+  pasteColumns = csMax (columns, 1);
+  pasteRows = csMax (rows, 1);
+  if (IsPasteSelectionActive ())
+    UpdatePasteStatus ();
+}
+
+void Paster::UpdatePasteStatus ()
+{
+  csString grid;
+  if (pasteColumns > 1 || pasteRows > 1)
+    grid.Format (" (%dx%d copies%s)", pasteColumns, pasteRows,
+	scatterMode ? ", scattered" : "");
+  app->SetStatus ("Left mouse to place objects%s. Right button to cancel. x/z to constrain placement. q for grid. Arrows for more copies. r to scatter",
+      grid.GetData ());
+}
+
 
 void Paster::ConstrainTransform (csReversibleTransform& tr)
 {
@@ -216,10 +313,11 @@ void Paster::StartPasteSelection ()
   pasteConstrainMode = CONSTRAIN_NONE;
   ShowConstrainMarker (false, true, false);
   todoSpawn = pastebuffer;
+  pasteColumns = pasteRows = 1;
   if (IsPasteSelectionActive ())
     PlacePasteMarker ();
   app->SetMenuState ();
-  app->SetStatus ("Left mouse to place objects. Right button to cancel. x/z to constrain placement. q for grid");
+  UpdatePasteStatus ();
   app->SetFocus3D ();
 }
 
@@ -242,9 +340,10 @@ void Paster::StartPasteSelection (const char* name)
   apc.useTransform = false;
   apc.dynfactName = name;
   todoSpawn.Push (apc);
+  pasteColumns = pasteRows = 1;
   PlacePasteMarker ();
   app->SetMenuState ();
-  app->SetStatus ("Left mouse to place objects. Right button to cancel. x/z to constrain placement. # for grid");
+  UpdatePasteStatus ();
   app->SetFocus3D ();
 }
 
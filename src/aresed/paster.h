@@ -51,6 +51,9 @@ private:
   csVector3 pasteConstrain;
   bool gridMode;
   float gridSize;
+  int pasteColumns, pasteRows;
+  bool scatterMode;
+  csRandomGen rng;
 
   /// A paste buffer.
   csArray<PasteContents> pastebuffer;
@@ -66,6 +69,18 @@ private:
   /// Return where an item would be spawned if we were to spawn it now.
   csReversibleTransform GetSpawnTransformation ();
 
+  /**
+   * Return the box of the paste buffer in the space of 'base' (the
+   * transform of the first copy). 'factNames' are the dynamic factories
+   * used for the items of the paste buffer. This is used to space the
+   * copies of a grid paste.
+   */
+  csBox3 GetPasteBox (const csStringArray& factNames,
+      const csReversibleTransform& base);
+
+  /// Show the status line for paste mode.
+  void UpdatePasteStatus ();
+
 public:
   Paster ();
   virtual ~Paster ();
@@ -109,6 +124,11 @@ public:
   virtual void SetPasteConstrain (int mode);
   virtual int GetPasteConstrain () const { return pasteConstrainMode; }
   virtual size_t GetClipboardSize () const { return pastebuffer.GetSize (); }
+  virtual void SetPasteGrid (int columns, int rows);
+  virtual int GetPasteColumns () const { return pasteColumns; }
+  virtual int GetPasteRows () const { return pasteRows; }
+  virtual void ToggleScatterMode ();
+  virtual bool IsScatterModeEnabled () const { return scatterMode; }
 
   virtual void ToggleGridMode ();
   virtual bool IsGridModeEnabled () const { return gridMode; }
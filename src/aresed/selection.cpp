@@ -27,47 +27,218 @@ THE SOFTWARE.
 
 //---------------------------------------------------------------------------
 
+void SelectionMovableListener::MovableChanged (iMovable*)
+{
+  selection->MarkBoundsDirty (dynobj);
+}
+
+void SelectionMovableListener::MovableDestroyed (iMovable*)
+{
+  // The object probably gets a new mesh. That one is watched when the
+  // bounds are calculated again.
+  selection->MarkBoundsDirty (dynobj);
+}
+
+//---------------------------------------------------------------------------
+
 Selection::Selection (AresEdit3DView* aresed3d) :
-  scfImplementationType (this), aresed3d (aresed3d)
+  scfImplementationType (this), aresed3d (aresed3d), totalBoxValid (true),
+  centerSum (0), totalCenter (0)
 {
 }
 
-void Selection::FireSelectionListeners ()
+Selection::~Selection ()
 {
-  for (size_t i = 0 ; i < listeners.GetSize () ; i++)
-    listeners[i]->SelectionChanged (current_objects);
+  for (size_t i = 0 ; i < current_objects.GetSize () ; i++)
+    RemoveObjectBounds (current_objects[i]);
 }
 
-void Selection::AddCurrentObject (iDynamicObject* dynobj)
+void Selection::UpdateObjectBounds (iDynamicObject* dynobj, ObjectBounds& b)
 {
-  if (!dynobj) return;
-  if (current_objects.Find (dynobj) != csArrayItemNotFound)
+  iMeshWrapper* mesh = dynobj->GetMesh ();
+  if (b.mesh != mesh)
   {
-    current_objects.Delete (dynobj);
-    dynobj->SetHilight (false);
+    if (b.mesh)
+      b.mesh->GetMovable ()->RemoveListener (b.listener);
+    b.mesh = mesh;
+    if (mesh)
+    {
+      if (!b.listener)
+	b.listener.AttachNew (new SelectionMovableListener (this, dynobj));
+      mesh->GetMovable ()->AddListener (b.listener);
+    }
   }
-  else
+
+  const csBox3& box = dynobj->GetFactory ()->GetBBox ();
+  const csReversibleTransform& tr = dynobj->GetTransform ();
+  b.box.StartBoundingBox (tr.This2Other (box.GetCorner (0)));
+  for (int c = 1 ; c < 8 ; c++)
+    b.box.AddBoundingVertexSmart (tr.This2Other (box.GetCorner (c)));
+  b.center = tr.This2Other (box.GetCenter ());
+  b.valid = true;
+}
+
+void Selection::RemoveObjectBounds (iDynamicObject* dynobj)
+{
+  ObjectBounds* b = objectBounds.GetElementPointer (dynobj);
+  if (!b) return;
+  if (b->mesh)
+    b->mesh->GetMovable ()->RemoveListener (b->listener);
+  if (b->valid)
   {
-    current_objects.Push (dynobj);
-    dynobj->SetHilight (true);
+    centerSum -= b->center;
+    totalBoxValid = false;
   }
-  FireSelectionListeners ();
+  objectBounds.DeleteAll (dynobj);
+  dirtyBounds.Delete (dynobj);
 }
 
-void Selection::SetCurrentObject (iDynamicObject* dynobj)
+void Selection::UpdateBounds ()
+{
+  if (dirtyBounds.GetSize () > 0)
+  {
+    csArray<iDynamicObject*> stillDirty;
+    csSet<csPtrKey<iDynamicObject> >::GlobalIterator it = dirtyBounds.GetIterator ();
+    while (it.HasNext ())
+    {
+      iDynamicObject* dynobj = it.Next ();
+      ObjectBounds* b = objectBounds.GetElementPointer (dynobj);
+      if (!b) continue;
+      bool wasValid = b->valid;
+      csBox3 oldBox = b->box;
+      csVector3 oldCenter = b->center;
+      UpdateObjectBounds (dynobj, *b);
+      if (!b->mesh) stillDirty.Push (dynobj);
+
+      if (wasValid) centerSum -= oldCenter;
+      centerSum += b->center;
+      if (!totalBoxValid) continue;
+      // If the old box touched the side of the total box the total box
+      // might shrink. Otherwise it can only grow.
+      if (wasValid)
+	for (int i = 0 ; i < 3 ; i++)
+	  if (oldBox.Min (i) <= totalBox.Min (i)
+	      || oldBox.Max (i) >= totalBox.Max (i))
+	  {
+	    totalBoxValid = false;
+	    break;
+	  }
+      if (totalBoxValid)
+	totalBox += b->box;
+    }
+    dirtyBounds.DeleteAll ();
+    for (size_t i = 0 ; i < stillDirty.GetSize () ; i++)
+      dirtyBounds.AddNoTest (stillDirty[i]);
+  }
+
+  if (!totalBoxValid)
+  {
+    totalBox.StartBoundingBox ();
+    for (size_t i = 0 ; i < current_objects.GetSize () ; i++)
+    {
+      const ObjectBounds* b = objectBounds.GetElementPointer (current_objects[i]);
+      if (b && b->valid) totalBox += b->box;
+    }
+    totalBoxValid = true;
+  }
+  if (current_objects.GetSize () > 0)
+    totalCenter = centerSum / float (current_objects.GetSize ());
+  else
+    totalCenter.Set (0, 0, 0);
+}
+
+void Selection::FireSelectionListeners ()
+{
+  for (size_t i = 0 ; i < listeners.GetSize () ; i++)
+    listeners[i]->SelectionChanged (current_objects);
+  aresed3d->GetApplication ()->RequestRedraw ();
+}
+
+bool Selection::AddObjectInt (iDynamicObject* dynobj)
+{
+  if (!dynobj || selected.Contains (dynobj)) return false;
+  selected.AddNoTest (dynobj);
+  current_objects.Push (dynobj);
+  objectBounds.Put (dynobj, ObjectBounds ());
+  dirtyBounds.AddNoTest (dynobj);
+  dynobj->SetHilight (true);
+  return true;
+}
+
+void Selection::ClearInt ()
 {
   SelectionIterator it = current_objects.GetIterator ();
   while (it.HasNext ())
   {
     iDynamicObject* dynobj = it.Next ();
+    RemoveObjectBounds (dynobj);
     dynobj->SetHilight (false);
   }
   current_objects.DeleteAll ();
-  if (dynobj)
+  selected.DeleteAll ();
+  totalBox.StartBoundingBox ();
+  totalBoxValid = true;
+  centerSum.Set (0, 0, 0);
+}
+
+void Selection::AddCurrentObject (iDynamicObject* dynobj)
+{
+  if (!dynobj) return;
+  if (selected.Contains (dynobj))
   {
-    current_objects.Push (dynobj);
-    dynobj->SetHilight (true);
+    selected.Delete (dynobj);
+    current_objects.Delete (dynobj);
+    RemoveObjectBounds (dynobj);
+    dynobj->SetHilight (false);
   }
+  else
+    AddObjectInt (dynobj);
+  FireSelectionListeners ();
+}
+
+void Selection::SetCurrentObject (iDynamicObject* dynobj)
+{
+  ClearInt ();
+  AddObjectInt (dynobj);
+  FireSelectionListeners ();
+}
+
+void Selection::SetObjects (const csArray<iDynamicObject*>& objects)
+{
+  ClearInt ();
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    AddObjectInt (objects[i]);
+  FireSelectionListeners ();
+}
+
+void Selection::AddObjects (const csArray<iDynamicObject*>& objects)
+{
+  bool changed = false;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    if (AddObjectInt (objects[i]))
+      changed = true;
+  if (changed)
+    FireSelectionListeners ();
+}
+
+void Selection::RemoveObjects (const csArray<iDynamicObject*>& objects)
+{
+  bool changed = false;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    if (objects[i] && selected.Delete (objects[i]))
+    {
+      RemoveObjectBounds (objects[i]);
+      objects[i]->SetHilight (false);
+      changed = true;
+    }
+  if (!changed) return;
+
+  // Compact the ordered array in one pass.
+  size_t j = 0;
+  for (size_t i = 0 ; i < current_objects.GetSize () ; i++)
+    if (selected.Contains (current_objects[i]))
+      current_objects[j++] = current_objects[i];
+  current_objects.Truncate (j);
   FireSelectionListeners ();
 }
 
@@ -26,9 +26,11 @@ THE SOFTWARE.
 #define __aresed_selection_h
 
 #include "editor/iselection.h"
+#include "iengine/movable.h"
 
 struct iDynamicObject;
 class AresEdit3DView;
+class Selection;
 
 typedef csArray<iDynamicObject*>::Iterator SelectionIterator;
 
@@ -55,19 +57,81 @@ public:
   virtual void SelectionChanged (const csArray<iDynamicObject*>& current_objects) = 0;
 };
 
+/**
+ * Listens to the movable of a selected object so that only the bounds
+ * of objects that really moved are calculated again.
+ */
+class SelectionMovableListener : public scfImplementation1<
+  SelectionMovableListener, iMovableListener>
+{
+private:
+  Selection* selection;
+  iDynamicObject* dynobj;
+
+public:
+  SelectionMovableListener (Selection* selection, iDynamicObject* dynobj) :
+    scfImplementationType (this), selection (selection), dynobj (dynobj) { }
+  virtual ~SelectionMovableListener () { }
+
+  virtual void MovableChanged (iMovable* movable);
+  virtual void MovableDestroyed (iMovable* movable);
+};
+
 class Selection : public scfImplementation1<Selection, iSelection>
 {
 private:
   AresEdit3DView* aresed3d;
 
+  // The selected objects in order and the same objects for fast lookup.
   csArray<iDynamicObject*> current_objects;
+  csSet<csPtrKey<iDynamicObject> > selected;
   csRefArray<SelectionListener> listeners;
 
+  /**
+   * The cached world space bounds of every selected object. The listener
+   * on the movable of the mesh marks the entry dirty when it moves.
+   */
+  struct ObjectBounds
+  {
+    csWeakRef<iMeshWrapper> mesh;
+    csRef<iMovableListener> listener;
+    bool valid;
+    csBox3 box;
+    csVector3 center;
+    ObjectBounds () : valid (false) { }
+  };
+  csHash<ObjectBounds,csPtrKey<iDynamicObject> > objectBounds;
+  /**
+   * Selected objects for which the bounds have to be calculated again.
+   * Objects without a mesh can't be watched so they stay in here.
+   */
+  csSet<csPtrKey<iDynamicObject> > dirtyBounds;
+  /// If false totalBox has to be made again from the cached boxes.
+  bool totalBoxValid;
+  csBox3 totalBox;
+  /// The sum of the centers of all selected objects.
+  csVector3 centerSum;
+  csVector3 totalCenter;
+
+  void UpdateBounds ();
+  /// Calculate the bounds of one object and watch its mesh.
+  void UpdateObjectBounds (iDynamicObject* dynobj, ObjectBounds& b);
+  /// Stop watching an object and remove it from the aggregate bounds.
+  void RemoveObjectBounds (iDynamicObject* dynobj);
+
   void FireSelectionListeners ();
 
+  /// Add an object without notifying the listeners.
+  bool AddObjectInt (iDynamicObject* dynobj);
+  /// Remove all objects without notifying the listeners.
+  void ClearInt ();
+
 public:
   Selection (AresEdit3DView* aresed3d);
-  virtual ~Selection () { }
+  virtual ~Selection ();
+
+  /// Called by the movable listeners when a selected object moved.
+  void MarkBoundsDirty (iDynamicObject* dynobj) { dirtyBounds.Add (dynobj); }
 
   SelectionIterator GetIteratorInt () { return current_objects.GetIterator (); }
 
@@ -76,7 +140,6 @@ public:
     iSelectionIterator* it = new SelectionIteratorImp (current_objects.GetIterator ());
     return it;
   }
-  csArray<iDynamicObject*>& GetObjects () { return current_objects; }
   virtual const csArray<iDynamicObject*>& GetObjects () const { return current_objects; }
   virtual size_t GetSize () const { return current_objects.GetSize (); }
   virtual iDynamicObject* GetFirst () const { return current_objects[0]; }
@@ -85,6 +148,24 @@ public:
 
   virtual void SetCurrentObject (iDynamicObject* dynobj);
   virtual void AddCurrentObject (iDynamicObject* dynobj);
+  virtual bool IsSelected (iDynamicObject* dynobj) const
+  {
+    return selected.Contains (dynobj);
+  }
+  virtual void SetObjects (const csArray<iDynamicObject*>& objects);
+  virtual void AddObjects (const csArray<iDynamicObject*>& objects);
+  virtual void RemoveObjects (const csArray<iDynamicObject*>& objects);
+
+  virtual const csBox3& GetBoundingBox ()
+  {
+    UpdateBounds ();
+    return totalBox;
+  }
+  virtual const csVector3& GetCenter ()
+  {
+    UpdateBounds ();
+    return totalCenter;
+  }
 
   void AddSelectionListener (SelectionListener* listener)
   {
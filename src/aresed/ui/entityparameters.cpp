@@ -267,7 +267,9 @@ void EntityParameterDialog::OnOkButton (wxCommandEvent& event)
       tplName.IsEmpty () ? 0 : tplName.GetData (),
       params);
 
-  uiManager->GetApp ()->RegisterModification ();
+  csArray<iDynamicObject*> objects;
+  objects.Push (object);
+  uiManager->GetApp ()->RegisterModification (objects);
   uiManager->GetApp ()->Get3DView ()->GetModelRepository ()->GetObjectsValue ()->Refresh ();
 
   EndModal (TRUE);
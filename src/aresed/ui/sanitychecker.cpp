@@ -71,10 +71,17 @@ public:
   virtual void RefreshModel () { BuildModel (); }
 };
 
-SanityCheckerUI::SanityCheckerUI (UIManager* uiManager) : uiManager (uiManager)
+SanityCheckerUI::SanityCheckerUI (UIManager* uiManager) : uiManager (uiManager),
+  checker (0), pendingGeneral (false)
 {
 }
 
+SanityCheckerUI::~SanityCheckerUI ()
+{
+  value = 0;
+  delete checker;
+}
+
 class SanityCallback : public scfImplementation1<SanityCallback,iUIDialogCallback>
 {
 private:
@@ -88,7 +95,7 @@ public:
     uiManager (uiManager), checker (checker), value (value)
   {
   }
-  virtual ~SanityCallback () { delete checker; }
+  virtual ~SanityCallback () { }
 
   virtual void ButtonPressed (iUIDialog* dialog, const char* button)
   {
@@ -128,12 +135,17 @@ void SanityCheckerUI::Show ()
     dialog->Close ();
     dialog = 0;
   }
-  SanityChecker* checker = new SanityChecker (uiManager->GetApp ()->GetObjectRegistry (),
-      uiManager->GetApp ()->Get3DView ()->GetDynamicWorld ());
+  if (!checker)
+  {
+    checker = new SanityChecker (uiManager->GetApp ()->GetObjectRegistry (),
+        uiManager->GetApp ()->Get3DView ()->GetDynamicWorld ());
+    value.AttachNew (new SanityCheckerValue (checker));
+  }
+  pendingResources.DeleteAll ();
+  pendingObjects.DeleteAll ();
+  pendingGeneral = false;
   checker->CheckAll ();
-
-  csRef<SanityCheckerValue> value;
-  value.AttachNew (new SanityCheckerValue (checker));
+  value->BuildModel ();
 
   csRef<SanityCallback> cb;
   cb.AttachNew (new SanityCallback (uiManager, checker, value));
@@ -154,3 +166,74 @@ void SanityCheckerUI::Show ()
   dialog->ShowNonModal (cb);
 }
 
+void SanityCheckerUI::RegisterModification (iObject* resource)
+{
+  if (!checker || !IsOpen ()) return;
+  if (resource)
+    pendingResources.Add (resource);
+  else
+    pendingGeneral = true;
+}
+
+void SanityCheckerUI::RegisterModification (const csArray<iDynamicObject*>& objects)
+{
+  if (!checker || !IsOpen ()) return;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    pendingObjects.Add (objects[i]);
+  pendingGeneral = true;
+}
+
+void SanityCheckerUI::RegisterRemoval (iObject* resource)
+{
+  if (!checker || !IsOpen ()) return;
+  pendingResources.Delete (resource);
+  checker->RegisterRemoval (resource);
+  pendingGeneral = true;
+}
+
+void SanityCheckerUI::RegisterRemoval (const csArray<iDynamicObject*>& objects)
+{
+  if (!checker || !IsOpen ()) return;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    pendingObjects.Delete (objects[i]);
+  checker->RegisterRemoval (objects);
+  pendingGeneral = true;
+}
+
+void SanityCheckerUI::FlushModifications ()
+{
+  if (!pendingGeneral && pendingResources.GetSize () == 0) return;
+  if (!checker || !IsOpen ())
+  {
+    pendingResources.DeleteAll ();
+    pendingObjects.DeleteAll ();
+    pendingGeneral = false;
+    return;
+  }
+
+  csSet<csPtrKey<iObject> >::GlobalIterator resIt = pendingResources.GetIterator ();
+  while (resIt.HasNext ())
+    checker->CheckModified (resIt.Next ());
+  if (pendingGeneral)
+  {
+    csArray<iDynamicObject*> objects;
+    csSet<csPtrKey<iDynamicObject> >::GlobalIterator objIt = pendingObjects.GetIterator ();
+    while (objIt.HasNext ())
+      objects.Push (objIt.Next ());
+    checker->CheckModified (objects);
+  }
+  pendingResources.DeleteAll ();
+  pendingObjects.DeleteAll ();
+  pendingGeneral = false;
+  value->BuildModel ();
+}
+
+void SanityCheckerUI::Refresh ()
+{
+  pendingResources.DeleteAll ();
+  pendingObjects.DeleteAll ();
+  pendingGeneral = false;
+  if (!checker || !IsOpen ()) return;
+  checker->CheckAll ();
+  value->BuildModel ();
+}
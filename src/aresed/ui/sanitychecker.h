@@ -35,6 +35,9 @@ THE SOFTWARE.
 #include <wx/xrc/xmlres.h>
 
 class UIManager;
+class SanityChecker;
+class SanityCheckerValue;
+struct iDynamicObject;
 
 using namespace Ares;
 
@@ -44,11 +47,51 @@ private:
   UIManager* uiManager;
   csRef<iUIDialog> dialog;
 
+  /**
+   * The checker and its results stay alive after the first Show() so
+   * that modifications can be checked incrementally.
+   */
+  SanityChecker* checker;
+  csRef<SanityCheckerValue> value;
+
+  /**
+   * Modifications are collected and checked once per frame because
+   * dragging objects registers a modification every frame.
+   */
+  csSet<csPtrKey<iObject> > pendingResources;
+  csSet<csPtrKey<iDynamicObject> > pendingObjects;
+  bool pendingGeneral;
+
+  /// Return true if the results are shown (and have to be kept up to date).
+  bool IsOpen () const { return dialog && dialog->IsOpen (); }
+
 public:
   SanityCheckerUI (UIManager* uiManager);
-  ~SanityCheckerUI () { }
+  ~SanityCheckerUI ();
 
   void Show ();
+
+  /**
+   * Called by the editor whenever a resource (or, for 0, something in
+   * the world) was modified. This updates the live results. While the
+   * dialog is closed nothing is done: Show() checks everything again.
+   */
+  void RegisterModification (iObject* resource);
+
+  /// Called by the editor when the given objects were modified.
+  void RegisterModification (const csArray<iDynamicObject*>& objects);
+
+  /// Called by the editor before a resource is removed.
+  void RegisterRemoval (iObject* resource);
+
+  /// Called by the editor before objects are removed from the world.
+  void RegisterRemoval (const csArray<iDynamicObject*>& objects);
+
+  /// Check the modifications collected since the last frame.
+  void FlushModifications ();
+
+  /// The whole world changed (loading, new project, ...).
+  void Refresh ();
 };
 
 #endif // __appares_sanitychecker_h
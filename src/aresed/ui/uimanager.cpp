@@ -213,7 +213,7 @@ void UIDialog::AddList (const char* name, Value* collectionValue, size_t valueCo
 {
   CS_ASSERT (collectionValue->GetType () == VALUE_COLLECTION);
   CS_ASSERT (lastRowSizer != 0);
-  wxListCtrl* list = new wxListCtrl (mainPanel, wxID_ANY, wxDefaultPosition,
+  wxListCtrl* list = new VirtualListCtrl (mainPanel, wxID_ANY, wxDefaultPosition,
       wxDefaultSize, wxLC_REPORT | (multi ? 0 : wxLC_SINGLE_SEL));
   list->SetMinSize (wxSize (-1, height));
   lastRowSizer->Add (list, 1, wxEXPAND | wxALL | wxALIGN_CENTER_VERTICAL, 5);
@@ -241,7 +241,7 @@ void UIDialog::AddListIndexed (const char* name, Value* collectionValue, size_t
 {
   CS_ASSERT (collectionValue->GetType () == VALUE_COLLECTION);
   CS_ASSERT (lastRowSizer != 0);
-  wxListCtrl* list = new wxListCtrl (mainPanel, wxID_ANY, wxDefaultPosition,
+  wxListCtrl* list = new VirtualListCtrl (mainPanel, wxID_ANY, wxDefaultPosition,
       wxDefaultSize, wxLC_REPORT | (multi ? 0 : wxLC_SINGLE_SEL));
   list->SetMinSize (wxSize (-1, height));
   lastRowSizer->Add (list, 1, wxEXPAND | wxALL | wxALIGN_CENTER_VERTICAL, 5);
@@ -575,7 +575,7 @@ void UIDialog::Prepare ()
     csString name;
     const ValueListInfo& info = itvLst.Next (name);
     info.collectionValue->Refresh ();
-    for (int col = 0 ; col < info.list->GetItemCount () ; col++)
+    for (int col = 0 ; col < info.list->GetColumnCount () ; col++)
       info.list->SetColumnWidth (col, wxLIST_AUTOSIZE);
   }
 }
@@ -164,6 +164,7 @@ public:
   virtual int Show (iUIDialogCallback* cb);
   virtual void ShowNonModal (iUIDialogCallback* cb);
   virtual void Close ();
+  virtual bool IsOpen () const { return IsShown (); }
 
   /**
    * When any button is pressed (including Ok and Cancel) this will return
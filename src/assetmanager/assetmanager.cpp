@@ -23,8 +23,10 @@ THE SOFTWARE.
  */
 
 #include <crystalspace.h>
+#include "csutil/threadjobqueue.h"
 #include "include/icurvemesh.h"
 #include "include/irooms.h"
+#include "include/binlevel.h"
 #include "assetmanager.h"
 
 #include "propclass/dynworld.h"
@@ -33,6 +35,9 @@ THE SOFTWARE.
 #include "tools/questmanager.h"
 #include "tools/dynworldload.h"
 
+// Number of worker threads used to read and parse asset files.
+#define ASSET_READ_THREADS 4
+
 SCF_IMPLEMENT_FACTORY (AssetManager)
 
 AssetManager::AssetManager (iBase* parent) : scfImplementationType (this, parent)
@@ -151,6 +156,7 @@ bool AssetManager::LoadDoc (iDocument* doc)
   csRef<iDocumentNode> root = doc->GetRoot ();
   csRef<iDocumentNode> dynlevelNode = root->GetNode ("dynlevel");
 
+  csArray<BaseAsset> toLoad;
   csRef<iDocumentNodeIterator> it = dynlevelNode->GetNodes ();
   while (it->HasNext ())
   {
@@ -159,24 +165,15 @@ bool AssetManager::LoadDoc (iDocument* doc)
     csString value = child->GetValue ();
     if (value == "asset")
     {
-      csString normpath = child->GetAttributeValue ("path");
-      csString file = child->GetAttributeValue ("file");
-      csString mount = child->GetAttributeValue ("mount");
-      bool writable = child->GetAttributeValueAsBool ("writable");
-      csString colName;
-      colName.Format ("__col__%d__", colCounter++);
-      iCollection* collection = engine->CreateCollection (colName);
-      LoadAsset (normpath, file, mount, collection);
-
-      csRef<IntAsset> asset;
-      asset.AttachNew (new IntAsset (file, writable));
-      asset->SetMountPoint (mount);
-      asset->SetNormalizedPath (normpath);
-      asset->SetCollection (collection);
-      assets.Push (asset);
+      BaseAsset a (child->GetAttributeValue ("file"),
+	  child->GetAttributeValueAsBool ("writable"));
+      a.SetNormalizedPath (child->GetAttributeValue ("path"));
+      a.SetMountPoint (child->GetAttributeValue ("mount"));
+      toLoad.Push (a);
     }
     // Ignore the other tags. These are processed below.
   }
+  LoadAssets (toLoad);
 
   csRef<iDocumentNode> metaNode = dynlevelNode->GetNode ("meta");
   if (metaNode)
@@ -194,6 +191,42 @@ bool AssetManager::LoadDoc (iDocument* doc)
       return Error ("Error loading curves '%s'!", error->GetData ());
   }
 
+  csRef<iDocumentNode> roomNode = dynlevelNode->GetNode ("rooms");
+  if (roomNode)
+  {
+    csRef<iString> error = roomMeshCreator->Load (roomNode);
+    if (error)
+      return Error ("Error loading rooms '%s'!", error->GetData ());
+  }
+
+  SetupGeneratedFactories ();
+
+  csRef<iDocumentNode> dynworldNode = dynlevelNode->GetNode ("dynworld");
+  if (dynworldNode)
+  {
+    csRef<iString> error = dynworld->Load (dynworldNode);
+    if (error)
+      return Error ("Error loading dynworld '%s'!", error->GetData ());
+  }
+
+  csRef<iDocumentNode> locksNode = dynlevelNode->GetNode ("locks");
+  if (locksNode)
+  {
+    csRef<iDocumentNodeIterator> it = locksNode->GetNodes ();
+    while (it->HasNext ())
+    {
+      csRef<iDocumentNode> child = it->Next ();
+      if (child->GetType () != CS_NODE_ELEMENT) continue;
+      if (!LockResource (child->GetValue (), child->GetAttributeValue ("name")))
+	return false;
+    }
+  }
+
+  return true;
+}
+
+void AssetManager::SetupGeneratedFactories ()
+{
   for (size_t i = 0 ; i < curvedMeshCreator->GetCurvedFactoryCount () ; i++)
   {
     iCurvedFactory* cfact = curvedMeshCreator->GetCurvedFactory (i);
@@ -205,14 +238,6 @@ bool AssetManager::LoadDoc (iDocument* doc)
     curvedFactories.Push (fact);
   }
 
-  csRef<iDocumentNode> roomNode = dynlevelNode->GetNode ("rooms");
-  if (roomNode)
-  {
-    csRef<iString> error = roomMeshCreator->Load (roomNode);
-    if (error)
-      return Error ("Error loading rooms '%s'!", error->GetData ());
-  }
-
   for (size_t i = 0 ; i < roomMeshCreator->GetRoomFactoryCount () ; i++)
   {
     iRoomFactory* cfact = roomMeshCreator->GetRoomFactory (i);
@@ -223,58 +248,162 @@ bool AssetManager::LoadDoc (iDocument* doc)
     fact->AddRigidMesh (csVector3 (0), 10.0);
     roomFactories.Push (fact);
   }
+}
 
-  csRef<iDocumentNode> dynworldNode = dynlevelNode->GetNode ("dynworld");
-  if (dynworldNode)
+bool AssetManager::LockResource (const char* type, const char* name)
+{
+  csString value = type;
+  iObject* resource = 0;
+  if (value == "template")
   {
-    csRef<iString> error = dynworld->Load (dynworldNode);
-    if (error)
-      return Error ("Error loading dynworld '%s'!", error->GetData ());
+    csRef<iCelPlLayer> pl = csQueryRegistry<iCelPlLayer> (object_reg);
+    iCelEntityTemplate* tpl = pl->FindEntityTemplate (name);
+    if (tpl) resource = tpl->QueryObject ();
   }
-
-  csRef<iDocumentNode> locksNode = dynlevelNode->GetNode ("locks");
-  if (locksNode)
+  else if (value == "dynfact")
+  {
+    iDynamicFactory* df = dynworld->FindFactory (name);
+    if (df) resource = df->QueryObject ();
+  }
+  else if (value == "quest")
   {
     csRef<iQuestManager> questMgr = csQueryRegistry<iQuestManager> (object_reg);
-    csRef<iCelPlLayer> pl = csQueryRegistry<iCelPlLayer> (object_reg);
-    csRef<iDocumentNodeIterator> it = locksNode->GetNodes ();
-    while (it->HasNext ())
+    iQuestFactory* qf = questMgr->GetQuestFactory (name);
+    if (qf) resource = qf->QueryObject ();
+  }
+  else if (value == "lightfact")
+  {
+    iLightFactory* lf = engine->FindLightFactory (name);
+    if (lf) resource = lf->QueryObject ();
+  }
+  else
+    return Error ("Unexpected token '%s'!", value.GetData ());
+  if (resource)
+  {
+    Lock (resource);
+  }
+  else
+  {
+    Warn ("Can't lock resource '%s' with type '%s'!", name, value.GetData ());
+  }
+  return true;
+}
+
+const char* AssetManager::GetLockType (iObject* resource)
+{
+  csRef<iCelEntityTemplate> tpl = scfQueryInterface<iCelEntityTemplate> (resource);
+  if (tpl) return "template";
+  csRef<iDynamicFactory> df = scfQueryInterface<iDynamicFactory> (resource);
+  if (df) return "dynfact";
+  csRef<iQuestFactory> qf = scfQueryInterface<iQuestFactory> (resource);
+  if (qf) return "quest";
+  csRef<iLightFactory> lf = scfQueryInterface<iLightFactory> (resource);
+  if (lf) return "lightfact";
+  return 0;
+}
+
+bool AssetManager::LoadBinary (iDataBuffer* buf)
+{
+  BinaryLevelReader reader (buf->GetData (), buf->GetSize ());
+  if (!reader.ReadHeader ())
+    return Error ("Unsupported compiled level version!");
+
+  // The dynworld section refers to the curve and room factories so it
+  // is loaded after all other sections.
+  csString dynworldXml;
+  bool haveCurves = false, haveRooms = false;
+  uint32 tag;
+  while (reader.NextSection (tag))
+  {
+    if (tag == ARES_BINLEVEL_META)
     {
-      csRef<iDocumentNode> child = it->Next ();
-      if (child->GetType () != CS_NODE_ELEMENT) continue;
-      csString value = child->GetValue ();
-      iObject* resource = 0;
-      if (value == "template")
-      {
-	iCelEntityTemplate* tpl = pl->FindEntityTemplate (child->GetAttributeValue ("name"));
-	if (tpl) resource = tpl->QueryObject ();
-      }
-      else if (value == "dynfact")
-      {
-	iDynamicFactory* df = dynworld->FindFactory (child->GetAttributeValue ("name"));
-	if (df) resource = df->QueryObject ();
-      }
-      else if (value == "quest")
-      {
-	iQuestFactory* qf = questMgr->GetQuestFactory (child->GetAttributeValue ("name"));
-	if (qf) resource = qf->QueryObject ();
-      }
-      else if (value == "lightfact")
-      {
-	iLightFactory* lf = engine->FindLightFactory (child->GetAttributeValue ("name"));
-	if (lf) resource = lf->QueryObject ();
-      }
-      else
-        return Error ("Unexpected token '%s'!", value.GetData ());
-      if (resource)
-      {
-	Lock (resource);
-      }
-      else
+      projectData->SetName (reader.ReadString ());
+      projectData->SetShortDescription (reader.ReadString ());
+      projectData->SetDescription (reader.ReadString ());
+    }
+    else if (tag == ARES_BINLEVEL_ASSETS)
+    {
+      csArray<BaseAsset> toLoad;
+      size_t count = reader.ReadCount (4 * sizeof (uint32));
+      for (size_t i = 0 ; i < count ; i++)
       {
-        Warn ("Can't lock resource '%s' with type '%s'!", child->GetAttributeValue ("name"),
-	    value.GetData ());
+	csString normpath = reader.ReadString ();
+	csString file = reader.ReadString ();
+	csString mount = reader.ReadString ();
+	BaseAsset a (file, reader.ReadBool ());
+	a.SetNormalizedPath (normpath);
+	a.SetMountPoint (mount);
+	toLoad.Push (a);
       }
+      if (!reader.IsOk ()) break;
+      LoadAssets (toLoad);
+    }
+    else if (tag == ARES_BINLEVEL_CURVES)
+    {
+      csRef<iString> error = curvedMeshCreator->LoadBinary (reader);
+      if (error)
+	return Error ("Error loading curves '%s'!", error->GetData ());
+      haveCurves = true;
+    }
+    else if (tag == ARES_BINLEVEL_ROOMS)
+    {
+      csRef<iString> error = roomMeshCreator->LoadBinary (reader);
+      if (error)
+	return Error ("Error loading rooms '%s'!", error->GetData ());
+      haveRooms = true;
+    }
+    else if (tag == ARES_BINLEVEL_DYNWORLD)
+    {
+      dynworldXml = reader.ReadString ();
+    }
+    else if (tag == ARES_BINLEVEL_LOCKS)
+    {
+      // Locks refer to dynamic factories so we must also do them later.
+      continue;
+    }
+    // Unknown sections are skipped.
+    if (!reader.IsOk ())
+      return Error ("Compiled level is corrupt!");
+  }
+  if (!reader.IsOk ())
+    return Error ("Compiled level is corrupt!");
+  if (!haveCurves || !haveRooms)
+    return Error ("Compiled level is incomplete!");
+
+  SetupGeneratedFactories ();
+
+  if (!dynworldXml.IsEmpty ())
+  {
+    // CEL can only load the dynamic world from a document.
+    csRef<iDocumentSystem> docsys;
+    docsys.AttachNew (new csTinyDocumentSystem ());
+    csRef<iDocument> doc = docsys->CreateDocument ();
+    const char* err = doc->Parse (dynworldXml);
+    if (err)
+      return Error ("Error parsing dynworld '%s'!", err);
+    csRef<iDocumentNode> dynworldNode = doc->GetRoot ()->GetNode ("dynworld");
+    if (dynworldNode)
+    {
+      csRef<iString> error = dynworld->Load (dynworldNode);
+      if (error)
+	return Error ("Error loading dynworld '%s'!", error->GetData ());
+    }
+  }
+
+  // Second pass for the locks.
+  BinaryLevelReader lockReader (buf->GetData (), buf->GetSize ());
+  lockReader.ReadHeader ();
+  while (lockReader.NextSection (tag))
+  {
+    if (tag != ARES_BINLEVEL_LOCKS) continue;
+    size_t count = lockReader.ReadCount (2 * sizeof (uint32));
+    for (size_t i = 0 ; i < count ; i++)
+    {
+      csString type = lockReader.ReadString ();
+      csString name = lockReader.ReadString ();
+      if (!lockReader.IsOk ()) break;
+      if (!LockResource (type, name))
+	return false;
     }
   }
 
@@ -285,6 +414,13 @@ bool AssetManager::LoadFile (const char* filename)
 {
   NewProject ();
 
+  // A compiled level is recognized by its header. Reading it without
+  // null termination allows VFS to map the file in memory.
+  csRef<iDataBuffer> buf = vfs->ReadFile (filename, false);
+  if (buf && BinaryLevelReader::IsBinaryLevel (buf->GetData (), buf->GetSize ()))
+    return LoadBinary (buf);
+  buf.Invalidate ();
+
   csRef<iDocument> doc;
   csRef<iString> error = LoadDocument (object_reg, doc, 0, filename);
   if (!doc && !error)
@@ -317,8 +453,8 @@ csRef<scfStringArray> AssetManager::ConstructPath ()
   return fullPath;
 }
 
-bool AssetManager::LoadAsset (const csString& normpath, const csString& file, const csString& mount,
-    iCollection* collection)
+bool AssetManager::MountAsset (const csString& normpath, const csString& file,
+    const csString& mount, csString& rmount, bool& exists)
 {
   csRef<iString> path;
   if (!normpath.IsEmpty ())
@@ -329,7 +465,6 @@ bool AssetManager::LoadAsset (const csString& normpath, const csString& file, co
       return Error ("Cannot find asset '%s' in the asset path!\n", normpath.GetData ());
   }
 
-  csString rmount;
   if (mount.IsEmpty ())
   {
     rmount.Format ("/assets/__mnt_%d__/", mntCounter);
@@ -350,14 +485,9 @@ bool AssetManager::LoadAsset (const csString& normpath, const csString& file, co
   vfs->PushDir (rmount);
   // If the file doesn't exist we don't try to load it. That's not an error
   // as it might be saved later.
-  bool exists = vfs->Exists (file);
+  exists = vfs->Exists (file);
   vfs->PopDir ();
-  if (exists)
-  {
-    if (!LoadLibrary (rmount, file, collection))
-      return false;
-  }
-  else
+  if (!exists)
   {
     Warn ("Warning! File '%s/%s' does not exist!\n",
 	(!path) ? rmount.GetData () : path->GetData (), file.GetData ());
@@ -368,6 +498,154 @@ bool AssetManager::LoadAsset (const csString& normpath, const csString& file, co
   return true;
 }
 
+bool AssetManager::LoadAsset (const csString& normpath, const csString& file, const csString& mount,
+    iCollection* collection)
+{
+  csString rmount;
+  bool exists;
+  if (!MountAsset (normpath, file, mount, rmount, exists))
+    return false;
+  if (exists)
+  {
+    if (!LoadLibrary (rmount, file, collection))
+      return false;
+  }
+  return true;
+}
+
+//---------------------------------------------------------------------------------------
+
+/**
+ * Read and parse an asset file. This runs on a worker thread so it
+ * must not touch the engine. Files that are not XML (or that the
+ * document system can't parse) are left for the loader to handle.
+ */
+class AssetReadJob : public scfImplementation1<AssetReadJob, iJob>
+{
+private:
+  csRef<iVFS> vfs;
+  csRef<iDocumentSystem> docsys;
+  csString path;
+
+public:
+  csRef<iDocument> doc;
+  csString error;
+
+  AssetReadJob (iVFS* vfs, iDocumentSystem* docsys, const char* path) :
+    scfImplementationType (this), vfs (vfs), docsys (docsys), path (path) { }
+  virtual ~AssetReadJob () { }
+
+  virtual void Run ()
+  {
+    csRef<iDataBuffer> buf = vfs->ReadFile (path);
+    if (!buf)
+    {
+      error.Format ("Can't read '%s'", path.GetData ());
+      return;
+    }
+    // Only try to parse something that looks like XML. Other files
+    // (binary or compressed) are loaded directly by the loader later.
+    const char* data = buf->GetData ();
+    size_t size = buf->GetSize ();
+    size_t i = 0;
+    while (i < size && isspace ((unsigned char)data[i])) i++;
+    if (i >= size || data[i] != '<')
+    {
+      error.Format ("'%s' is not an XML file", path.GetData ());
+      return;
+    }
+    doc = docsys->CreateDocument ();
+    const char* err = doc->Parse (buf, true);
+    if (err)
+    {
+      error.Format ("Can't parse '%s': %s", path.GetData (), err);
+      doc.Invalidate ();
+    }
+  }
+};
+
+bool AssetManager::LoadAssets (const csArray<BaseAsset>& toLoad)
+{
+  // Mounting is cheap and changes the VFS so it is done here. Reading
+  // and parsing the files happens in parallel on the job queue. After
+  // that the assets are given to the loader in the original order as
+  // later assets can depend on the ones before them.
+  if (!jobQueue)
+    jobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (
+	  ASSET_READ_THREADS, CS::Threading::THREAD_PRIO_NORMAL, "assets"));
+  csRef<iDocumentSystem> docsys;
+  docsys.AttachNew (new csTinyDocumentSystem ());
+
+  csStringArray mounts;
+  csRefArray<AssetReadJob> jobs;
+  size_t first = assets.GetSize ();
+  for (size_t i = 0 ; i < toLoad.GetSize () ; i++)
+  {
+    const BaseAsset& a = toLoad[i];
+    csString colName;
+    colName.Format ("__col__%d__", colCounter++);
+    iCollection* collection = engine->CreateCollection (colName);
+
+    csRef<IntAsset> asset;
+    asset.AttachNew (new IntAsset (a.GetFile (), a.IsWritable ()));
+    asset->SetMountPoint (a.GetMountPoint ());
+    asset->SetNormalizedPath (a.GetNormalizedPath ());
+    asset->SetCollection (collection);
+    assets.Push (asset);
+
+    csString rmount;
+    bool exists;
+    csRef<AssetReadJob> job;
+    if (MountAsset (a.GetNormalizedPath (), a.GetFile (), a.GetMountPoint (), rmount, exists)
+	&& exists)
+    {
+      job.AttachNew (new AssetReadJob (vfs, docsys, rmount + a.GetFile ()));
+      jobQueue->Enqueue (job);
+    }
+    mounts.Push (rmount);
+    jobs.Push (job);
+  }
+
+  bool rc = true;
+  for (size_t i = 0 ; i < jobs.GetSize () ; i++)
+  {
+    AssetReadJob* job = jobs[i];
+    if (!job) continue;
+    // Runs the job here if no worker picked it up yet.
+    jobQueue->PullAndRun (job);
+    IntAsset* ia = static_cast<IntAsset*> (assets[first+i]);
+    if (!job->doc)
+    {
+      // Give the loader a chance with the file itself. It knows about
+      // more formats than plain XML.
+      if (!LoadLibrary (mounts[i], ia->GetFile (), ia->GetCollection ()))
+      {
+	Error ("%s!", job->error.GetData ());
+	rc = false;
+      }
+      continue;
+    }
+    // Set current VFS dir to the asset dir, helps with relative paths in maps
+    vfs->PushDir (mounts[i]);
+    csLoadResult lr = loader->Load (job->doc->GetRoot (), ia->GetCollection ());
+    vfs->PopDir ();
+    if (!lr.success)
+    {
+      Error ("Couldn't load asset '%s'!", ia->GetFile ().GetData ());
+      rc = false;
+    }
+    else if (ia->IsWritable ())
+    {
+      // Keep the document so that saving can update it.
+      ia->SetDocument (job->doc);
+      IndexAssetDocument (ia);
+    }
+  }
+  return rc;
+}
+
+//---------------------------------------------------------------------------------------
+
 bool AssetManager::NewProject ()
 {
   // @@@ Should this also unload all loaded data? Probably yes.
@@ -456,10 +734,46 @@ bool AssetManager::UpdateAssets (const csArray<BaseAsset>& update)
   return true;
 }
 
-bool AssetManager::SaveAsset (iDocumentSystem* docsys, iAsset* asset)
+bool AssetManager::WriteQuests (iDocumentNode* rootNode, iCollection* collection,
+    iDocumentNode* before)
+{
+  csRef<iQuestManager> questmgr = csQueryRegistryOrLoad<iQuestManager> (object_reg,
+      "cel.manager.quests");
+  if (!questmgr) return false;
+  csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT, before);
+  addonNode->SetValue ("addon");
+  addonNode->SetAttribute ("plugin", "cel.addons.questdef");
+  return questmgr->Save (addonNode, collection);
+}
+
+bool AssetManager::WriteDynamicFactories (iDocumentNode* rootNode, iCollection* collection,
+    iDocumentNode* before)
+{
+  csRef<iDynamicWorldSaver> saver = csLoadPluginCheck<iDynamicWorldSaver> (object_reg,
+      "cel.addons.dynamicworld.loader");
+  if (!saver) return false;
+  csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT, before);
+  addonNode->SetValue ("addon");
+  addonNode->SetAttribute ("plugin", "cel.addons.dynamicworld.loader");
+  return saver->WriteFactories (dynworld, addonNode, collection);
+}
+
+csRef<iDocumentNode> AssetManager::WriteTemplate (iDocumentNode* rootNode,
+    iCelEntityTemplate* temp, iDocumentNode* before)
+{
+  csRef<iSaverPlugin> saver = csLoadPluginCheck<iSaverPlugin> (object_reg,
+      "cel.addons.celentitytpl");
+  if (!saver) return 0;
+  csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT, before);
+  addonNode->SetValue ("addon");
+  addonNode->SetAttribute ("plugin", "cel.addons.celentitytpl");
+  if (!saver->WriteDown (temp, addonNode, 0))
+    return 0;
+  return addonNode;
+}
+
+bool AssetManager::WriteAssetDocument (iDocument* docasset, IntAsset* ia)
 {
-  csRef<iDocument> docasset = docsys->CreateDocument ();
-  IntAsset* ia = static_cast<IntAsset*> (asset);
   iCollection* collection = ia->GetCollection ();
 
   csRef<iDocumentNode> root = docasset->CreateRoot ();
@@ -475,49 +789,137 @@ bool AssetManager::SaveAsset (iDocumentSystem* docsys, iAsset* asset)
       return Error ("ERROR! Error saving light factories!\n");
   }
 
-  {
-    csRef<iQuestManager> questmgr = csQueryRegistryOrLoad<iQuestManager> (object_reg,
-	"cel.manager.quests");
-    if (!questmgr) return false;
-    csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT);
-    addonNode->SetValue ("addon");
-    addonNode->SetAttribute ("plugin", "cel.addons.questdef");
-    if (!questmgr->Save (addonNode, collection))
-      return false;
-  }
+  if (!WriteQuests (rootNode, collection))
+    return false;
+
+  if (!WriteDynamicFactories (rootNode, collection))
+    return false;
 
+  csRef<iCelPlLayer> pl = csQueryRegistry<iCelPlLayer> (object_reg);
+  csRef<iCelEntityTemplateIterator> tempIt = pl->GetEntityTemplates ();
+  while (tempIt->HasNext ())
   {
-    csRef<iDynamicWorldSaver> saver = csLoadPluginCheck<iDynamicWorldSaver> (object_reg,
-	"cel.addons.dynamicworld.loader");
-    if (!saver) return false;
-    csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT);
-    addonNode->SetValue ("addon");
-    addonNode->SetAttribute ("plugin", "cel.addons.dynamicworld.loader");
-    if (!saver->WriteFactories (dynworld, addonNode, collection))
-      return false;
+    iCelEntityTemplate* temp = tempIt->Next ();
+    if (!collection || collection->IsParentOf (temp->QueryObject ()))
+    {
+      if (!WriteTemplate (rootNode, temp))
+	return false;
+    }
   }
+  return true;
+}
 
+void AssetManager::IndexAssetDocument (IntAsset* ia)
+{
+  ia->GetResourceNodes ().Empty ();
+  iDocument* doc = ia->GetDocument ();
+  if (!doc) return;
+  csRef<iDocumentNode> rootNode = doc->GetRoot ()->GetNode ("library");
+  if (!rootNode) return;
+  csRef<iCelPlLayer> pl = csQueryRegistry<iCelPlLayer> (object_reg);
+  csRef<iDocumentNodeIterator> it = rootNode->GetNodes ("addon");
+  while (it->HasNext ())
   {
-    csRef<iSaverPlugin> saver = csLoadPluginCheck<iSaverPlugin> (object_reg,
-	"cel.addons.celentitytpl");
-    if (!saver) return 0;
-    csRef<iCelPlLayer> pl = csQueryRegistry<iCelPlLayer> (object_reg);
-    csRef<iCelEntityTemplateIterator> tempIt = pl->GetEntityTemplates ();
+    csRef<iDocumentNode> addonNode = it->Next ();
+    csString plugin = addonNode->GetAttributeValue ("plugin");
+    if (plugin != "cel.addons.celentitytpl") continue;
+    csRef<iDocumentNodeIterator> tempIt = addonNode->GetNodes ();
     while (tempIt->HasNext ())
     {
-      iCelEntityTemplate* temp = tempIt->Next ();
-      if (!collection || collection->IsParentOf (temp->QueryObject ()))
-      {
-        csString tempName = temp->GetName ();
-        csRef<iDocumentNode> addonNode = rootNode->CreateNodeBefore (CS_NODE_ELEMENT);
-        addonNode->SetValue ("addon");
-        addonNode->SetAttribute ("plugin", "cel.addons.celentitytpl");
-        if (!saver->WriteDown (temp, addonNode, 0))
-	  return false;
-      }
+      csRef<iDocumentNode> child = tempIt->Next ();
+      if (child->GetType () != CS_NODE_ELEMENT) continue;
+      iCelEntityTemplate* temp = pl->FindEntityTemplate (child->GetAttributeValue ("name"));
+      if (temp)
+	ia->GetResourceNodes ().PutUnique (temp->QueryObject (), addonNode);
+      break;
     }
   }
+}
+
+csRef<iDocumentNode> AssetManager::FindAddon (iDocumentNode* rootNode, const char* plugin)
+{
+  csRef<iDocumentNodeIterator> it = rootNode->GetNodes ("addon");
+  while (it->HasNext ())
+  {
+    csRef<iDocumentNode> addonNode = it->Next ();
+    if (csString (plugin) == addonNode->GetAttributeValue ("plugin"))
+      return addonNode;
+  }
+  return 0;
+}
+
+bool AssetManager::PatchAssetDocument (IntAsset* ia)
+{
+  iDocument* doc = ia->GetDocument ();
+  if (!doc || ia->IsStructureModified ()) return false;
+  csRef<iDocumentNode> rootNode = doc->GetRoot ()->GetNode ("library");
+  if (!rootNode) return false;
+
+  // First see if all modified resources can be patched. Light factories
+  // can only be saved all together so they need a full save.
+  bool questsModified = false, dynfactsModified = false;
+  csArray<iCelEntityTemplate*> templates;
+  csSet<csPtrKey<iObject> >::GlobalIterator it = ia->GetModifiedResources ().GetIterator ();
+  while (it.HasNext ())
+  {
+    iObject* resource = it.Next ();
+    csRef<iCelEntityTemplate> tpl = scfQueryInterface<iCelEntityTemplate> (resource);
+    if (tpl) { templates.Push (tpl); continue; }
+    csRef<iDynamicFactory> df = scfQueryInterface<iDynamicFactory> (resource);
+    if (df) { dynfactsModified = true; continue; }
+    csRef<iQuestFactory> qf = scfQueryInterface<iQuestFactory> (resource);
+    if (qf) { questsModified = true; continue; }
+    return false;
+  }
+
+  // Quests and dynamic factories are written per collection so their
+  // addon is replaced as a whole. Templates are replaced one by one.
+  iCollection* collection = ia->GetCollection ();
+  if (questsModified)
+  {
+    csRef<iDocumentNode> oldNode = FindAddon (rootNode, "cel.addons.questdef");
+    if (!WriteQuests (rootNode, collection, oldNode)) return false;
+    if (oldNode) rootNode->RemoveNode (oldNode);
+  }
+  if (dynfactsModified)
+  {
+    csRef<iDocumentNode> oldNode = FindAddon (rootNode, "cel.addons.dynamicworld.loader");
+    if (!WriteDynamicFactories (rootNode, collection, oldNode)) return false;
+    if (oldNode) rootNode->RemoveNode (oldNode);
+  }
+  for (size_t i = 0 ; i < templates.GetSize () ; i++)
+  {
+    iObject* resource = templates[i]->QueryObject ();
+    csRef<iDocumentNode> oldNode = ia->GetResourceNodes ().Get (resource, 0);
+    csRef<iDocumentNode> newNode = WriteTemplate (rootNode, templates[i], oldNode);
+    if (!newNode) return false;
+    if (oldNode) rootNode->RemoveNode (oldNode);
+    ia->GetResourceNodes ().PutUnique (resource, newNode);
+  }
+  return true;
+}
+
+bool AssetManager::SaveAsset (iDocumentSystem* docsys, iAsset* asset)
+{
+  IntAsset* ia = static_cast<IntAsset*> (asset);
 
+  // If possible only the modified resources are written again in the
+  // document we kept for this asset. Otherwise the document is rebuilt.
+  csRef<iDocument> docasset;
+  if (PatchAssetDocument (ia))
+    docasset = ia->GetDocument ();
+  else
+  {
+    docasset = docsys->CreateDocument ();
+    if (!WriteAssetDocument (docasset, ia))
+    {
+      // This document is incomplete so it can't be patched later.
+      ia->SetDocument (0);
+      return false;
+    }
+    ia->SetDocument (docasset);
+    IndexAssetDocument (ia);
+  }
 
   csRef<iString> xml;
   xml.AttachNew (new scfString ());
@@ -611,6 +1013,7 @@ csRef<iDocument> AssetManager::SaveDoc ()
   {
     IntAsset* ia = static_cast<IntAsset*> (assets[i]);
     ia->SetModified (false);
+    ia->SetStructureModified (false);
     ia->GetModifiedResources ().DeleteAll ();
   }
 
@@ -622,42 +1025,16 @@ csRef<iDocument> AssetManager::SaveDoc ()
     while (it.HasNext ())
     {
       iObject* resource = it.Next ();
-      csRef<iDocumentNode> resNode = locksNode->CreateNodeBefore (CS_NODE_ELEMENT);
-
-      csRef<iCelEntityTemplate> tpl = scfQueryInterface<iCelEntityTemplate> (resource);
-      if (tpl)
+      const char* type = GetLockType (resource);
+      if (!type)
       {
-        resNode->SetValue ("template");
-	resNode->SetAttribute ("name", resource->GetName ());
+	printf ("WHAT!\n"); fflush (stdout);
+	CS_ASSERT (false);
 	continue;
       }
-
-      csRef<iDynamicFactory> df = scfQueryInterface<iDynamicFactory> (resource);
-      if (df)
-      {
-        resNode->SetValue ("dynfact");
-	resNode->SetAttribute ("name", resource->GetName ());
-	continue;
-      }
-
-      csRef<iQuestFactory> qf = scfQueryInterface<iQuestFactory> (resource);
-      if (qf)
-      {
-        resNode->SetValue ("quest");
-	resNode->SetAttribute ("name", resource->GetName ());
-	continue;
-      }
-
-      csRef<iLightFactory> lf = scfQueryInterface<iLightFactory> (resource);
-      if (lf)
-      {
-	resNode->SetValue ("light");
-	resNode->SetAttribute ("name", resource->GetName ());
-	continue;
-      }
-
-      printf ("WHAT!\n"); fflush (stdout);
-      CS_ASSERT (false);
+      csRef<iDocumentNode> resNode = locksNode->CreateNodeBefore (CS_NODE_ELEMENT);
+      resNode->SetValue (type);
+      resNode->SetAttribute ("name", resource->GetName ());
     }
   }
 
@@ -678,6 +1055,75 @@ bool AssetManager::SaveFile (const char* filename)
   return true;
 }
 
+bool AssetManager::CompileFile (const char* filename)
+{
+  BinaryLevelWriter writer;
+  writer.WriteHeader ();
+
+  writer.BeginSection (ARES_BINLEVEL_META);
+  writer.WriteString (projectData->GetName ());
+  writer.WriteString (projectData->GetShortDescription ());
+  writer.WriteString (projectData->GetDescription ());
+  writer.EndSection ();
+
+  writer.BeginSection (ARES_BINLEVEL_ASSETS);
+  writer.WriteUInt32 (uint32 (assets.GetSize ()));
+  for (size_t i = 0 ; i < assets.GetSize () ; i++)
+  {
+    iAsset* asset = assets[i];
+    writer.WriteString (asset->GetNormalizedPath ());
+    writer.WriteString (asset->GetFile ());
+    writer.WriteString (asset->GetMountPoint ());
+    writer.WriteBool (asset->IsWritable ());
+  }
+  writer.EndSection ();
+
+  writer.BeginSection (ARES_BINLEVEL_CURVES);
+  curvedMeshCreator->SaveBinary (writer);
+  writer.EndSection ();
+
+  writer.BeginSection (ARES_BINLEVEL_ROOMS);
+  roomMeshCreator->SaveBinary (writer);
+  writer.EndSection ();
+
+  {
+    csRef<iDocumentSystem> docsys;
+    docsys.AttachNew (new csTinyDocumentSystem ());
+    csRef<iDocument> doc = docsys->CreateDocument ();
+    csRef<iDocumentNode> root = doc->CreateRoot ();
+    csRef<iDocumentNode> dynworldNode = root->CreateNodeBefore (CS_NODE_ELEMENT);
+    dynworldNode->SetValue ("dynworld");
+    dynworld->Save (dynworldNode);
+    csRef<iString> xml;
+    xml.AttachNew (new scfString ());
+    doc->Write (xml);
+    writer.BeginSection (ARES_BINLEVEL_DYNWORLD);
+    writer.WriteString (xml->GetData ());
+    writer.EndSection ();
+  }
+
+  writer.BeginSection (ARES_BINLEVEL_LOCKS);
+  csArray<iObject*> locks;
+  csSet<csPtrKey<iObject> >::GlobalIterator it = lockedResources.GetIterator ();
+  while (it.HasNext ())
+  {
+    iObject* resource = it.Next ();
+    if (GetLockType (resource)) locks.Push (resource);
+  }
+  writer.WriteUInt32 (uint32 (locks.GetSize ()));
+  for (size_t i = 0 ; i < locks.GetSize () ; i++)
+  {
+    writer.WriteString (GetLockType (locks[i]));
+    writer.WriteString (locks[i]->GetName ());
+  }
+  writer.EndSection ();
+
+  Report ("Compiling '%s' at '%s\n", filename, vfs->GetCwd ());
+  if (!vfs->WriteFile (filename, writer.GetData (), writer.GetSize ()))
+    return Error ("Error writing '%s'!", filename);
+  return true;
+}
+
 IntAsset* AssetManager::FindAssetForCollection (iCollection* collection)
 {
   // @@@ Avoid this loop?
@@ -785,6 +1231,7 @@ void AssetManager::RegisterRemoval (iObject* resource)
   if (asset)
   {
     asset->SetModified (true);
+    asset->SetStructureModified (true);
   }
   resourcesWithoutAsset.Delete (resource);
 }
@@ -802,6 +1249,7 @@ void AssetManager::PlaceResource (iObject* resource, iAsset* asset)
       if (ia)
       {
 	ia->SetModified (true);
+	ia->SetStructureModified (true);
 	wasModifiedInOriginalAsset = ia->GetModifiedResources ().Contains (resource);
 	ia->GetModifiedResources ().Delete (resource);
       }
@@ -814,6 +1262,7 @@ void AssetManager::PlaceResource (iObject* resource, iAsset* asset)
     IntAsset* ia = static_cast<IntAsset*> (asset);
     ia->GetCollection ()->Add (resource);
     ia->SetModified (true);
+    ia->SetStructureModified (true);
     if (wasModifiedInOriginalAsset)
       ia->GetModifiedResources ().Add (resource);
     resourcesWithoutAsset.Delete (resource);
@@ -30,6 +30,7 @@ THE SOFTWARE.
 struct iCurvedMeshCreator;
 struct iRoomMeshCreator;
 struct iCollection;
+struct iCelEntityTemplate;
 
 class IntAsset : public scfImplementation1<IntAsset,iAsset>
 {
@@ -42,11 +43,15 @@ private:
   bool modified;	// True if modified. Can be true even if there are no
   			// modified resources because a resource could have been deleted.
   csSet<csPtrKey<iObject> > modifiedResources;
+  bool structureModified;	// True if resources were added to or removed from
+  				// this asset in another way then RegisterModification().
+  csRef<iDocument> document;	// The last loaded or saved document for this asset.
+  csHash<csRef<iDocumentNode>,csPtrKey<iObject> > resourceNodes;
 
 public:
   IntAsset (const char* file, bool writable) :
     scfImplementationType (this),
-    file (file), writable (writable), modified (false)
+    file (file), writable (writable), modified (false), structureModified (false)
   { }
   virtual ~IntAsset () { }
 
@@ -66,6 +71,15 @@ public:
   void SetModified (bool m) { modified = m; }
   virtual bool IsModified () const { return modified; }
   csSet<csPtrKey<iObject> >& GetModifiedResources () { return modifiedResources; }
+
+  void SetStructureModified (bool m) { structureModified = m; }
+  bool IsStructureModified () const { return structureModified; }
+
+  void SetDocument (iDocument* doc) { document = doc; }
+  iDocument* GetDocument () const { return document; }
+  /// The addon node in the document for every entity template.
+  csHash<csRef<iDocumentNode>,csPtrKey<iObject> >& GetResourceNodes ()
+  { return resourceNodes; }
 };
 
 class ProjectData : public scfImplementation1<ProjectData, iProjectData>
@@ -107,6 +121,7 @@ private:
   csSet<csPtrKey<iObject> > resourcesWithoutAsset;
   csSet<csPtrKey<iObject> > lockedResources;
   int colCounter;
+  csRef<iJobQueue> jobQueue;
 
   bool generallyModified;	// A general modification outside of an asset has occured.
 
@@ -115,12 +130,58 @@ private:
 
   csRef<iDocument> SaveDoc ();
   bool LoadDoc (iDocument* doc);
+  bool LoadBinary (iDataBuffer* buf);
   bool LoadLibrary (const char* path, const char* file, iCollection* collection);
 
   bool SaveAsset (iDocumentSystem* docsys, iAsset* asset);
+  bool WriteAssetDocument (iDocument* docasset, IntAsset* ia);
+  bool WriteQuests (iDocumentNode* rootNode, iCollection* collection,
+      iDocumentNode* before = 0);
+  bool WriteDynamicFactories (iDocumentNode* rootNode, iCollection* collection,
+      iDocumentNode* before = 0);
+  csRef<iDocumentNode> WriteTemplate (iDocumentNode* rootNode,
+      iCelEntityTemplate* temp, iDocumentNode* before = 0);
+  csRef<iDocumentNode> FindAddon (iDocumentNode* rootNode, const char* plugin);
+
+  /**
+   * Remember the addon nodes of the entity templates in the document
+   * of this asset.
+   */
+  void IndexAssetDocument (IntAsset* ia);
+
+  /**
+   * Update the document of an asset by writing only the modified
+   * resources again. Returns false if this is not possible and the
+   * document has to be rebuilt.
+   */
+  bool PatchAssetDocument (IntAsset* ia);
   iAsset* HasAsset (const BaseAsset& a);
   bool LoadAsset (const csString& normpath, const csString& file, const csString& mount,
       iCollection* collection);
+  bool MountAsset (const csString& normpath, const csString& file,
+      const csString& mount, csString& rmount, bool& exists);
+
+  /**
+   * Load a number of assets and add them to the project. The files
+   * are read and parsed in parallel.
+   */
+  bool LoadAssets (const csArray<BaseAsset>& toLoad);
+
+  /**
+   * Create the dynamic factories for the curves and rooms.
+   */
+  void SetupGeneratedFactories ();
+
+  /**
+   * Lock a resource given the type as used in the 'locks' section.
+   * Returns false on an unknown type.
+   */
+  bool LockResource (const char* type, const char* name);
+
+  /**
+   * Get the type of a resource as used in the 'locks' section.
+   */
+  static const char* GetLockType (iObject* resource);
 
   /**
    * Find a suitable asset to save this resource. Returns 0
@@ -215,6 +276,11 @@ public:
    */
   virtual bool SaveFile (const char* filename);
 
+  /**
+   * Compile the world to a binary file.
+   */
+  virtual bool CompileFile (const char* filename);
+
   /**
    * Create a new project with the given assets.
    */
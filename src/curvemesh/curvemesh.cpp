@@ -40,7 +40,9 @@ THE SOFTWARE.
 #include "imap/services.h"
 #include "iengine/movable.h"
 #include "iengine/sector.h"
+#include "imesh/lod.h"
 
+#include "include/binlevel.h"
 #include "curvemesh.h"
 
 #define VERBOSE 0
@@ -77,25 +79,167 @@ void ClingyPath::RefreshWorkingPath ()
   points = basePoints;
 }
 
-static bool HeightDiff (const csVector3& pos, iMeshWrapper* thisMesh, float& dy)
+//---------------------------------------------------------------------------------------
+
+// Distance between two samples of the ground along the path.
+#define HEIGHT_STEP .25f
+// Maximum vertical distance between a point and the ground that we
+// still consider to be 'near' the ground.
+#define HEIGHT_RANGE 2.0f
+
+void HeightSampler::Clear ()
 {
-  const csReversibleTransform& meshtrans = thisMesh->GetMovable ()->GetTransform ();
-  csVector3 p = meshtrans.This2Other (pos);
-  iSector* sector = thisMesh->GetMovable ()->GetSectors ()->Get (0);
-  csSectorHitBeamResult result = sector->HitBeamPortals (
-      p + csVector3 (0, 2, 0), p - csVector3 (0, 2, 0));
-  if (result.mesh)
+  times.Empty ();
+  segments.DeleteAll ();
+  sector = 0;
+}
+
+static bool SameEntry (const PathEntry& p1, const PathEntry& p2)
+{
+  return p1.pos == p2.pos && p1.front == p2.front && p1.up == p2.up;
+}
+
+void HeightSampler::Sample (iMeshWrapper* thisMesh,
+    const csArray<PathEntry>& basePoints, float width, size_t first, size_t last)
+{
+  meshtrans = thisMesh->GetMovable ()->GetTransform ();
+  sector = thisMesh->GetMovable ()->GetSectors ()->Get (0);
+  size_t count = basePoints.GetSize ();
+  times.SetSize (count);
+  for (size_t i = 0 ; i < count ; i++)
+    times[i] = basePoints[i].time;
+  segments.SetSize (count-1);
+
+  for (size_t seg = 0 ; seg < count-1 ; seg++)
   {
-    dy = p.y - result.isect.y;
-    return true;
+    // The spline of a segment depends on the point before and after it.
+    PathEntry key[4];
+    for (int k = 0 ; k < 4 ; k++)
+    {
+      int idx = int (seg) + k - 1;
+      if (idx < 0) idx = 0;
+      if (idx >= int (count)) idx = int (count)-1;
+      key[k] = basePoints[idx];
+    }
+
+    HeightSegment* hs = segments[seg];
+    if (hs)
+    {
+      bool valid = hs->width == width
+	&& hs->meshtrans.GetOrigin () == meshtrans.GetOrigin ()
+	&& hs->meshtrans.GetO2T () == meshtrans.GetO2T ();
+      for (int k = 0 ; valid && k < 4 ; k++)
+	valid = SameEntry (hs->key[k], key[k]);
+      if (valid) continue;
+      segments.Put (seg, 0);
+    }
+    // Segments we don't need now are only dropped if they are out of date.
+    if (seg < first || seg > last) continue;
+
+    csRef<HeightSegment> newSeg;
+    newSeg.AttachNew (new HeightSegment ());
+    for (int k = 0 ; k < 4 ; k++)
+      newSeg->key[k] = key[k];
+    newSeg->width = width;
+    newSeg->meshtrans = meshtrans;
+
+    size_t pfirst = seg > 0 ? seg-1 : 0;
+    size_t plast = csMin (seg+2, count-1);
+    csPath path (1);
+    path.Setup (plast-pfirst+1);
+    for (size_t i = pfirst ; i <= plast ; i++)
+    {
+      const PathEntry& pe = basePoints[i];
+      path.SetTime (i-pfirst, pe.time);
+      path.SetPositionVector (i-pfirst, pe.pos);
+      path.SetForwardVector (i-pfirst, pe.front);
+      path.SetUpVector (i-pfirst, pe.up);
+    }
+
+    float dist = sqrt (csSquaredDist::PointPoint (key[1].pos, key[2].pos));
+    newSeg->steps = int (dist / HEIGHT_STEP) + 1;
+    newSeg->ground.SetSize ((newSeg->steps+1) * 3);
+    newSeg->hit.SetSize ((newSeg->steps+1) * 3);
+    for (int i = 0 ; i <= newSeg->steps ; i++)
+    {
+      float t = key[1].time + (key[2].time - key[1].time)
+	* float (i) / float (newSeg->steps);
+      path.CalculateAtTime (t);
+      csVector3 pos, front, up;
+      path.GetInterpolatedPosition (pos);
+      path.GetInterpolatedForward (front);
+      path.GetInterpolatedUp (up);
+      csVector3 right = (width / 2.0) * (front % up);
+      for (int line = 0 ; line < 3 ; line++)
+      {
+	// Only the first surface near the path is interesting.
+	csVector3 p = meshtrans.This2Other (pos + right * float (line-1));
+	csVector3 start (p.x, p.y + HEIGHT_RANGE, p.z);
+	csVector3 end (p.x, p.y - HEIGHT_RANGE, p.z);
+	csSectorHitBeamResult result = sector->HitBeamPortals (start, end);
+	newSeg->hit[i*3+line] = result.mesh != 0;
+	newSeg->ground[i*3+line] = result.isect.y;
+      }
+    }
+    segments.Put (seg, newSeg);
   }
-  else
+}
+
+HeightSegment* HeightSampler::FindSegment (float time, float& fraction) const
+{
+  if (times.GetSize () < 2) return 0;
+  // The last segment that starts at or before this time.
+  size_t lo = 0, hi = times.GetSize ()-1;
+  while (hi-lo > 1)
   {
-    dy = 0.0f;
-    return false;
+    size_t mid = (lo+hi) / 2;
+    if (times[mid] <= time) lo = mid;
+    else hi = mid;
   }
+  HeightSegment* hs = segments[lo];
+  // A time on the border between two segments can use either one.
+  if (!hs && lo > 0 && time <= times[lo]) { lo--; hs = segments[lo]; }
+  if (!hs && lo+1 < segments.GetSize () && time >= times[lo+1])
+  {
+    lo++;
+    hs = segments[lo];
+  }
+  if (!hs) return 0;
+  float span = times[lo+1] - times[lo];
+  fraction = span > SMALL_EPSILON ? (time - times[lo]) / span : 0.0f;
+  if (fraction < 0.0f) fraction = 0.0f;
+  else if (fraction > 1.0f) fraction = 1.0f;
+  return hs;
 }
 
+bool HeightSampler::HeightDiff (float time, int line, const csVector3& pos,
+    float& dy) const
+{
+  dy = 0.0f;
+  float fraction;
+  HeightSegment* hs = FindSegment (time, fraction);
+  if (!hs) return false;
+  // Take the nearest sample so steps in the ground stay sharp.
+  int i = int (fraction * float (hs->steps) + .5f);
+  if (!hs->hit[i*3+line]) return false;
+  csVector3 p = meshtrans.This2Other (pos);
+  float y = hs->ground[i*3+line];
+  if (fabs (p.y - y) > HEIGHT_RANGE) return false;
+  dy = p.y - y;
+  return true;
+}
+
+void HeightSampler::HeightDiffs (const float* pathTimes, const csVector3* pos,
+    size_t count, float* dy, bool* hit) const
+{
+  for (size_t i = 0 ; i < count ; i++)
+    for (int line = 0 ; line < 3 ; line++)
+      hit[i*3+line] = HeightDiff (pathTimes[i], line, pos[i*3+line],
+	  dy[i*3+line]);
+}
+
+//---------------------------------------------------------------------------------------
+
 //#define BOTTOM_MARGIN .02f
 //#define TOP_MARGIN 1.0f
 #define BOTTOM_MARGIN .1f
@@ -110,7 +254,7 @@ static float cmax (bool u1, float v1, bool u2, float v2)
   return v2;
 }
 
-void ClingyPath::FitToTerrain (size_t idx, float width, iMeshWrapper* thisMesh)
+void ClingyPath::FitToTerrain (size_t idx, float width)
 {
   const csVector3& pos = points[idx].pos;
   csVector3 right = (width / 2.0) * (points[idx].front % points[idx].up);
@@ -118,9 +262,10 @@ void ClingyPath::FitToTerrain (size_t idx, float width, iMeshWrapper* thisMesh)
   csVector3 leftPos = pos - right;
 
   float dyL, dy, dyR;
-  bool hL = HeightDiff (leftPos, thisMesh, dyL);
-  bool h  = HeightDiff (pos, thisMesh, dy);
-  bool hR = HeightDiff (rightPos, thisMesh, dyR);
+  float time = points[idx].time;
+  bool hL = sampler.HeightDiff (time, 0, leftPos, dyL);
+  bool h  = sampler.HeightDiff (time, 1, pos, dy);
+  bool hR = sampler.HeightDiff (time, 2, rightPos, dyR);
 
   if ((hL && dyL > TOP_MARGIN) || (hR && dyR > TOP_MARGIN))
   {
@@ -205,24 +350,84 @@ float ClingyPath::GetTotalDistance ()
 
 void ClingyPath::GeneratePath (csPath& path)
 {
-  size_t l = points.GetSize ();
+  GeneratePath (path, 0, points.GetSize ()-1);
+}
+
+void ClingyPath::GeneratePath (csPath& path, size_t first, size_t last)
+{
+  size_t l = last-first+1;
   path.Setup (l);
   for (size_t i = 0 ; i < l ; i++)
   {
-    path.SetTime (i, points[i].time);
-    path.SetPositionVector (i, points[i].pos);
-    path.SetForwardVector (i, points[i].front);
-    path.SetUpVector (i, points[i].up);
+    const PathEntry& pe = points[first+i];
+    path.SetTime (i, pe.time);
+    path.SetPositionVector (i, pe.pos);
+    path.SetForwardVector (i, pe.front);
+    path.SetUpVector (i, pe.up);
 #   if VERBOSE
     printf ("        path %d (%g): pos:%g,%g,%g front:%g,%g,%g up:%g,%g,%g\n",
-	i, points[i].time,
-	points[i].pos.x, points[i].pos.y, points[i].pos.z,
-	points[i].front.x, points[i].front.y, points[i].front.z,
-	points[i].up.x, points[i].up.y, points[i].up.z);
+	first+i, pe.time,
+	pe.pos.x, pe.pos.y, pe.pos.z,
+	pe.front.x, pe.front.y, pe.front.z,
+	pe.up.x, pe.up.y, pe.up.z);
 #   endif
   }
 }
 
+size_t ClingyPath::GenerateSegmentPath (csPath& path, size_t segIdx)
+{
+  // The spline between two points only depends on the point before
+  // and the point after the segment.
+  size_t first = segIdx > 0 ? segIdx-1 : 0;
+  size_t last = csMin (segIdx+2, points.GetSize ()-1);
+  GeneratePath (path, first, last);
+  return segIdx-first;
+}
+
+void ClingyPath::GenerateAnchorPath (csPath& path, size_t seg,
+    float& startTime, float& endTime, float& distance)
+{
+  size_t i0 = anchorIndices[seg];
+  size_t i1 = anchorIndices[seg+1];
+  size_t first = i0 > 0 ? i0-1 : 0;
+  size_t last = csMin (i1+1, points.GetSize ()-1);
+  GeneratePath (path, first, last);
+  startTime = points[i0].time;
+  endTime = points[i1].time;
+  distance = 0.0f;
+  for (size_t i = i0 ; i < i1 ; i++)
+    distance += sqrt (csSquaredDist::PointPoint (points[i].pos, points[i+1].pos));
+}
+
+void ClingyPath::UpdateAnchorIndices ()
+{
+  anchorIndices.Empty ();
+  for (size_t i = 0 ; i < points.GetSize () ; i++)
+    if (points[i].anchor)
+      anchorIndices.Push (i);
+}
+
+void ClingyPath::RemapTimes ()
+{
+  for (size_t seg = 0 ; seg+1 < anchorIndices.GetSize () ; seg++)
+  {
+    size_t i0 = anchorIndices[seg];
+    size_t i1 = anchorIndices[seg+1];
+    float oldStart = points[i0].time;
+    float oldEnd = points[i1].time;
+    float newStart = basePoints[seg].time;
+    float newEnd = basePoints[seg+1].time;
+    for (size_t i = i0+1 ; i < i1 ; i++)
+    {
+      float frac = oldEnd-oldStart > SMALL_EPSILON ?
+	(points[i].time-oldStart) / (oldEnd-oldStart) : 0.5f;
+      points[i].time = newStart + frac * (newEnd-newStart);
+    }
+  }
+  for (size_t seg = 0 ; seg < anchorIndices.GetSize () ; seg++)
+    points[anchorIndices[seg]].time = basePoints[seg].time;
+}
+
 void ClingyPath::GetSegmentTime (const csPath& path, size_t segIdx,
     float& startTime, float& endTime)
 {
@@ -235,13 +440,13 @@ void ClingyPath::GetSegmentTime (const csPath& path, size_t segIdx,
 #define LOOSE_BOTTOM_MARGIN .02f
 #define LOOSE_TOP_MARGIN 1.0f
 
-void ClingyPath::CalcMinMaxDY (size_t segIdx, float width, iMeshWrapper* thisMesh,
+void ClingyPath::CalcMinMaxDY (size_t segIdx, float width,
     float& maxRaiseY, float& maxLowerY)
 {
   csPath path (1);
-  GeneratePath (path);
+  size_t pathSegIdx = GenerateSegmentPath (path, segIdx);
   float startTime, endTime;
-  GetSegmentTime (path, segIdx, startTime, endTime);
+  GetSegmentTime (path, pathSegIdx, startTime, endTime);
 
   maxRaiseY = -1.0f;
   maxLowerY = -1.0f;
@@ -256,6 +461,11 @@ void ClingyPath::CalcMinMaxDY (size_t segIdx, float width, iMeshWrapper* thisMes
       segIdx, dist, steps, startTime, endTime, timeStep);
   Dump (10);
 # endif
+
+  // First collect the left/center/right positions for the whole segment
+  // so that the heights can be fetched in one batch.
+  csDirtyAccessArray<float> times;
+  csDirtyAccessArray<csVector3> samplePos;
   for (float t = startTime ; t <= endTime ; t += timeStep)
   {
     path.CalculateAtTime (t);
@@ -264,13 +474,26 @@ void ClingyPath::CalcMinMaxDY (size_t segIdx, float width, iMeshWrapper* thisMes
     path.GetInterpolatedForward (front);
     path.GetInterpolatedUp (up);
     csVector3 right = (width / 2.0) * (front % up);
-    csVector3 rightPos = pos + right;
-    csVector3 leftPos = pos - right;
-
-    float dyL, dy, dyR;
-    bool hL = HeightDiff (leftPos, thisMesh, dyL);
-    bool h  = HeightDiff (pos, thisMesh, dy);
-    bool hR = HeightDiff (rightPos, thisMesh, dyR);
+    times.Push (t);
+    samplePos.Push (pos - right);
+    samplePos.Push (pos);
+    samplePos.Push (pos + right);
+  }
+  size_t cnt = samplePos.GetSize ();
+  csDirtyAccessArray<float> dys;
+  csDirtyAccessArray<bool> hits;
+  dys.SetSize (cnt);
+  hits.SetSize (cnt);
+  sampler.HeightDiffs (times.GetArray (), samplePos.GetArray (),
+      times.GetSize (), dys.GetArray (), hits.GetArray ());
+
+  for (size_t i = 0 ; i < times.GetSize () ; i++)
+  {
+#   if VERBOSE
+    float t = times[i];
+#   endif
+    float dyL = dys[i*3+0], dy = dys[i*3+1], dyR = dys[i*3+2];
+    bool hL = hits[i*3+0], h = hits[i*3+1], hR = hits[i*3+2];
     if ((hL && dyL > LOOSE_TOP_MARGIN) || (hR && dyR > LOOSE_TOP_MARGIN))
     {
       float lowerY = cmax (hL, dyL-LOOSE_TOP_MARGIN, hR, dyR-LOOSE_TOP_MARGIN);
@@ -338,9 +561,9 @@ static float FindHorizontalMiddlePoint (csPath& path,
 void ClingyPath::SplitSegment (size_t segIdx)
 {
   csPath path (1);
-  GeneratePath (path);
+  size_t pathSegIdx = GenerateSegmentPath (path, segIdx);
   float startTime, endTime;
-  GetSegmentTime (path, segIdx, startTime, endTime);
+  GetSegmentTime (path, pathSegIdx, startTime, endTime);
 
   //float time = (startTime+endTime) / 2.0f;
   csVector3 pos1, pos2;
@@ -354,6 +577,7 @@ void ClingyPath::SplitSegment (size_t segIdx)
   path.CalculateAtTime (time);
   PathEntry pe;
   pe.time = time;
+  pe.anchor = false;
   path.GetInterpolatedPosition (pe.pos);
   path.GetInterpolatedForward (pe.front);
   path.GetInterpolatedUp (pe.up);
@@ -370,32 +594,22 @@ void ClingyPath::SplitSegment (size_t segIdx)
   points.Insert (segIdx+1, pe);
 }
 
-void ClingyPath::Flatten (iMeshWrapper* thisMesh, float width)
+void ClingyPath::FlattenSegments (size_t first, size_t last, float width)
 {
-  RefreshWorkingPath ();
-
-  // Flatten the terrain first.
-  for (size_t i = 0 ; i < points.GetSize () ; i++)
-    FitToTerrain (i, width, thisMesh);
-  Dump (2);
-
-  // Now fix the slope.
-  for (size_t i = 0 ; i < points.GetSize () ; i++)
-    FixSlope (i);
-
-  size_t segIdx = 0;
+  size_t segIdx = first;
   float maxRaiseY, maxLowerY;
-  while (segIdx < points.GetSize ()-1)
+  while (segIdx < last)
   {
-    CalcMinMaxDY (segIdx, width, thisMesh, maxRaiseY, maxLowerY);
+    CalcMinMaxDY (segIdx, width, maxRaiseY, maxLowerY);
     if (maxRaiseY > 0.0f || maxLowerY > 0.0f)
     {
       // The segment needs improving. Let's split it.
       SplitSegment (segIdx);
-      FitToTerrain (segIdx+1, width, thisMesh);
+      FitToTerrain (segIdx+1, width);
       FixSlope (segIdx);
       FixSlope (segIdx+1);
       FixSlope (segIdx+2);
+      last++;
     }
     else
     {
@@ -405,6 +619,58 @@ void ClingyPath::Flatten (iMeshWrapper* thisMesh, float width)
   }
 }
 
+void ClingyPath::SampleGround (iMeshWrapper* thisMesh, float width,
+    size_t firstSeg, size_t lastSeg)
+{
+  // Flattening only moves points up and down and splits the path so
+  // the ground along the spline of the base points is enough.
+  sampler.Sample (thisMesh, basePoints, width, firstSeg, lastSeg);
+}
+
+void ClingyPath::Flatten (float width)
+{
+  RefreshWorkingPath ();
+
+  // Flatten the terrain first.
+  for (size_t i = 0 ; i < points.GetSize () ; i++)
+    FitToTerrain (i, width);
+  Dump (2);
+
+  // Now fix the slope.
+  for (size_t i = 0 ; i < points.GetSize () ; i++)
+    FixSlope (i);
+
+  FlattenSegments (0, points.GetSize ()-1, width);
+  UpdateAnchorIndices ();
+}
+
+void ClingyPath::FlattenRange (float width, size_t firstSeg, size_t lastSeg)
+{
+  RemapTimes ();
+
+  // Replace the working points of the changed part with the base points.
+  size_t first = anchorIndices[firstSeg];
+  size_t last = anchorIndices[lastSeg+1];
+  csArray<PathEntry> newPoints;
+  newPoints.SetCapacity (points.GetSize ());
+  for (size_t i = 0 ; i < first ; i++)
+    newPoints.Push (points[i]);
+  for (size_t i = firstSeg ; i <= lastSeg+1 ; i++)
+    newPoints.Push (basePoints[i]);
+  for (size_t i = last+1 ; i < points.GetSize () ; i++)
+    newPoints.Push (points[i]);
+  points = newPoints;
+  last = first + lastSeg+1-firstSeg;
+
+  for (size_t i = first ; i <= last ; i++)
+    FitToTerrain (i, width);
+  for (size_t i = first ; i <= last ; i++)
+    FixSlope (i);
+
+  FlattenSegments (first, last, width);
+  UpdateAnchorIndices ();
+}
+
 void ClingyPath::Dump (int indent)
 {
 # if VERBOSE
@@ -425,6 +691,12 @@ void ClingyPath::Dump (int indent)
 
 //---------------------------------------------------------------------------------------
 
+// The rate at which the path is sampled before removing unneeded samples.
+#define SAMPLES_PER_UNIT 1.0f
+// The maximum distance between two emitted samples.
+#define MAX_SAMPLE_SPAN 25.0f
+#define DEFAULT_TOLERANCE .05f
+
 CurvedFactory::CurvedFactory (CurvedMeshCreator* creator, const char* name) :
   scfImplementationType (this), creator (creator), name (name)
 {
@@ -432,6 +704,16 @@ CurvedFactory::CurvedFactory (CurvedMeshCreator* creator, const char* name) :
   width = 1.0f;
   sideHeight = 0.4f;
   offsetHeight = 0.1f;
+  tolerance = DEFAULT_TOLERANCE;
+  dirtyFirst = csArrayItemNotFound;
+  dirtyLast = csArrayItemNotFound;
+  dirtyAll = true;
+  generation = 0;
+  groundChanged = false;
+  lodStart = 0.0f;
+  lodEnd = 0.0f;
+  jobPending = false;
+  lodDirty = false;
 
   factory = creator->engine->CreateMeshFactory (
 	"crystalspace.mesh.object.genmesh", name);
@@ -442,102 +724,607 @@ CurvedFactory::~CurvedFactory ()
 {
 }
 
-void CurvedFactory::GenerateGeometry (iMeshWrapper* thisMesh)
+float CurvedFactory::SampleError (const CurveSample& a, const CurveSample& b,
+    const CurveSample& s, float width)
 {
-# if VERBOSE
-  printf ("#############################################################\n");
-  fflush (stdout);
-# endif
-  csFlags oldFlags = thisMesh->GetFlags ();
-  thisMesh->GetFlags ().Set (CS_ENTITY_NOHITBEAM);
+  float span = b.distance - a.distance;
+  float t = span > SMALL_EPSILON ? (s.distance - a.distance) / span : 0.0f;
+  float w = width / 2.0f;
+  csVector3 ar = w * (a.front % a.up);
+  csVector3 br = w * (b.front % b.up);
+  csVector3 sr = w * (s.front % s.up);
+  // Compare the real edges of the strip at this sample with the edges
+  // we would get by interpolating between a and b.
+  csVector3 rightA = a.pos + ar, rightB = b.pos + br;
+  csVector3 leftA = a.pos - ar, leftB = b.pos - br;
+  csVector3 rightI = rightA + (rightB - rightA) * t;
+  csVector3 leftI = leftA + (leftB - leftA) * t;
+  float errR = sqrt (csSquaredDist::PointPoint (s.pos + sr, rightI));
+  float errL = sqrt (csSquaredDist::PointPoint (s.pos - sr, leftI));
+  return csMax (errR, errL);
+}
 
-  clingyPath.SetBasePoints (anchorPoints);
-# if VERBOSE
-  printf ("GenerateGeometry: Flatten\n"); fflush (stdout);
-# endif
-  clingyPath.Flatten (thisMesh, width);
-  csPath path (1);
+void CurvedFactory::TessellatePath (csPath& path, float startTime, float endTime,
+    float distance, float width, float tolerance, csArray<CurveSample>& samples)
+{
+  // Calculate a rounded number of samples from SAMPLES_PER_UNIT and
+  // then sample evenly over this part of the path.
+  size_t count = size_t (distance * SAMPLES_PER_UNIT) + 1;
+  if (count < 2) count = 2;
+
+  csArray<CurveSample> all;
+  all.SetCapacity (count);
+  csVector3 prevPos;
+  path.CalculateAtTime (startTime);
+  path.GetInterpolatedPosition (prevPos);
+  float traveledDistance = 0;
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    float time = startTime + (endTime-startTime) * float (i) / float (count-1);
+    path.CalculateAtTime (time);
+    CurveSample s;
+    path.GetInterpolatedPosition (s.pos);
+    path.GetInterpolatedForward (s.front);
+    path.GetInterpolatedUp (s.up);
+    traveledDistance += sqrt (csSquaredDist::PointPoint (s.pos, prevPos));
+    s.distance = traveledDistance;
+    prevPos = s.pos;
+    all.Push (s);
+  }
+
+  samples.Empty ();
+  if (tolerance <= 0.0f)
+  {
+    samples = all;
+    return;
+  }
+
+  // Greedily extend every span as long as all samples we skip can be
+  // reconstructed within the tolerance.
+  size_t start = 0;
+  samples.Push (all[0]);
+  while (start < count-1)
+  {
+    size_t end = start+1;
+    while (end+1 < count)
+    {
+      size_t cand = end+1;
+      if (all[cand].distance - all[start].distance > MAX_SAMPLE_SPAN) break;
+      bool ok = true;
+      for (size_t k = start+1 ; k < cand ; k++)
+	if (SampleError (all[start], all[cand], all[k], width) > tolerance)
+	{
+	  ok = false;
+	  break;
+	}
+      if (!ok) break;
+      end = cand;
+    }
+    samples.Push (all[end]);
+    start = end;
+  }
+}
+
+void CurvedFactory::TessellateSegments (ClingyPath& clingyPath, size_t first,
+    size_t last, float width, float tolerance,
+    csArray<csArray<CurveSample> >& samples)
+{
+  samples.SetSize (last-first+1);
+  for (size_t seg = first ; seg <= last ; seg++)
+  {
+    csPath path (1);
+    float startTime, endTime, distance;
+    clingyPath.GenerateAnchorPath (path, seg, startTime, endTime, distance);
+    TessellatePath (path, startTime, endTime, distance, width, tolerance,
+	samples[seg-first]);
+  }
+}
+
+void CurvedFactory::FlattenPath (ClingyPath& path, float width, bool all,
+    size_t flatFirst, size_t flatLast)
+{
+  if (all)
+  {
+#   if VERBOSE
+    printf ("GenerateGeometry: Flatten\n"); fflush (stdout);
+#   endif
+    path.Flatten (width);
+  }
+  else
+  {
+#   if VERBOSE
+    printf ("GenerateGeometry: FlattenRange %d-%d\n", int (flatFirst),
+	int (flatLast)); fflush (stdout);
+#   endif
+    path.FlattenRange (width, flatFirst, flatLast);
+  }
 # if VERBOSE
-  printf ("GenerateGeometry: GeneratePath\n"); fflush (stdout);
-# endif
-  clingyPath.GeneratePath (path);
   printf ("Path has %d control points\n",
-      int (clingyPath.GetWorkingPointCount ()));
+      int (path.GetWorkingPointCount ()));
   fflush (stdout);
-  float totalDistance = clingyPath.GetTotalDistance ();
+# endif
+}
 
-  // @@@todo, the entire detail on the path should be customizable. Also it should
-  // use less detail on relatively straight lines.
-  float samplesPerUnit = 1.0;
-  // Calculate a rounded number of samples from the samplesPerUnit and
-  // then correct samplesPerUnit so that the samples are evenly spread.
-  size_t samples = size_t (totalDistance / samplesPerUnit) + 1;
-  samplesPerUnit = totalDistance / (samples - 1);
+void CurveTessellateJob::Run ()
+{
+  CurvedFactory::FlattenPath (path, width, all, flatFirst, flatLast);
+  CurvedFactory::TessellateSegments (path, firstSeg, lastSeg, width, tolerance,
+      samples);
+  CS::Threading::AtomicOperations::Set (&done, 1);
+}
 
-  state->SetVertexCount (samples * 4);
-  state->SetTriangleCount ((samples-1) * 6);
+void CurvedFactory::WriteSample (const CurveSample& s, float distance,
+    csVector3* vertices, csVector3* normals, csVector2* texels)
+{
+  csVector3 right = (width / 2.0) * (s.front % s.up);
+  csVector3 down = -s.up.Unit () * sideHeight;
+  csVector3 offsetUp = s.up.Unit () * offsetHeight;
+
+  csVector3 rightPos = s.pos + right;
+  csVector3 leftPos = s.pos - right;
+  rightPos += offsetUp;
+  leftPos += offsetUp;
+
+  *vertices++ = rightPos;
+  *vertices++ = leftPos;
+  *vertices++ = rightPos + down;
+  *vertices++ = leftPos + down;
+  *normals++ = (s.up*.8+right*.2).Unit ();
+  *normals++ = (s.up*.8-right*.2).Unit ();
+  *normals++ = right;
+  *normals++ = -right;
+  *texels++ = csVector2 (0, distance / width);
+  *texels++ = csVector2 (1, distance / width);
+  *texels++ = csVector2 (-width/sideHeight, distance / width);
+  *texels++ = csVector2 (width/sideHeight, distance / width);
+}
+
+/**
+ * Write the triangles for a strip of samples. With side borders there
+ * are four vertices per sample and otherwise two.
+ */
+static void WriteStripTriangles (csTriangle* tris, size_t numSamples,
+    bool borders)
+{
+  int vtidx = 0;
+  for (size_t i = 0 ; i < numSamples-1 ; i++)
+  {
+    if (borders)
+    {
+      *tris++ = csTriangle (vtidx+5, vtidx+1, vtidx+0);
+      *tris++ = csTriangle (vtidx+4, vtidx+5, vtidx+0);
+      *tris++ = csTriangle (vtidx+6, vtidx+4, vtidx+0);
+      *tris++ = csTriangle (vtidx+2, vtidx+6, vtidx+0);
+      *tris++ = csTriangle (vtidx+3, vtidx+1, vtidx+7);
+      *tris++ = csTriangle (vtidx+7, vtidx+1, vtidx+5);
+      vtidx += 4;
+    }
+    else
+    {
+      *tris++ = csTriangle (vtidx+3, vtidx+1, vtidx+0);
+      *tris++ = csTriangle (vtidx+2, vtidx+3, vtidx+0);
+      vtidx += 2;
+    }
+  }
+}
+
+void CurvedFactory::UpdateBuffers (size_t firstSeg, size_t lastSeg)
+{
+  size_t segCount = segmentSamples.GetSize ();
+
+  // Calculate the new distance offsets and the total number of samples.
+  csArray<float> oldOffsets = segmentOffsets;
+  segmentOffsets.SetSize (segCount);
+  size_t numSamples = 1;
+  float offset = 0.0f;
+  for (size_t seg = 0 ; seg < segCount ; seg++)
+  {
+    const csArray<CurveSample>& samples = segmentSamples[seg];
+    segmentOffsets[seg] = offset;
+    offset += samples[samples.GetSize ()-1].distance;
+    numSamples += samples.GetSize ()-1;
+  }
+
+  bool all = numSamples * 4 != size_t (state->GetVertexCount ())
+    || oldOffsets.GetSize () != segCount;
+  if (all)
+  {
+    state->SetVertexCount (numSamples * 4);
+    state->SetTriangleCount ((numSamples-1) * 6);
+    WriteStripTriangles (state->GetTriangles (), numSamples, true);
+  }
 
-  csVector3 pos, front, up, prevPos;
   csVector3* vertices = state->GetVertices ();
   csVector3* normals = state->GetNormals ();
   csVector2* texels = state->GetTexels ();
 
-  path.CalculateAtTime (0);
-  path.GetInterpolatedPosition (prevPos);
+  size_t sampleIdx = 0;
+  for (size_t seg = 0 ; seg < segCount ; seg++)
+  {
+    const csArray<CurveSample>& samples = segmentSamples[seg];
+    // The first sample of a segment was already written as the last
+    // sample of the previous segment.
+    size_t start = seg == 0 ? 0 : 1;
+    bool write = all || (seg >= firstSeg && seg <= lastSeg);
+    bool moved = !write && fabs (segmentOffsets[seg]-oldOffsets[seg]) > SMALL_EPSILON;
+    for (size_t i = start ; i < samples.GetSize () ; i++, sampleIdx++)
+    {
+      float distance = segmentOffsets[seg] + samples[i].distance;
+      size_t vtidx = sampleIdx * 4;
+      if (write)
+	WriteSample (samples[i], distance, vertices+vtidx, normals+vtidx,
+	    texels+vtidx);
+      else if (moved)
+	for (size_t k = 0 ; k < 4 ; k++)
+	  texels[vtidx+k].y = distance / width;
+    }
+  }
 
-  float traveledDistance = 0;
-  for (size_t i = 0 ; i < samples ; i++)
+  state->Invalidate ();
+}
+
+void CurvedFactory::WriteLODLevel (int level)
+{
+  if (!lodFactories[level])
   {
-    float time = float (i) / float (samples-1);
-    path.CalculateAtTime (time);
-    path.GetInterpolatedPosition (pos);
-    traveledDistance += sqrt (csSquaredDist::PointPoint (pos, prevPos));
-    //printf ("%d time=%g pos=%g,%g,%g dist=%g\n", i, time, pos.x, pos.y, pos.z, traveledDistance); fflush (stdout);
-    prevPos = pos;
+    csString lodName;
+    lodName.Format ("%s_lod%d", name.GetData (), level);
+    lodFactories[level] = creator->engine->CreateMeshFactory (
+	"crystalspace.mesh.object.genmesh", lodName);
+  }
+  csRef<iGeneralFactoryState> lodState = scfQueryInterface<iGeneralFactoryState> (
+      lodFactories[level]->GetMeshObjectFactory ());
+
+  // Take every n'th sample of the full geometry but always keep the last one.
+  size_t stride = size_t (1) << level;
+  csArray<CurveSample> samples;
+  csArray<float> distances;
+  size_t sampleIdx = 0;
+  size_t segCount = segmentSamples.GetSize ();
+  for (size_t seg = 0 ; seg < segCount ; seg++)
+  {
+    const csArray<CurveSample>& segSamples = segmentSamples[seg];
+    size_t start = seg == 0 ? 0 : 1;
+    for (size_t i = start ; i < segSamples.GetSize () ; i++, sampleIdx++)
+    {
+      bool last = seg == segCount-1 && i == segSamples.GetSize ()-1;
+      if (sampleIdx % stride != 0 && !last) continue;
+      samples.Push (segSamples[i]);
+      distances.Push (segmentOffsets[seg] + segSamples[i].distance);
+    }
+  }
 
-    path.GetInterpolatedForward (front);
-    path.GetInterpolatedUp (up);
+  bool borders = level < CURVE_LOD_LEVELS-1;
+  size_t numSamples = samples.GetSize ();
+  size_t vtPerSample = borders ? 4 : 2;
+  lodState->SetVertexCount (numSamples * vtPerSample);
+  lodState->SetTriangleCount ((numSamples-1) * (borders ? 6 : 2));
 
-    csVector3 right = (width / 2.0) * (front % up);
-    csVector3 down = -up.Unit () * sideHeight;
-    csVector3 offsetUp = up.Unit () * offsetHeight;
-
-    csVector3 rightPos = pos + right;
-    csVector3 leftPos = pos - right;
-    rightPos += offsetUp;
-    leftPos += offsetUp;
-
-    *vertices++ = rightPos;
-    *vertices++ = leftPos;
-    *vertices++ = rightPos + down;
-    *vertices++ = leftPos + down;
-    *normals++ = (up*.8+right*.2).Unit ();
-    *normals++ = (up*.8-right*.2).Unit ();
-    *normals++ = right;
-    *normals++ = -right;
-    *texels++ = csVector2 (0, traveledDistance / width);
-    *texels++ = csVector2 (1, traveledDistance / width);
-    *texels++ = csVector2 (-width/sideHeight, traveledDistance / width);
-    *texels++ = csVector2 (width/sideHeight, traveledDistance / width);
-  }
-
-  csTriangle* tris = state->GetTriangles ();
-  int vtidx = 0;
-  for (size_t i = 0 ; i < samples-1 ; i++)
+  csVector3* vertices = lodState->GetVertices ();
+  csVector3* normals = lodState->GetNormals ();
+  csVector2* texels = lodState->GetTexels ();
+  for (size_t i = 0 ; i < numSamples ; i++)
   {
-    *tris++ = csTriangle (vtidx+5, vtidx+1, vtidx+0);
-    *tris++ = csTriangle (vtidx+4, vtidx+5, vtidx+0);
-    *tris++ = csTriangle (vtidx+6, vtidx+4, vtidx+0);
-    *tris++ = csTriangle (vtidx+2, vtidx+6, vtidx+0);
-    *tris++ = csTriangle (vtidx+3, vtidx+1, vtidx+7);
-    *tris++ = csTriangle (vtidx+7, vtidx+1, vtidx+5);
-    vtidx += 4;
+    csVector3 v[4], n[4];
+    csVector2 t[4];
+    WriteSample (samples[i], distances[i], v, n, t);
+    for (size_t k = 0 ; k < vtPerSample ; k++)
+    {
+      *vertices++ = v[k];
+      *normals++ = n[k];
+      *texels++ = t[k];
+    }
   }
+  WriteStripTriangles (lodState->GetTriangles (), numSamples, borders);
 
-  factory->GetMeshObjectFactory ()->SetMaterialWrapper (material);
-  state->Invalidate ();
+  lodFactories[level]->GetMeshObjectFactory ()->SetMaterialWrapper (material);
+  lodState->Invalidate ();
+}
+
+void CurvedFactory::RemoveLODChildren (LODMesh& lm)
+{
+  for (int level = 0 ; level < CURVE_LOD_LEVELS ; level++)
+    if (lm.children[level])
+    {
+      lm.children[level]->QuerySceneNode ()->SetParent (0);
+      creator->engine->RemoveObject (lm.children[level]);
+      lm.children[level] = 0;
+    }
+}
+
+void CurvedFactory::PruneLODMeshes ()
+{
+  for (size_t i = lodMeshes.GetSize () ; i-- > 0 ; )
+    if (!lodMeshes[i].parent)
+    {
+      RemoveLODChildren (lodMeshes[i]);
+      lodMeshes.DeleteIndex (i);
+    }
+}
+
+void CurvedFactory::DetachLOD (iMeshWrapper* thisMesh)
+{
+  PruneLODMeshes ();
+  for (size_t i = 0 ; i < lodMeshes.GetSize () ; i++)
+    if (lodMeshes[i].parent == thisMesh)
+    {
+      thisMesh->DestroyStaticLOD ();
+      RemoveLODChildren (lodMeshes[i]);
+      lodMeshes.DeleteIndex (i);
+      // Only a mesh we made invisible for LOD is made visible again.
+      thisMesh->GetFlags ().Reset (CS_ENTITY_INVISIBLEMESH);
+      break;
+    }
+}
+
+void CurvedFactory::AttachLOD (iMeshWrapper* thisMesh)
+{
+  PruneLODMeshes ();
+  iLODControl* lod = thisMesh->GetStaticLOD ();
+  if (!lod)
+  {
+    lod = thisMesh->CreateStaticLOD ();
+    LODMesh lm;
+    lm.parent = thisMesh;
+    for (int level = 0 ; level < CURVE_LOD_LEVELS ; level++)
+    {
+      csString lodName;
+      lodName.Format ("%s_lod%d", thisMesh->QueryObject ()->GetName (), level);
+      iMeshFactoryWrapper* fact = level == 0 ? factory : lodFactories[level];
+      csRef<iMeshWrapper> child = creator->engine->CreateMeshWrapper (
+	  fact, lodName);
+      // Only the parent mesh should be hit by beams.
+      child->GetFlags ().Set (CS_ENTITY_NOHITBEAM);
+      child->QuerySceneNode ()->SetParent (thisMesh->QuerySceneNode ());
+      thisMesh->AddMeshToStaticLOD (level, child);
+      lm.children[level] = child;
+    }
+    lodMeshes.Push (lm);
+  }
+
+  // A LOD value of 1 is full detail and 0 is the lowest detail.
+  float range = csMax (lodEnd - lodStart, SMALL_EPSILON);
+  lod->SetLOD (-1.0f / range, lodEnd / range);
+
+  // The mesh itself keeps the full geometry for physics and hit beams
+  // but only the LOD children are rendered.
+  thisMesh->GetFlags ().Set (CS_ENTITY_INVISIBLEMESH);
+}
+
+bool CurvedFactory::PrepareGeometry (iMeshWrapper* thisMesh, ClingyPath& path,
+    size_t& flatFirst, size_t& flatLast, size_t& firstSeg, size_t& lastSeg,
+    bool& all)
+{
+# if VERBOSE
+  printf ("#############################################################\n");
+  fflush (stdout);
+# endif
+  if (anchorPoints.GetSize () < 2)
+  {
+    state->SetVertexCount (0);
+    state->SetTriangleCount (0);
+    state->Invalidate ();
+    segmentSamples.Empty ();
+    segmentOffsets.Empty ();
+    dirtyAll = true;
+    return false;
+  }
+
+  // If the mesh was moved the ground below it is different so we
+  // have to do everything again.
+  const csReversibleTransform& trans = thisMesh->GetMovable ()->GetTransform ();
+  if (!(trans.GetOrigin () == lastTransform.GetOrigin ())
+      || !(trans.GetO2T () == lastTransform.GetO2T ()))
+    dirtyAll = true;
+  if (!dirtyAll && dirtyFirst == csArrayItemNotFound)
+  {
+    // The geometry is fine but this could be a new mesh for it.
+    if (lodEnd > 0.0f && lodFactories[1])
+      AttachLOD (thisMesh);
+    else
+      DetachLOD (thisMesh);
+    return false;
+  }
+
+  csFlags oldFlags = thisMesh->GetFlags ();
+  thisMesh->GetFlags ().Set (CS_ENTITY_NOHITBEAM);
+
+  size_t segCount = anchorPoints.GetSize ()-1;
+  clingyPath.SetBasePoints (anchorPoints);
+  if (groundChanged)
+  {
+    clingyPath.ClearGroundSamples ();
+    groundChanged = false;
+  }
+  if (&path != &clingyPath)
+    path.CopyWorkingPath (clingyPath);
+  all = dirtyAll;
+  if (dirtyAll)
+  {
+    flatFirst = 0;
+    flatLast = segCount-1;
+    firstSeg = 0;
+    lastSeg = segCount-1;
+  }
+  else
+  {
+    // Flatten the segments on both sides of the changed points.
+    flatFirst = dirtyFirst > 0 ? dirtyFirst-1 : 0;
+    flatLast = csMin (dirtyLast, segCount-1);
+    // The spline in the neighbouring segments also depends on the
+    // points we just changed.
+    firstSeg = flatFirst > 0 ? flatFirst-1 : 0;
+    lastSeg = csMin (flatLast+1, segCount-1);
+  }
+  // Only the ground sampling needs the engine. The flattening itself
+  // can happen later (on a worker thread).
+  path.SampleGround (thisMesh, width, flatFirst, flatLast);
 
   thisMesh->GetFlags ().SetAll (oldFlags.Get ());
+
+  dirtyAll = false;
+  dirtyFirst = dirtyLast = csArrayItemNotFound;
+  lastTransform = trans;
+  return true;
+}
+
+void CurvedFactory::UpdateLODLevels ()
+{
+  for (int level = 1 ; level < CURVE_LOD_LEVELS ; level++)
+    WriteLODLevel (level);
+  lodDirty = false;
+}
+
+void CurvedFactory::ApplyGeometry (iMeshWrapper* thisMesh, size_t firstSeg,
+    size_t lastSeg, bool all, bool finished,
+    csArray<csArray<CurveSample> >& samples)
+{
+  if (all)
+  {
+    segmentSamples.SetSize (samples.GetSize ());
+    segmentOffsets.Empty ();
+  }
+  for (size_t seg = firstSeg ; seg <= lastSeg ; seg++)
+    segmentSamples[seg] = samples[seg-firstSeg];
+  UpdateBuffers (firstSeg, lastSeg);
+
+  factory->GetMeshObjectFactory ()->SetMaterialWrapper (material);
+
+  if (lodEnd > 0.0f)
+  {
+    // Level 0 shares the factory so it is already up to date. The other
+    // levels are only written again when the edit is finished.
+    if (finished || !lodFactories[1])
+      UpdateLODLevels ();
+    else
+      lodDirty = true;
+    if (thisMesh)
+      AttachLOD (thisMesh);
+  }
+  else
+  {
+    if (thisMesh)
+      DetachLOD (thisMesh);
+    RemoveLODFactories ();
+  }
+}
+
+void CurvedFactory::GenerateGeometry (iMeshWrapper* thisMesh)
+{
+  WaitForJob ();
+  jobPending = false;
+
+  size_t flatFirst, flatLast, firstSeg, lastSeg;
+  bool all;
+  if (!PrepareGeometry (thisMesh, clingyPath, flatFirst, flatLast, firstSeg,
+	lastSeg, all))
+  {
+    // Finish the LOD levels that were skipped by background updates.
+    if (lodDirty && lodEnd > 0.0f && segmentSamples.GetSize () > 0)
+      UpdateLODLevels ();
+    return;
+  }
+  FlattenPath (clingyPath, width, all, flatFirst, flatLast);
+  csArray<csArray<CurveSample> > samples;
+  TessellateSegments (clingyPath, firstSeg, lastSeg, width, tolerance, samples);
+  ApplyGeometry (thisMesh, firstSeg, lastSeg, all, true, samples);
+}
+
+void CurvedFactory::GenerateGeometryAsync (iMeshWrapper* thisMesh)
+{
+  if (job)
+  {
+    // Only the latest request matters. It is started when the current
+    // job is finished.
+    jobPending = true;
+    jobMesh = thisMesh;
+    return;
+  }
+
+  csRef<CurveTessellateJob> newJob;
+  newJob.AttachNew (new CurveTessellateJob ());
+  size_t flatFirst, flatLast, firstSeg, lastSeg;
+  bool all;
+  if (!PrepareGeometry (thisMesh, newJob->path, flatFirst, flatLast, firstSeg,
+	lastSeg, all))
+    return;
+  job = newJob;
+  job->width = width;
+  job->tolerance = tolerance;
+  job->flatFirst = flatFirst;
+  job->flatLast = flatLast;
+  job->firstSeg = firstSeg;
+  job->lastSeg = lastSeg;
+  job->all = all;
+  job->generation = generation;
+  jobMesh = thisMesh;
+  creator->GetJobQueue ()->Enqueue (job);
+}
+
+bool CurvedFactory::WaitForJob ()
+{
+  if (!job) return true;
+  // Runs the job here if the worker didn't start it yet.
+  creator->GetJobQueue ()->PullAndRun (job);
+  csRef<CurveTessellateJob> finished = job;
+  job = 0;
+  // If everything changed while the job was running (points added or
+  // removed, new width, ...) its samples don't fit anymore. 'dirtyAll'
+  // is still set so the next generation redoes it all.
+  if (finished->generation != generation)
+    return false;
+  // The job flattened its own copy of the path. Nothing else changes
+  // our path while a job runs so it can simply take over the result.
+  clingyPath.CopyWorkingPath (finished->path);
+  ApplyGeometry (jobMesh, finished->firstSeg, finished->lastSeg, finished->all,
+      false,
+      finished->samples);
+  return true;
+}
+
+bool CurvedFactory::FinishGeometry ()
+{
+  if (!job || !job->IsDone ()) return false;
+  // A stale job is started again for the current state.
+  bool applied = WaitForJob ();
+  if (!applied)
+    jobPending = true;
+  if (jobPending)
+  {
+    jobPending = false;
+    if (jobMesh)
+      GenerateGeometryAsync (jobMesh);
+  }
+  return applied;
+}
+
+void CurvedFactory::SetLODDistances (float start, float end)
+{
+  lodStart = start;
+  lodEnd = end;
+  MarkAllDirty ();
+}
+
+void CurvedFactory::RemoveLODFactories ()
+{
+  for (size_t i = 0 ; i < lodMeshes.GetSize () ; i++)
+  {
+    LODMesh& lm = lodMeshes[i];
+    if (lm.parent)
+    {
+      lm.parent->DestroyStaticLOD ();
+      lm.parent->GetFlags ().Reset (CS_ENTITY_INVISIBLEMESH);
+    }
+    RemoveLODChildren (lm);
+  }
+  lodMeshes.DeleteAll ();
+  lodDirty = false;
+  for (int level = 0 ; level < CURVE_LOD_LEVELS ; level++)
+    if (lodFactories[level])
+    {
+      creator->engine->RemoveObject (lodFactories[level]);
+      lodFactories[level] = 0;
+    }
 }
 
 void CurvedFactory::SetMaterial (const char* materialName)
@@ -548,29 +1335,57 @@ void CurvedFactory::SetMaterial (const char* materialName)
     printf ("Could not find material '%s' for curve factory '%s'!\n",
 	materialName, name.GetData ());
     fflush (stdout);
+    return;
   }
+  // The geometry doesn't depend on the material so it is applied here
+  // instead of waiting for the next change of the geometry.
+  factory->GetMeshObjectFactory ()->SetMaterialWrapper (material);
+  for (int level = 0 ; level < CURVE_LOD_LEVELS ; level++)
+    if (lodFactories[level])
+      lodFactories[level]->GetMeshObjectFactory ()->SetMaterialWrapper (material);
 }
 
 void CurvedFactory::SetCharacteristics (float width, float sideHeight)
 {
   CurvedFactory::width = width;
   CurvedFactory::sideHeight = sideHeight;
+  MarkAllDirty ();
+}
+
+void CurvedFactory::MarkDirty (size_t idx)
+{
+  if (dirtyFirst == csArrayItemNotFound)
+  {
+    dirtyFirst = dirtyLast = idx;
+  }
+  else
+  {
+    if (idx < dirtyFirst) dirtyFirst = idx;
+    if (idx > dirtyLast) dirtyLast = idx;
+  }
 }
 
 size_t CurvedFactory::AddPoint (const csVector3& pos, const csVector3& front,
       const csVector3& up)
 {
+  MarkAllDirty ();
   return anchorPoints.Push (PathEntry (pos, front.Unit (), up.Unit ()));
 }
 
 void CurvedFactory::ChangePoint (size_t idx, const csVector3& pos,
     const csVector3& front, const csVector3& up)
 {
-  anchorPoints[idx] = PathEntry (pos, front.Unit (), up.Unit ());
+  PathEntry pe (pos, front.Unit (), up.Unit ());
+  const PathEntry& old = anchorPoints[idx];
+  if (old.pos == pe.pos && old.front == pe.front && old.up == pe.up)
+    return;
+  anchorPoints[idx] = pe;
+  MarkDirty (idx);
 }
 
 void CurvedFactory::DeletePoint (size_t idx)
 {
+  MarkAllDirty ();
   anchorPoints.DeleteIndex (idx);
 }
 
@@ -579,6 +1394,12 @@ void CurvedFactory::Save (iDocumentNode* node, iSyntaxService* syn)
   node->SetAttribute ("name", name);
   node->SetAttributeAsFloat ("width", width);
   node->SetAttributeAsFloat ("sideheight", sideHeight);
+  node->SetAttributeAsFloat ("tolerance", tolerance);
+  if (lodEnd > 0.0f)
+  {
+    node->SetAttributeAsFloat ("lodstart", lodStart);
+    node->SetAttributeAsFloat ("lodend", lodEnd);
+  }
   node->SetAttribute ("material", material->QueryObject ()->GetName ());
   size_t i;
   for (i = 0 ; i < anchorPoints.GetSize () ; i++)
@@ -601,6 +1422,14 @@ bool CurvedFactory::Load (iDocumentNode* node, iSyntaxService* syn)
   if (fabs (width) < .0001) width = 1.0;
   sideHeight = node->GetAttributeValueAsFloat ("sideheight");
   if (fabs (sideHeight) < 0.0001f) sideHeight = 0.2f;
+  // Factories saved before adaptive tessellation keep the fixed sampling
+  // so that their shape doesn't change.
+  if (node->GetAttribute ("tolerance"))
+    tolerance = node->GetAttributeValueAsFloat ("tolerance");
+  else
+    tolerance = 0.0f;
+  lodStart = node->GetAttributeValueAsFloat ("lodstart");
+  lodEnd = node->GetAttributeValueAsFloat ("lodend");
   csString materialName = node->GetAttributeValue ("material");
   SetMaterial (materialName);
   anchorPoints.DeleteAll ();
@@ -629,6 +1458,46 @@ bool CurvedFactory::Load (iDocumentNode* node, iSyntaxService* syn)
   return true;
 }
 
+void CurvedFactory::SaveBinary (BinaryLevelWriter& writer)
+{
+  writer.WriteString (name);
+  writer.WriteFloat (width);
+  writer.WriteFloat (sideHeight);
+  writer.WriteFloat (tolerance);
+  writer.WriteFloat (lodStart);
+  writer.WriteFloat (lodEnd);
+  writer.WriteString (material->QueryObject ()->GetName ());
+  writer.WriteUInt32 (uint32 (anchorPoints.GetSize ()));
+  for (size_t i = 0 ; i < anchorPoints.GetSize () ; i++)
+  {
+    writer.WriteVector3 (anchorPoints[i].pos);
+    writer.WriteVector3 (anchorPoints[i].front);
+    writer.WriteVector3 (anchorPoints[i].up);
+  }
+}
+
+bool CurvedFactory::LoadBinary (BinaryLevelReader& reader)
+{
+  width = reader.ReadFloat ();
+  sideHeight = reader.ReadFloat ();
+  tolerance = reader.ReadFloat ();
+  lodStart = reader.ReadFloat ();
+  lodEnd = reader.ReadFloat ();
+  csString materialName = reader.ReadString ();
+  SetMaterial (materialName);
+  anchorPoints.DeleteAll ();
+  size_t count = reader.ReadCount (9 * sizeof (float));
+  anchorPoints.SetCapacity (count);
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    csVector3 pos = reader.ReadVector3 ();
+    csVector3 front = reader.ReadVector3 ();
+    csVector3 up = reader.ReadVector3 ();
+    AddPoint (pos, front, up);
+  }
+  return reader.IsOk ();
+}
+
 //---------------------------------------------------------------------------------------
 
 CurvedFactoryTemplate::CurvedFactoryTemplate (CurvedMeshCreator* creator,
@@ -690,11 +1559,22 @@ bool CurvedMeshCreator::Initialize (iObjectRegistry *object_reg)
   return true;
 }
 
+iJobQueue* CurvedMeshCreator::GetJobQueue ()
+{
+  if (!jobQueue)
+    jobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (1,
+	  CS::Threading::THREAD_PRIO_NORMAL, "curves"));
+  return jobQueue;
+}
+
 void CurvedMeshCreator::DeleteFactories ()
 {
   size_t i;
   for (i = 0 ; i < factories.GetSize () ; i++)
+  {
     engine->RemoveObject (factories[i]->GetFactory ());
+    factories[i]->RemoveLODFactories ();
+  }
   factories.DeleteAll ();
   factory_hash.Empty ();
 }
@@ -735,6 +1615,27 @@ iCurvedFactory* CurvedMeshCreator::AddCurvedFactory (const char* name, const cha
   CurvedFactory* cf = new CurvedFactory (this, name);
   cf->SetMaterial (cftemp->GetMaterial ());
   cf->SetCharacteristics (cftemp->GetWidth (), cftemp->GetSideHeight ());
+  const char* toleranceS = cftemp->GetAttribute ("tolerance");
+  if (toleranceS)
+  {
+    float tolerance;
+    csScanStr (toleranceS, "%f", &tolerance);
+    cf->SetTolerance (tolerance);
+  }
+  const char* lodS = cftemp->GetAttribute ("lod");
+  if (lodS && *lodS == 't')
+  {
+    // The lowest detail is reached where the object would become an
+    // imposter or disappear.
+    float maxradius = 0.0f, imposterradius = -1.0f;
+    const char* maxradiusS = cftemp->GetAttribute ("maxradius");
+    if (maxradiusS) csScanStr (maxradiusS, "%f", &maxradius);
+    const char* imposterradiusS = cftemp->GetAttribute ("imposterradius");
+    if (imposterradiusS) csScanStr (imposterradiusS, "%f", &imposterradius);
+    float end = imposterradius > 0.0f ? imposterradius : maxradius;
+    if (end > 0.0f)
+      cf->SetLODDistances (end / 4.0f, end);
+  }
   const csArray<PathEntry>& points = cftemp->GetPoints ();
   for (size_t i = 0 ; i < points.GetSize () ; i++)
     cf->AddPoint (points[i].pos, points[i].front, points[i].up);
@@ -786,6 +1687,33 @@ csRef<iString> CurvedMeshCreator::Load (iDocumentNode* node)
   return 0;
 }
 
+void CurvedMeshCreator::SaveBinary (BinaryLevelWriter& writer)
+{
+  writer.WriteUInt32 (uint32 (factories.GetSize ()));
+  for (size_t i = 0 ; i < factories.GetSize () ; i++)
+    factories[i]->SaveBinary (writer);
+}
+
+csRef<iString> CurvedMeshCreator::LoadBinary (BinaryLevelReader& reader)
+{
+  size_t count = reader.ReadCount (sizeof (uint32));
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    csRef<CurvedFactory> cfact;
+    csString name = reader.ReadString ();
+    cfact.AttachNew (new CurvedFactory (this, name));
+    if (!cfact->LoadBinary (reader))
+    {
+      csRef<iString> str;
+      str.AttachNew (new scfString ("Error loading factory!"));
+      return str;
+    }
+    factories.Push (cfact);
+    factory_hash.Put (name, cfact);
+  }
+  return 0;
+}
+
 }
 CS_PLUGIN_NAMESPACE_END(CurvedMesh)
 
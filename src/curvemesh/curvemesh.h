@@ -32,7 +32,11 @@ THE SOFTWARE.
 #include "csutil/hash.h"
 #include "csutil/eventhandlers.h"
 #include "csutil/refarr.h"
+#include "csutil/refcount.h"
 #include "csutil/parray.h"
+#include "csutil/dirtyaccessarray.h"
+#include "csutil/threadjobqueue.h"
+#include "csutil/threading/atomicops.h"
 #include "iutil/comp.h"
 #include "iutil/virtclk.h"
 
@@ -56,9 +60,86 @@ struct PathEntry
 {
   csVector3 pos, front, up;
   float time;
-  PathEntry () { }
+  /// True if this is one of the base points (and not a split point).
+  bool anchor;
+  PathEntry () : anchor (true) { }
   PathEntry (const csVector3& pos, const csVector3& front, const csVector3& up) :
-    pos (pos), front (front), up (up) { }
+    pos (pos), front (front), up (up), anchor (true) { }
+};
+
+/**
+ * The ground below one segment of the base path. The ground is sampled
+ * along the three lines the flattener queries: the left edge, the center
+ * and the right edge of the path. Once sampled it is never changed so
+ * it can be shared between copies of a path.
+ */
+struct HeightSegment : public csRefCount
+{
+  /// The path points this segment was sampled for (the spline depends on them).
+  PathEntry key[4];
+  float width;
+  csReversibleTransform meshtrans;
+
+  /**
+   * For 'steps'+1 evenly spaced times in the segment the world height of
+   * the ground below the left, center and right line.
+   */
+  int steps;
+  csArray<float> ground;
+  csArray<bool> hit;
+};
+
+/**
+ * Answer height queries about the ground below a curved mesh.
+ * The ground below every segment is sampled in advance (on the main
+ * thread) and cached until the segment or the mesh changes. After that
+ * the queries only use these samples so flattening can run on a worker
+ * thread. Every sample only looks for the first surface near the height
+ * of the path so a bridge above a road isn't seen as the ground of the road.
+ */
+class HeightSampler
+{
+private:
+  iSector* sector;
+  csReversibleTransform meshtrans;
+
+  /// The times of the base points.
+  csArray<float> times;
+  /// The samples for every segment (0 if not sampled).
+  csRefArray<HeightSegment> segments;
+
+  /// Find the sampled segment that covers this time.
+  HeightSegment* FindSegment (float time, float& fraction) const;
+
+public:
+  HeightSampler () : sector (0) { }
+
+  /**
+   * Sample the ground below the segments first to last of the given
+   * base points (unless they are still valid from a previous call). This
+   * needs the engine so it must run on the main thread.
+   */
+  void Sample (iMeshWrapper* thisMesh, const csArray<PathEntry>& basePoints,
+      float width, size_t first, size_t last);
+
+  /// Forget all samples.
+  void Clear ();
+
+  /**
+   * Calculate the height difference between an (object space) position
+   * at the given path time and the ground below or above it. 'line' is
+   * 0, 1 or 2 for a position on the left, center or right line. Returns
+   * false if there is no ground nearby.
+   */
+  bool HeightDiff (float time, int line, const csVector3& pos, float& dy) const;
+
+  /**
+   * Batched version of HeightDiff() for 'count' times. For every time
+   * 'pos' has the left, center and right position (so 3*count entries
+   * in 'pos', 'dy' and 'hit').
+   */
+  void HeightDiffs (const float* pathTimes, const csVector3* pos, size_t count,
+      float* dy, bool* hit) const;
 };
 
 class ClingyPath
@@ -70,6 +151,12 @@ private:
   /// The working points.
   csArray<PathEntry> points;
 
+  /// For every base point the index of the corresponding working point.
+  csArray<size_t> anchorIndices;
+
+  /// Height queries to the ground below the path.
+  HeightSampler sampler;
+
   /**
    * Given a segment index, return the start and end time
    * on the path.
@@ -77,6 +164,33 @@ private:
   void GetSegmentTime (const csPath& path, size_t segIdx,
       float& startTime, float& endTime);
 
+  /**
+   * Generate a path from the working points first to last (inclusive).
+   */
+  void GeneratePath (csPath& path, size_t first, size_t last);
+
+  /**
+   * Generate a path that is only big enough to correctly interpolate
+   * the given segment. Returns the index of the segment in that path.
+   */
+  size_t GenerateSegmentPath (csPath& path, size_t segIdx);
+
+  /// Recalculate the anchor indices from the working points.
+  void UpdateAnchorIndices ();
+
+  /**
+   * The base points got new times. Move the times of the working points
+   * along so that every split point keeps its relative position between
+   * its two anchors.
+   */
+  void RemapTimes ();
+
+  /**
+   * Split all segments between working points first and last until they
+   * nicely match the landscape.
+   */
+  void FlattenSegments (size_t first, size_t last, float width);
+
 public:
   /// Set the base points.
   void SetBasePoints (const csArray<PathEntry> pts);
@@ -89,7 +203,7 @@ public:
   /**
    * Fit a point of the working path to the ground.
    */
-  void FitToTerrain (size_t idx, float width, iMeshWrapper* thisMesh);
+  void FitToTerrain (size_t idx, float width);
 
   /**
    * Fix slope of the working path at this index so that the up vector points
@@ -101,7 +215,7 @@ public:
    * Calculate how much this segment would have to raise or lower in
    * order to better fit the landscape.
    */
-  void CalcMinMaxDY (size_t segIdx, float width, iMeshWrapper* thisMesh,
+  void CalcMinMaxDY (size_t segIdx, float width,
       float& maxRaiseY, float& maxLowerY);
 
   /**
@@ -109,15 +223,40 @@ public:
    */
   void SplitSegment (size_t segIdx);
 
+  /**
+   * Sample the ground around the part of the path between base point
+   * firstSeg and lastSeg+1. Segments that didn't change since they were
+   * sampled keep their samples. This has to be done on the main thread
+   * before Flatten() or FlattenRange() (which only use these samples).
+   */
+  void SampleGround (iMeshWrapper* thisMesh, float width,
+      size_t firstSeg, size_t lastSeg);
+
   /**
    * The whole thing. Take the base points and generate a new set
    * of points that nicely matches the landscape.
    */
-  void Flatten (iMeshWrapper* thisMesh, float width);
+  void Flatten (float width);
+
+  /**
+   * Flatten again only the part of the path between base point firstSeg
+   * and lastSeg+1. The rest of the working path is kept from the previous
+   * flatten. This requires that the number of base points didn't change.
+   */
+  void FlattenRange (float width, size_t firstSeg, size_t lastSeg);
 
   /// Generate a path from the working points.
   void GeneratePath (csPath& path);
 
+  /**
+   * Generate a path that covers the part between base points seg
+   * and seg+1 (with enough neighbours to interpolate correctly).
+   * Also returns the start and end time of that part and the distance
+   * between the working points in it.
+   */
+  void GenerateAnchorPath (csPath& path, size_t seg,
+      float& startTime, float& endTime, float& distance);
+
   /// Calculate the total distance of the path.
   float GetTotalDistance ();
 
@@ -126,10 +265,72 @@ public:
 
   /// Get the number of working points.
   size_t GetWorkingPointCount () const { return points.GetSize (); }
+
+  /// Get the number of base points.
+  size_t GetBasePointCount () const { return basePoints.GetSize (); }
+
+  /**
+   * Copy the base and working points of another path and share its
+   * cached ground samples.
+   */
+  void CopyWorkingPath (const ClingyPath& other)
+  {
+    basePoints = other.basePoints;
+    points = other.points;
+    anchorIndices = other.anchorIndices;
+    sampler = other.sampler;
+  }
+
+  /// Forget the cached ground samples (because the ground changed).
+  void ClearGroundSamples () { sampler.Clear (); }
+};
+
+/**
+ * A sample on the generated path where we emit vertices.
+ */
+struct CurveSample
+{
+  csVector3 pos, front, up;
+  /// Distance traveled along the path up to this sample.
+  float distance;
+};
+
+/**
+ * Flatten a path and tessellate a range of its segments. This only
+ * works on its own copy of the path (and the ground samples that were
+ * taken for it) so it can run on a worker thread.
+ */
+class CurveTessellateJob : public scfImplementation1<CurveTessellateJob, iJob>
+{
+private:
+  int32 done;
+
+public:
+  ClingyPath path;
+  float width, tolerance;
+  /// The range of base segments to flatten (if not 'all').
+  size_t flatFirst, flatLast;
+  size_t firstSeg, lastSeg;
+  bool all;
+  /// The generation of the factory when this job was started.
+  uint generation;
+  /// The result: the samples for firstSeg to lastSeg.
+  csArray<csArray<CurveSample> > samples;
+
+  CurveTessellateJob () : scfImplementationType (this), done (0) { }
+  virtual ~CurveTessellateJob () { }
+
+  virtual void Run ();
+
+  /// Return true if Run() has finished.
+  bool IsDone () { return CS::Threading::AtomicOperations::Read (&done) != 0; }
 };
 
 class CurvedMeshCreator;
 
+// Number of LOD levels for a curved factory (if LOD is enabled).
+#define CURVE_LOD_LEVELS 3
+
 class CurvedFactory : public scfImplementation2<CurvedFactory, iCurvedFactory,
   iGeometryGenerator>
 {
@@ -140,6 +341,7 @@ private:
   float width;
   float sideHeight;
   float offsetHeight;
+  float tolerance;
 
   csRef<iMeshFactoryWrapper> factory;
   csRef<iGeneralFactoryState> state;
@@ -147,6 +349,159 @@ private:
   ClingyPath clingyPath;
   csArray<PathEntry> anchorPoints;
 
+  /**
+   * The samples for every segment between two anchor points. The
+   * distance of a sample is relative to the start of its segment. The
+   * last sample of a segment is at the same spot as the first sample
+   * of the next segment.
+   */
+  csArray<csArray<CurveSample> > segmentSamples;
+  /// Distance of the start of every segment (as used in the texels).
+  csArray<float> segmentOffsets;
+
+  /**
+   * The range of anchor points that changed since the last generation.
+   * dirtyFirst is csArrayItemNotFound if none changed.
+   */
+  size_t dirtyFirst, dirtyLast;
+  /// If true the next generation has to redo everything.
+  bool dirtyAll;
+  /**
+   * Incremented every time everything has to be done again. A background
+   * job that was started in an older generation has a stale result.
+   */
+  uint generation;
+  /// The ground changed so the cached ground samples can't be used.
+  bool groundChanged;
+  /// The transform of the mesh for which geometry was last generated.
+  csReversibleTransform lastTransform;
+
+  /// LOD distances. No LOD if lodEnd is 0.
+  float lodStart, lodEnd;
+  /**
+   * The factories with the geometry for every LOD level. Level 0 is the
+   * full geometry so it uses 'factory' and lodFactories[0] stays 0.
+   */
+  csRef<iMeshFactoryWrapper> lodFactories[CURVE_LOD_LEVELS];
+  /// True if the LOD levels 1 and up are older than the geometry.
+  bool lodDirty;
+
+  /// The LOD child meshes we created for a mesh of this factory.
+  struct LODMesh
+  {
+    csWeakRef<iMeshWrapper> parent;
+    csRef<iMeshWrapper> children[CURVE_LOD_LEVELS];
+  };
+  csArray<LODMesh> lodMeshes;
+
+  /// The job that is tessellating in the background (if any).
+  csRef<CurveTessellateJob> job;
+  /// The mesh for which the job is running.
+  csWeakRef<iMeshWrapper> jobMesh;
+  /// True if another generation was requested while the job was running.
+  bool jobPending;
+
+  void MarkDirty (size_t idx);
+  /// Everything has to be generated again.
+  void MarkAllDirty ()
+  {
+    dirtyAll = true;
+    generation++;
+  }
+
+  /**
+   * Copy the new base points to 'path' (which is either our own path or
+   * the copy of a job) and sample the ground below its dirty part.
+   * Returns the range of segments to flatten (flatFirst to flatLast,
+   * unless 'all') and the range that has to be tessellated again.
+   * Returns false if there is nothing to do.
+   */
+  bool PrepareGeometry (iMeshWrapper* thisMesh, ClingyPath& path,
+      size_t& flatFirst, size_t& flatLast, size_t& firstSeg, size_t& lastSeg,
+      bool& all);
+
+  /**
+   * Put new samples for the segments firstSeg to lastSeg in the mesh.
+   * If 'all' is true all segments are new. If 'finished' is false this
+   * is an intermediate (background) update and the lower LOD levels are
+   * left alone until the geometry is generated synchronously again.
+   */
+  void ApplyGeometry (iMeshWrapper* thisMesh, size_t firstSeg, size_t lastSeg,
+      bool all, bool finished, csArray<csArray<CurveSample> >& samples);
+
+  /**
+   * Wait for the background job (if any) and apply its results. The
+   * results are dropped if they are stale. Returns false in that case.
+   */
+  bool WaitForJob ();
+
+  /// Write the vertex data for a sample.
+  void WriteSample (const CurveSample& s, float distance,
+      csVector3* vertices, csVector3* normals, csVector2* texels);
+
+  /**
+   * Update the genmesh from the segment samples. If the number of samples
+   * didn't change only the segments firstSeg to lastSeg are written again
+   * (and the texels after them if their offset changed).
+   */
+  void UpdateBuffers (size_t firstSeg, size_t lastSeg);
+
+  /**
+   * Write the geometry for a LOD level. Every level uses half the
+   * samples of the previous one and the last level has no side borders.
+   */
+  void WriteLODLevel (int level);
+
+  /// Write all LOD levels that don't share the full geometry.
+  void UpdateLODLevels ();
+
+  /**
+   * Make sure the mesh has the LOD meshes as children and that the
+   * LOD distances are correct.
+   */
+  void AttachLOD (iMeshWrapper* thisMesh);
+
+  /**
+   * Remove the LOD meshes from a mesh and make it visible again.
+   */
+  void DetachLOD (iMeshWrapper* thisMesh);
+
+  /// Remove the LOD children of a mesh entry from the engine.
+  void RemoveLODChildren (LODMesh& lm);
+
+  /**
+   * Remove the LOD children of meshes that were deleted (for example
+   * because the dynamic world recreated the mesh).
+   */
+  void PruneLODMeshes ();
+
+public:
+  /// Calculate how far a sample deviates from the strip between a and b.
+  static float SampleError (const CurveSample& a, const CurveSample& b,
+      const CurveSample& s, float width);
+
+  /**
+   * Sample the path at a fixed rate between two times and then drop all
+   * samples that can be interpolated from their neighbours within the
+   * tolerance.
+   */
+  static void TessellatePath (csPath& path, float startTime, float endTime,
+      float distance, float width, float tolerance, csArray<CurveSample>& samples);
+
+  /**
+   * Tessellate the segments first to last of a flattened path. The
+   * samples for segment 'first' are put at index 0.
+   */
+  static void TessellateSegments (ClingyPath& path, size_t first, size_t last,
+      float width, float tolerance, csArray<csArray<CurveSample> >& samples);
+
+  /**
+   * Flatten a path for which the ground was sampled. Either everything
+   * (if 'all' is true) or only the segments flatFirst to flatLast.
+   */
+  static void FlattenPath (ClingyPath& path, float width, bool all,
+      size_t flatFirst, size_t flatLast);
+
 public:
   CurvedFactory (CurvedMeshCreator* creator, const char* name);
   virtual ~CurvedFactory ();
@@ -157,6 +512,18 @@ public:
   virtual void SetCharacteristics (float width, float sideHeight);
   virtual float GetWidth () const { return width; }
   virtual float GetSideHeight () const { return sideHeight; }
+  virtual void SetTolerance (float tolerance)
+  {
+    CurvedFactory::tolerance = tolerance;
+    MarkAllDirty ();
+  }
+  virtual float GetTolerance () const { return tolerance; }
+  virtual void SetLODDistances (float start, float end);
+  virtual void GetLODDistances (float& start, float& end) const
+  {
+    start = lodStart;
+    end = lodEnd;
+  }
   virtual size_t AddPoint (const csVector3& pos, const csVector3& front,
       const csVector3& up);
   virtual void ChangePoint (size_t idx, const csVector3& pos, const csVector3& front,
@@ -178,11 +545,24 @@ public:
   {
     return anchorPoints[idx].up;
   }
+  virtual void InvalidateGeometry ()
+  {
+    MarkAllDirty ();
+    groundChanged = true;
+  }
 
   void Save (iDocumentNode* node, iSyntaxService* syn);
   bool Load (iDocumentNode* node, iSyntaxService* syn);
+  void SaveBinary (BinaryLevelWriter& writer);
+  bool LoadBinary (BinaryLevelReader& reader);
+
+  /// Remove the LOD factories from the engine.
+  void RemoveLODFactories ();
 
   virtual void GenerateGeometry (iMeshWrapper* mesh);
+  virtual void GenerateGeometryAsync (iMeshWrapper* mesh);
+  virtual bool FinishGeometry ();
+  virtual bool IsGeneratingGeometry () const { return job.IsValid (); }
 };
 
 class CurvedFactoryTemplate : public scfImplementation1<CurvedFactoryTemplate,
@@ -228,9 +608,13 @@ public:
   csRefArray<CurvedFactory> factories;
   csHash<CurvedFactory*,csString> factory_hash;
   csRefArray<CurvedFactoryTemplate> factoryTemplates;
+  csRef<iJobQueue> jobQueue;
 
   CurvedFactoryTemplate* FindFactoryTemplate (const char* name);
 
+  /// Get the queue for background tessellation.
+  iJobQueue* GetJobQueue ();
+
 public:
   CurvedMeshCreator (iBase *iParent);
   virtual ~CurvedMeshCreator ();
@@ -264,6 +648,8 @@ public:
 
   virtual void Save (iDocumentNode* node);
   virtual csRef<iString> Load (iDocumentNode* node);
+  virtual void SaveBinary (BinaryLevelWriter& writer);
+  virtual csRef<iString> LoadBinary (BinaryLevelReader& reader);
 };
 
 }
@@ -232,13 +232,13 @@ void ListCtrlTools::SelectRow (wxListCtrl* list, int row, bool sendEvent, bool a
 
 void ListCtrlTools::ClearSelection (wxListCtrl* list, bool sendEvent)
 {
-  wxListItem rowInfo;
-  for (int row = 0 ; row < list->GetItemCount () ; row++)
+  // Only visit the selected rows. Getting the item of every row would
+  // format all rows of a virtual list.
+  long row = list->GetNextItem (-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+  while (row != -1)
   {
-    rowInfo.m_itemId = row;
-    rowInfo.m_col = 0;
-    list->GetItem (rowInfo);
-    list->SetItemState (rowInfo, 0, wxLIST_STATE_SELECTED);
+    list->SetItemState (row, 0, wxLIST_STATE_SELECTED);
+    row = list->GetNextItem (row, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
   }
   if (sendEvent)
   {
@@ -272,3 +272,18 @@ bool ListCtrlTools::CheckHitList (wxListBox* list, bool& hasItem,
   return false;
 }
 
+//-----------------------------------------------------------------------------
+
+IMPLEMENT_DYNAMIC_CLASS (VirtualListCtrl, wxListCtrl)
+
+wxString VirtualListCtrl::OnGetItemText (long item, long column) const
+{
+  if (!provider) return wxString ();
+  if (item != cachedItem)
+  {
+    cachedRow = provider->GetVirtualRow (const_cast<VirtualListCtrl*> (this), item);
+    cachedItem = item;
+  }
+  if (column < 0 || size_t (column) >= cachedRow.GetSize ()) return wxString ();
+  return wxString::FromUTF8 (cachedRow[column]);
+}
@@ -113,6 +113,18 @@ bool Value::IsChild (Value* value)
   return false;
 }
 
+size_t Value::GetChildCount ()
+{
+  size_t count = 0;
+  csRef<ValueIterator> it = GetIterator ();
+  while (it->HasNext ())
+  {
+    it->NextChild ();
+    count++;
+  }
+  return count;
+}
+
 // --------------------------------------------------------------------------
 
 DialogResult AbstractCompositeValue::GetDialogValue ()
@@ -559,9 +571,24 @@ bool DeleteChildAction::IsActive (View* view, wxWindow* component)
 
 // --------------------------------------------------------------------------
 
+class View::ListProvider : public VirtualListProvider
+{
+private:
+  View* view;
+
+public:
+  ListProvider (View* view) : view (view) { }
+  virtual ~ListProvider () { }
+  virtual csStringArray GetVirtualRow (wxListCtrl* list, long item)
+  {
+    return view->GetVirtualRow (list, item);
+  }
+};
+
 View::View (wxWindow* parent) : parent (parent), lastContextID (wxID_HIGHEST + 10000), eventHandler (this)
 {
   changeListener.AttachNew (new ViewChangeListener (this));
+  listProvider = new ListProvider (this);
 }
 
 void View::Reset ()
@@ -588,6 +615,7 @@ void View::DestroyBindings ()
     csPtrKey<wxWindow> component;
     Binding* binding = it.Next (component);
     binding->value->RemoveValueChangeListener (changeListener);
+    ReleaseVirtualList (component);
     if (binding->eventType == wxEVT_COMMAND_TEXT_UPDATED ||
 	binding->eventType == wxEVT_COMMAND_LIST_ITEM_SELECTED ||
 	binding->eventType == wxEVT_COMMAND_CHOICE_SELECTED ||
@@ -603,6 +631,7 @@ void View::RemoveBinding (wxWindow* component)
   Binding* binding = bindingsByComponent.Get (component, 0);
   if (!binding) return;
   binding->value->RemoveValueChangeListener (changeListener);
+  ReleaseVirtualList (component);
   if (binding->eventType == wxEVT_COMMAND_TEXT_UPDATED ||
       binding->eventType == wxEVT_COMMAND_LIST_ITEM_SELECTED ||
       binding->eventType == wxEVT_COMMAND_CHOICE_SELECTED ||
@@ -643,6 +672,29 @@ View::~View ()
 {
   DestroyBindings ();
   DestroyActionBindings ();
+  delete listProvider;
+}
+
+void View::ReleaseVirtualList (wxWindow* component)
+{
+  VirtualListCtrl* vlist = wxDynamicCast (component, VirtualListCtrl);
+  if (vlist && vlist->GetProvider () == listProvider)
+    vlist->SetProvider (0);
+}
+
+csStringArray View::GetVirtualRow (wxListCtrl* list, long item)
+{
+  // The item count of the list is the child count that was given to
+  // SetItemCount() when the value last changed. Asking the value for it
+  // again for every row can be expensive.
+  Binding* binding = bindingsByComponent.Get (list, 0);
+  if (!binding || item < 0 || item >= list->GetItemCount ())
+    return csStringArray ();
+  Value* child = binding->value->GetChild (item);
+  if (!child) return csStringArray ();
+  ListHeading lhdef;
+  const ListHeading& lh = listToHeading.Get (list, lhdef);
+  return ConstructListRow (lh, child);
 }
 
 wxWindow* View::FindComponentByName (wxWindow* container, const char* name)
@@ -906,6 +958,9 @@ bool View::Bind (Value* value, wxListCtrl* component)
   }
 
   RegisterBinding (value, component, wxEVT_NULL);
+  VirtualListCtrl* vlist = wxDynamicCast (component, VirtualListCtrl);
+  if (vlist)
+    vlist->SetProvider (listProvider);
   ValueChanged (value);
   return true;
 }
@@ -1517,6 +1572,15 @@ void View::ValueChanged (Value* value)
       {
 //csString compName = (const char*)comp->GetName ().mb_str (wxConvUTF8);
 //printf ("ValueChanged for component '%s'\n", compName.GetData ()); fflush (stdout);
+	VirtualListCtrl* vlist = wxDynamicCast (comp, VirtualListCtrl);
+	if (vlist)
+	{
+	  // Rows are fetched on demand so we only have to update the count.
+	  vlist->InvalidateCache ();
+	  vlist->SetItemCount (value->GetChildCount ());
+	  vlist->Refresh ();
+	  continue;
+	}
 	wxListCtrl* listCtrl = wxStaticCast (comp, wxListCtrl);
 	long idx = ListCtrlTools::GetFirstSelectedRow (listCtrl);
 	listCtrl->Freeze ();
@@ -1580,6 +1644,97 @@ void View::ValueChanged (Value* value)
   }
 }
 
+void View::ChildChanged (Value* value, size_t idx, ChildChange change)
+{
+  ValueToBinding::Iterator it = bindingsByValue.GetIterator (value);
+  if (!it.HasNext ())
+  {
+    printf ("ChildChanged: Something went wrong! Called without a valid binding!\n");
+    CS_ASSERT (false);
+    return;
+  }
+
+  // Only lists can update a single row. If the value is bound to anything
+  // else we update everything.
+  csArray<wxListCtrl*> lists;
+  while (it.HasNext ())
+  {
+    Binding* b = it.Next ();
+    if (b->processing) continue;
+    if (b->changeEnabled || !b->component->IsKindOf (CLASSINFO (wxListCtrl)))
+    {
+      ValueChanged (value);
+      return;
+    }
+    lists.Push (wxStaticCast (b->component, wxListCtrl));
+  }
+
+  for (size_t i = 0 ; i < lists.GetSize () ; i++)
+  {
+    wxListCtrl* listCtrl = lists[i];
+    VirtualListCtrl* vlist = wxDynamicCast (listCtrl, VirtualListCtrl);
+    if (vlist)
+    {
+      vlist->InvalidateCache ();
+      if (change == CHILD_MODIFIED)
+      {
+	vlist->RefreshItem (idx);
+	continue;
+      }
+      // All rows after the inserted or removed one shift. The selection
+      // of a virtual list is kept by index so it has to shift too.
+      csArray<long> selected;
+      long row = vlist->GetNextItem (-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+      while (row != -1)
+      {
+	selected.Push (row);
+	row = vlist->GetNextItem (row, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+      }
+      ListCtrlTools::ClearSelection (vlist);
+      long count = long (value->GetChildCount ());
+      vlist->SetItemCount (count);
+      for (size_t s = 0 ; s < selected.GetSize () ; s++)
+      {
+	row = selected[s];
+	if (row >= long (idx))
+	{
+	  if (change == CHILD_INSERTED) row++;
+	  else if (row == long (idx)) continue;
+	  else row--;
+	}
+	if (row < count)
+	  vlist->SetItemState (row, wxLIST_STATE_SELECTED, wxLIST_STATE_SELECTED);
+      }
+      if (long (idx) < count)
+	vlist->RefreshItems (idx, count-1);
+      else
+	vlist->Refresh ();
+      continue;
+    }
+
+    ListHeading lhdef;
+    const ListHeading& lh = listToHeading.Get (listCtrl, lhdef);
+    switch (change)
+    {
+      case CHILD_INSERTED:
+	ListCtrlTools::InsertRow (listCtrl, idx, ConstructListRow (lh, value->GetChild (idx)));
+	break;
+      case CHILD_REMOVED:
+	listCtrl->DeleteItem (idx);
+	break;
+      case CHILD_MODIFIED:
+	{
+	  // Replacing a row loses its selection state.
+	  bool sel = listCtrl->GetItemState (idx, wxLIST_STATE_SELECTED) != 0;
+	  ListCtrlTools::ReplaceRow (listCtrl, idx, ConstructListRow (lh, value->GetChild (idx)));
+	  if (sel)
+	    ListCtrlTools::SelectRow (listCtrl, idx, false, true);
+	}
+	break;
+    }
+  }
+}
+
 bool View::DefineHeading (const char* listName, const char* heading,
       const char* names)
 {
@@ -59,6 +59,29 @@ static bool Equals (const char* p1, const char* p2)
   return strcmp (p1, p2) == 0;
 }
 
+template <class T>
+static void AddDependency (csHash<T*,csString>& deps, const char* name, T* user)
+{
+  csArray<T*> users = deps.GetAll (name);
+  if (users.Find (user) == csArrayItemNotFound)
+    deps.Put (name, user);
+}
+
+template <class T>
+static void RemoveDependencies (csHash<T*,csString>& deps, T* user)
+{
+  csHash<T*,csString> kept;
+  typename csHash<T*,csString>::GlobalIterator it = deps.GetIterator ();
+  while (it.HasNext ())
+  {
+    csString name;
+    T* u = it.Next (name);
+    if (u != user)
+      kept.Put (name, u);
+  }
+  deps = kept;
+}
+
 //----------------------------------------------------------------------
 
 SanityResult& SanityResult::Object (iDynamicObject* object)
@@ -105,6 +128,7 @@ SanityChecker::SanityChecker (iObjectRegistry* object_reg, iPcDynamicWorld* dynw
   pl = csQueryRegistry<iCelPlLayer> (object_reg);
   engine = csQueryRegistry<iEngine> (object_reg);
   questManager = csQueryRegistry<iQuestManager> (object_reg);
+  entityIndexValid = false;
 
   ClearContext ();
 }
@@ -125,6 +149,51 @@ void SanityChecker::ClearContext ()
 void SanityChecker::ClearResults ()
 {
   results.Empty ();
+  entityQuests.Empty ();
+  entityObjects.Empty ();
+  templateQuests.Empty ();
+}
+
+void SanityChecker::InvalidateCaches ()
+{
+  entityIndex.Empty ();
+  indexedNames.Empty ();
+  removedNames.Empty ();
+  entityIndexValid = false;
+  templateParameters.Empty ();
+}
+
+void SanityChecker::BuildEntityIndex ()
+{
+  entityIndex.Empty ();
+  indexedNames.Empty ();
+  csRef<iDynamicCellIterator> it = dynworld->GetCells ();
+  while (it->HasNext ())
+  {
+    iDynamicCell* cell = it->NextCell ();
+    for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+    {
+      iDynamicObject* object = cell->GetObject (i);
+      const char* entityName = object->GetEntityName ();
+      if (entityName)
+      {
+	entityIndex.Put (entityName, object);
+	indexedNames.Put (object, entityName);
+      }
+    }
+  }
+  entityIndexValid = true;
+}
+
+const csHash<ParameterDomain,csStringID>& SanityChecker::GetTemplateParameters (
+    iCelEntityTemplate* tpl)
+{
+  // The returned reference is only valid until the next template is added.
+  csHash<ParameterDomain,csStringID>* params = templateParameters.GetElementPointer (tpl);
+  if (params) return *params;
+  templateParameters.Put (tpl,
+      InspectTools::GetTemplateParameters (pl, questManager, tpl));
+  return *templateParameters.GetElementPointer (tpl);
 }
 
 void SanityChecker::PushResult (const char* msg, ...)
@@ -440,7 +509,7 @@ void SanityChecker::Check (iDynamicObject* dynobj)
 
   if (tpl)
   {
-    csHash<ParameterDomain,csStringID> wanted = InspectTools::GetTemplateParameters (pl, questManager, tpl);
+    const csHash<ParameterDomain,csStringID>& wanted = GetTemplateParameters (tpl);
     csHash<ParameterDomain,csStringID> given = InspectTools::GetObjectParameters (dynobj);
     csHash<const celData*,csStringID> givenValues = InspectTools::GetObjectParameterValues (dynobj);
 
@@ -503,25 +572,18 @@ iQuestFactory* SanityChecker::FindQuest (iCelEntityTemplate* tpl, const char* ta
 
 iDynamicObject* SanityChecker::FindEntity (const char* par)
 {
-  csRef<iDynamicCellIterator> it = dynworld->GetCells ();
-  while (it->HasNext ())
-  {
-    iDynamicCell* cell = it->NextCell ();
-    for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
-    {
-      iDynamicObject* object = cell->GetObject (i);
-      const char* entityName = object->GetEntityName ();
-      if (entityName && strcmp (entityName, par) == 0)
-	return object;
-    }
-  }
-  return 0;
+  if (!entityIndexValid) BuildEntityIndex ();
+  return entityIndex.Get (par, (iDynamicObject*)0);
 }
 
 iDynamicObject* SanityChecker::CheckExistingEntityAndReport (
     const char* parent, const char* par)
 {
   if (!IsConstant (par)) return 0;
+  if (contextQuest)
+    AddDependency (entityQuests, par, contextQuest);
+  else if (contextObject)
+    AddDependency (entityObjects, par, contextObject);
   iDynamicObject* object = FindEntity (par);
   if (!object)
     if (strcmp (par, "World") != 0)
@@ -533,6 +595,8 @@ void SanityChecker::CheckExistingEntityTemplateAndReport (const char* parent,
     const char* par)
 {
   if (!IsConstant (par)) return;
+  if (contextQuest)
+    AddDependency (templateQuests, par, contextQuest);
   iCelEntityTemplate* tpl = pl->FindEntityTemplate (par);
   if (!tpl)
     PushResult ("Cannot find template '%s' in '%s'!", par, parent);
@@ -917,8 +981,268 @@ void SanityChecker::CheckQuests ()
 void SanityChecker::CheckAll ()
 {
   ClearResults ();
+  InvalidateCaches ();
   CheckTemplates ();
   CheckObjects ();
   CheckQuests ();
 }
 
+//----------------------------------------------------------------------
+
+void SanityChecker::RemoveResults (iObject* resource)
+{
+  for (size_t i = results.GetSize () ; i-- > 0 ; )
+    if (results[i].resource == resource)
+      results.DeleteIndex (i);
+}
+
+void SanityChecker::RemoveResults (iDynamicObject* object)
+{
+  for (size_t i = results.GetSize () ; i-- > 0 ; )
+    if (results[i].object == object)
+      results.DeleteIndex (i);
+}
+
+void SanityChecker::UpdateEntityIndex (const csArray<iDynamicObject*>& objects,
+    csSet<csString>& changedNames)
+{
+  if (!entityIndexValid)
+  {
+    // Without an index nothing was looked up yet so there are no
+    // changes to find.
+    BuildEntityIndex ();
+    return;
+  }
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+  {
+    iDynamicObject* object = objects[i];
+    csString newName = object->GetEntityName ();
+    const csString* oldName = indexedNames.GetElementPointer (object);
+    if (oldName && *oldName == newName) continue;
+    if (oldName)
+    {
+      entityIndex.Delete (*oldName, object);
+      changedNames.Add (*oldName);
+      indexedNames.DeleteAll (object);
+    }
+    if (!newName.IsEmpty ())
+    {
+      entityIndex.Put (newName, object);
+      indexedNames.Put (object, newName);
+      changedNames.Add (newName);
+    }
+  }
+}
+
+bool SanityChecker::DependsOn (iCelEntityTemplate* tpl,
+    const csSet<csPtrKey<iCelEntityTemplate> >& templates)
+{
+  if (templates.Contains (tpl)) return true;
+  csRef<iCelEntityTemplateIterator> it = tpl->GetParents ();
+  while (it->HasNext ())
+    if (DependsOn (it->Next (), templates)) return true;
+  return false;
+}
+
+void SanityChecker::RecheckQuest (iQuestFactory* quest)
+{
+  RemoveResults (quest->QueryObject ());
+  Check (quest);
+}
+
+void SanityChecker::RecheckObjects (const csArray<iDynamicObject*>& objects,
+    csSet<csString>& names)
+{
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+  {
+    iDynamicObject* dynobj = objects[i];
+    RemoveResults (dynobj);
+    Check (dynobj);
+    if (dynobj->GetEntityName ())
+      names.Add (dynobj->GetEntityName ());
+  }
+}
+
+void SanityChecker::RecheckEntityUsers (const csSet<csString>& names)
+{
+  // Collect first: checking again records new dependencies.
+  csSet<csPtrKey<iQuestFactory> > quests;
+  csSet<csPtrKey<iDynamicObject> > objects;
+  csSet<csString>::GlobalIterator it = names.GetIterator ();
+  while (it.HasNext ())
+  {
+    const csString& name = it.Next ();
+    csArray<iQuestFactory*> q = entityQuests.GetAll (name);
+    for (size_t i = 0 ; i < q.GetSize () ; i++)
+      quests.Add (q[i]);
+    csArray<iDynamicObject*> o = entityObjects.GetAll (name);
+    for (size_t i = 0 ; i < o.GetSize () ; i++)
+      objects.Add (o[i]);
+  }
+
+  csSet<csPtrKey<iDynamicObject> >::GlobalIterator objIt = objects.GetIterator ();
+  while (objIt.HasNext ())
+  {
+    iDynamicObject* dynobj = objIt.Next ();
+    RemoveResults (dynobj);
+    Check (dynobj);
+  }
+  csSet<csPtrKey<iQuestFactory> >::GlobalIterator questIt = quests.GetIterator ();
+  while (questIt.HasNext ())
+    RecheckQuest (questIt.Next ());
+}
+
+void SanityChecker::RecheckTemplates (
+    const csSet<csPtrKey<iCelEntityTemplate> >& templates)
+{
+  // Templates inherit parameters from their parents so the cached
+  // parameters of children are stale too.
+  templateParameters.Empty ();
+
+  csSet<csPtrKey<iCelEntityTemplate> >::GlobalIterator tplIt = templates.GetIterator ();
+  while (tplIt.HasNext ())
+  {
+    iCelEntityTemplate* tpl = tplIt.Next ();
+    RemoveResults (tpl->QueryObject ());
+    Check (tpl);
+  }
+
+  // Objects without template are included because their template may
+  // just have been renamed.
+  csArray<iDynamicObject*> objects;
+  csRef<iDynamicCellIterator> cellIt = dynworld->GetCells ();
+  while (cellIt->HasNext ())
+  {
+    iDynamicCell* cell = cellIt->NextCell ();
+    for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+    {
+      iDynamicObject* dynobj = cell->GetObject (i);
+      iCelEntityTemplate* tpl = FindTemplateForObject (dynobj);
+      if (tpl ? DependsOn (tpl, templates) : dynobj->GetEntityName () != 0)
+	objects.Push (dynobj);
+    }
+  }
+  csSet<csString> names;
+  RecheckObjects (objects, names);
+  RecheckEntityUsers (names);
+}
+
+void SanityChecker::CheckModified (iObject* resource)
+{
+  if (!resource) return;
+
+  csSet<csPtrKey<iCelEntityTemplate> > templates;
+  csRef<iCelEntityTemplate> tpl = scfQueryInterface<iCelEntityTemplate> (resource);
+  csRef<iQuestFactory> quest = scfQueryInterface<iQuestFactory> (resource);
+  csRef<iDynamicFactory> fact = scfQueryInterface<iDynamicFactory> (resource);
+  if (tpl)
+  {
+    templates.Add (tpl);
+
+    // A new or renamed template can resolve (or break) the default
+    // template of factories and the templates used by quests.
+    for (size_t i = 0 ; i < dynworld->GetFactoryCount () ; i++)
+    {
+      iDynamicFactory* f = dynworld->GetFactory (i);
+      RemoveResults (f->QueryObject ());
+      Check (f);
+    }
+    csSet<csPtrKey<iQuestFactory> > quests;
+    csHash<iQuestFactory*,csString>::GlobalIterator it = templateQuests.GetIterator ();
+    while (it.HasNext ())
+    {
+      csString name;
+      iQuestFactory* q = it.Next (name);
+      if (name == tpl->GetName () || !pl->FindEntityTemplate (name))
+	quests.Add (q);
+    }
+    csSet<csPtrKey<iQuestFactory> >::GlobalIterator questIt = quests.GetIterator ();
+    while (questIt.HasNext ())
+      RecheckQuest (questIt.Next ());
+  }
+  else if (quest)
+  {
+    RecheckQuest (quest);
+
+    // Templates that start this quest (or a quest that no longer
+    // exists) get their parameters from it.
+    csRef<iCelEntityTemplateIterator> it = pl->GetEntityTemplates ();
+    while (it->HasNext ())
+    {
+      iCelEntityTemplate* t = it->Next ();
+      for (size_t i = 0 ; i < t->GetPropertyClassTemplateCount () ; i++)
+      {
+	iCelPropertyClassTemplate* pctpl = t->GetPropertyClassTemplate (i);
+	csString pcname = pctpl->GetName ();
+	if (pcname != "pclogic.quest") continue;
+	csString questName = InspectTools::FindActionParameter (pl, pctpl, "NewQuest", "name");
+	if (questName == quest->GetName ()
+	    || !questManager->GetQuestFactory (questName))
+	  templates.Add (t);
+      }
+    }
+  }
+  else if (fact)
+  {
+    RemoveResults (resource);
+    Check (fact);
+
+    csArray<iDynamicObject*> objects;
+    csRef<iDynamicCellIterator> cellIt = dynworld->GetCells ();
+    while (cellIt->HasNext ())
+    {
+      iDynamicCell* cell = cellIt->NextCell ();
+      for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+	if (cell->GetObject (i)->GetFactory () == fact)
+	  objects.Push (cell->GetObject (i));
+    }
+    csSet<csString> names;
+    RecheckObjects (objects, names);
+    RecheckEntityUsers (names);
+  }
+
+  if (templates.GetSize () > 0)
+    RecheckTemplates (templates);
+}
+
+void SanityChecker::CheckModified (const csArray<iDynamicObject*>& objects)
+{
+  csSet<csString> names = removedNames;
+  removedNames.Empty ();
+  UpdateEntityIndex (objects, names);
+  RecheckObjects (objects, names);
+  RecheckEntityUsers (names);
+}
+
+void SanityChecker::RegisterRemoval (iObject* resource)
+{
+  RemoveResults (resource);
+  csRef<iQuestFactory> quest = scfQueryInterface<iQuestFactory> (resource);
+  if (quest)
+  {
+    RemoveDependencies (entityQuests, (iQuestFactory*)quest);
+    RemoveDependencies (templateQuests, (iQuestFactory*)quest);
+  }
+  csRef<iCelEntityTemplate> tpl = scfQueryInterface<iCelEntityTemplate> (resource);
+  if (tpl)
+    templateParameters.DeleteAll ((iCelEntityTemplate*)tpl);
+}
+
+void SanityChecker::RegisterRemoval (const csArray<iDynamicObject*>& objects)
+{
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+  {
+    iDynamicObject* object = objects[i];
+    RemoveResults (object);
+    RemoveDependencies (entityObjects, object);
+    const csString* name = indexedNames.GetElementPointer (object);
+    if (name)
+    {
+      // The users of this name are checked again with the next
+      // CheckModified(), when the object is really gone.
+      entityIndex.Delete (*name, object);
+      removedNames.Add (*name);
+      indexedNames.DeleteAll (object);
+    }
+  }
+}
@@ -34,41 +34,85 @@ csSphere TransformTools::GetSphereSelected (iSelection* selection)
   return csSphere (box.GetCenter (), dist/2.0f);
 }
 
-csBox3 TransformTools::GetBoxSelected (iSelection* selection)
+// The objects that are kinematic for the current edit.
+static csArray<iDynamicObject*> transformObjects;
+static csSet<csPtrKey<iDynamicObject> > transformSet;
+static csTicks lastTransformTime = 0;
+
+static bool HasJoints (iDynamicObject* dynobj)
 {
-  csBox3 totalbox;
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  return dynobj->GetFactory ()->GetJointCount () > 0;
+}
+
+void TransformTools::BeginTransform (const csArray<iDynamicObject*>& objects)
+{
+  lastTransformTime = csGetTicks ();
+  // Objects that are already kinematic for this edit are left alone.
+  csArray<iDynamicObject*> newObjects;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    if (!transformSet.Contains (objects[i]))
+    {
+      transformSet.AddNoTest (objects[i]);
+      newObjects.Push (objects[i]);
+    }
+  for (size_t i = 0 ; i < newObjects.GetSize () ; i++)
+    if (HasJoints (newObjects[i]))
+      newObjects[i]->RemovePivotJoints ();
+  for (size_t i = 0 ; i < newObjects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    const csBox3& box = dynobj->GetFactory ()->GetBBox ();
-    const csReversibleTransform& tr = dynobj->GetTransform ();
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (0)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (1)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (2)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (3)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (4)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (5)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (6)));
-    totalbox.AddBoundingVertex (tr.This2Other (box.GetCorner (7)));
+    newObjects[i]->MakeKinematic ();
+    transformObjects.Push (newObjects[i]);
   }
-  return totalbox;
 }
 
-csVector3 TransformTools::GetCenterSelected (iSelection* selection)
+void TransformTools::EndTransform ()
+{
+  for (size_t i = 0 ; i < transformObjects.GetSize () ; i++)
+    transformObjects[i]->UndoKinematic ();
+  for (size_t i = 0 ; i < transformObjects.GetSize () ; i++)
+    if (HasJoints (transformObjects[i]))
+      transformObjects[i]->RecreatePivotJoints ();
+  transformObjects.DeleteAll ();
+  transformSet.DeleteAll ();
+}
+
+bool TransformTools::IsTransforming ()
+{
+  return transformObjects.GetSize () > 0;
+}
+
+csTicks TransformTools::GetLastTransformTime ()
+{
+  return lastTransformTime;
+}
+
+/**
+ * Collect the objects of the selection that a tool will actually move:
+ * the ones that have a mesh and are not one of the given reference objects.
+ */
+static void CollectMovedObjects (iSelection* selection,
+    csArray<iDynamicObject*>& objects, iDynamicObject* skip1 = 0,
+    iDynamicObject* skip2 = 0)
 {
-  csVector3 center (0);
   csRef<iSelectionIterator> it = selection->GetIterator ();
   while (it->HasNext ())
   {
     iDynamicObject* dynobj = it->Next ();
-    const csBox3& box = dynobj->GetFactory ()->GetBBox ();
-    const csReversibleTransform& tr = dynobj->GetTransform ();
-    center += tr.This2Other (box.GetCenter ());
+    if (dynobj == skip1 || dynobj == skip2) continue;
+    if (!dynobj->GetMesh ()) continue;
+    objects.Push (dynobj);
   }
-  if (selection->GetSize () > 0)
-    center /= selection->GetSize ();
-  return center;
+}
+
+csBox3 TransformTools::GetBoxSelected (iSelection* selection)
+{
+  // The selection caches the bounds of its objects.
+  return selection->GetBoundingBox ();
+}
+
+csVector3 TransformTools::GetCenterSelected (iSelection* selection)
+{
+  return selection->GetCenter ();
 }
 
 void TransformTools::Move (iSelection* selection,
@@ -78,21 +122,17 @@ void TransformTools::Move (iSelection* selection,
   if (slow) vector *= 0.01f;
   else if (!fast) vector *= 0.1f;
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects);
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
 
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     csReversibleTransform& trans = mesh->GetMovable ()->GetTransform ();
     //trans.Translate (trans.This2OtherRelative (vector));
     trans.Translate (vector);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
@@ -104,37 +144,29 @@ void TransformTools::Rotate (iSelection* selection, float baseAngle,
   else if (fast) angle /= 2.0;
   else angle /= 8.0;
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects);
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
 
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     mesh->GetMovable ()->GetTransform ().RotateOther (csVector3 (0, 1, 0), angle);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
 void TransformTools::Rotate (iSelection* selection, float angle)
 {
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects);
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
 
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     mesh->GetMovable ()->GetTransform ().RotateOther (csVector3 (0, 1, 0), angle);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
@@ -209,20 +241,15 @@ void TransformTools::AlignSelectedObjects (iSelection* selection)
 
   const csReversibleTransform& trans = selection->GetFirst ()->GetMesh ()->GetMovable ()->GetTransform ();
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects, selection->GetFirst ());
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    if (dynobj == selection->GetFirst ()) continue;
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
     csReversibleTransform& tr = mesh->GetMovable ()->GetTransform ();
     FindBestAlignedTransform (trans, tr);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
@@ -236,15 +263,13 @@ void TransformTools::StackSelectedObjects (iSelection* selection)
   firstBbox = firstTrans.This2Other (firstBbox);
   float cury = firstBbox.MaxY ();
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects, selection->GetFirst ());
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    if (dynobj == selection->GetFirst ()) continue;
+    iDynamicObject* dynobj = objects[i];
     iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
 
     csReversibleTransform& tr = mesh->GetMovable ()->GetTransform ();
     csBox3 bbox = dynobj->GetFactory ()->GetPhysicsBBox ();
@@ -256,8 +281,6 @@ void TransformTools::StackSelectedObjects (iSelection* selection)
     cury += bbox.MaxY ()-bbox.MinY ();
 
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
 
     // Next stack we perform relative to the previous one we stacked.
     firstTrans = tr;
@@ -276,7 +299,11 @@ void TransformTools::SpreadSelectedObjects (iSelection* selection)
   float maxdist = sqrt (csSquaredDist::PointPoint (first, last));
   float step = maxdist / float (selection->GetSize ()-1);
 
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects, selection->GetFirst (),
+      selection->GetLast ());
   size_t i = 0;
+  BeginTransform (objects);
   csRef<iSelectionIterator> it = selection->GetIterator ();
   while (it->HasNext ())
   {
@@ -285,15 +312,11 @@ void TransformTools::SpreadSelectedObjects (iSelection* selection)
     if (dynobj == selection->GetFirst () || dynobj == selection->GetLast ()) continue;
     iMeshWrapper* mesh = dynobj->GetMesh ();
     if (!mesh) continue;
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
 
     csReversibleTransform& tr = mesh->GetMovable ()->GetTransform ();
     tr.SetOrigin (first + (last-first) * float (i-1) * step / maxdist);
 
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
@@ -305,22 +328,17 @@ void TransformTools::SameYSelectedObjects (iSelection* selection)
   csReversibleTransform trans = selection->GetFirst ()->GetMesh ()->GetMovable ()->GetTransform ();
   float y = trans.GetOrigin ().y;
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects, selection->GetFirst ());
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    if (dynobj == selection->GetFirst ()) continue;
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
     csReversibleTransform& tr = mesh->GetMovable ()->GetTransform ();
     csVector3 v = tr.GetOrigin ();
     v.y = y;
     tr.SetOrigin (v);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
@@ -333,23 +351,19 @@ void TransformTools::SetPosSelectedObjects (iSelection* selection)
     ->GetTransform ();
   csBox3 firstBbox = selection->GetFirst ()->GetFactory ()->GetPhysicsBBox ();
 
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects, selection->GetFirst ());
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    if (dynobj == selection->GetFirst ()) continue;
+    iDynamicObject* dynobj = objects[i];
     iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
 
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     csReversibleTransform& tr = mesh->GetMovable ()->GetTransform ();
     const csBox3& bbox = dynobj->GetFactory ()->GetPhysicsBBox ();
     csVector3 newpos = FindBiggestHorizontalMovement (firstBbox, firstTrans, bbox, tr);
     tr.SetOrigin (newpos);
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
 
     // Next SetPos we perform relative to the previous one we stacked.
     firstTrans = tr;
@@ -359,19 +373,15 @@ void TransformTools::SetPosSelectedObjects (iSelection* selection)
 
 void TransformTools::RotResetSelectedObjects (iSelection* selection)
 {
-  csRef<iSelectionIterator> it = selection->GetIterator ();
-  while (it->HasNext ())
+  csArray<iDynamicObject*> objects;
+  CollectMovedObjects (selection, objects);
+  BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    iDynamicObject* dynobj = it->Next ();
-    iMeshWrapper* mesh = dynobj->GetMesh ();
-    if (!mesh) continue;
+    iMeshWrapper* mesh = objects[i]->GetMesh ();
 
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     mesh->GetMovable ()->GetTransform ().LookAt (csVector3 (0, 0, 1), csVector3 (0, 1, 0));
     mesh->GetMovable ()->UpdateMove ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
   }
 }
 
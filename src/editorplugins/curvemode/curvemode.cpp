@@ -91,34 +91,45 @@ void CurveMode::UpdateMarkers ()
 {
   if (!editingCurveFactory) return;
   iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
-  if (editingCurveFactory->GetPointCount () != markers.GetSize ())
+  if (editingCurveFactory->GetPointCount () == markers.GetSize ())
   {
-    Stop ();
-    for (size_t i = 0 ; i < editingCurveFactory->GetPointCount () ; i++)
+    // Same number of points: only move the existing markers. If one
+    // of them can't be updated all markers are created again.
+    bool ok = true;
+    for (size_t i = 0 ; ok && i < markers.GetSize () ; i++)
+    {
+      markers[i]->AttachMesh (mesh);
+      ok = UpdateMarker (i);
+    }
+    if (ok)
     {
-      iMarker* marker = markerMgr->CreateMarker ();
-      markers.Push (marker);
-      marker->AttachMesh (mesh);
+      UpdateMarkerSelection ();
+      return;
     }
   }
 
+  Stop ();
+
   iMarkerColor* red = markerMgr->FindMarkerColor ("red");
   iMarkerColor* green = markerMgr->FindMarkerColor ("green");
   iMarkerColor* yellow = markerMgr->FindMarkerColor ("yellow");
 
+  // All markers share the same callback. The point is found with the
+  // data of the hit area.
+  csRef<MarkerCallback> cb;
+  cb.AttachNew (new MarkerCallback (this));
+
   for (size_t i = 0 ; i < editingCurveFactory->GetPointCount () ; i++)
   {
     csVector3 pos = editingCurveFactory->GetPosition (i);
     csVector3 front = editingCurveFactory->GetFront (i);
     csVector3 up = editingCurveFactory->GetUp (i);
-    iMarker* marker = markers[i];
-    marker->Clear ();
+    iMarker* marker = markerMgr->CreateMarker ();
+    markers.Push (marker);
+    marker->AttachMesh (mesh);
     marker->Line (MARKER_OBJECT, pos, pos+front, green, true);
     marker->Line (MARKER_OBJECT, pos, pos+up, red, true);
-    marker->ClearHitAreas ();
     iMarkerHitArea* hitArea = marker->HitArea (MARKER_OBJECT, pos, .1f, i, yellow);
-    csRef<MarkerCallback> cb;
-    cb.AttachNew (new MarkerCallback (this));
     hitArea->DefineDrag (0, 0, MARKER_WORLD, CONSTRAIN_MESH, cb);
     hitArea->DefineDrag (0, CSMASK_SHIFT, MARKER_WORLD, CONSTRAIN_MESH, cb);
     hitArea->DefineDrag (0, CSMASK_ALT, MARKER_WORLD, CONSTRAIN_YPLANE, cb);
@@ -130,6 +141,20 @@ void CurveMode::UpdateMarkers ()
   UpdateMarkerSelection ();
 }
 
+bool CurveMode::UpdateMarker (size_t idx)
+{
+  csVector3 pos = editingCurveFactory->GetPosition (idx);
+  csVector3 front = editingCurveFactory->GetFront (idx);
+  csVector3 up = editingCurveFactory->GetUp (idx);
+  iMarker* marker = idx < markers.GetSize () ? markers[idx] : 0;
+  iMarkerHitArea* hitArea = marker ? marker->GetHitArea (0) : 0;
+  if (!hitArea || !marker->UpdateLine (0, pos, pos+front)
+      || !marker->UpdateLine (1, pos, pos+up))
+    return false;
+  hitArea->SetCenter (pos);
+  return true;
+}
+
 void CurveMode::UpdateMarkerSelection ()
 {
   for (size_t i = 0 ; i < markers.GetSize () ; i++)
@@ -157,6 +182,8 @@ void CurveMode::Start ()
 
 void CurveMode::Stop ()
 {
+  if (editingCurveFactory && editingCurveFactory->IsGeneratingGeometry ())
+    FlushGeometry ();
   ViewMode::Stop ();
   for (size_t i = 0 ; i < markers.GetSize () ; i++)
     markerMgr->DestroyMarker (markers[i]);
@@ -200,11 +227,22 @@ void CurveMode::MarkerWantsMove (iMarker* marker, iMarkerHitArea* area,
 	  rp,
 	  editingCurveFactory->GetFront (idx),
 	  editingCurveFactory->GetUp (idx));
-    UpdateMarkers ();
   }
-  if (autoSmooth) DoAutoSmooth ();
-  ggen->GenerateGeometry (mesh);
-  view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+  if (autoSmooth) DoAutoSmooth (false);
+  else
+  {
+    // Only the dragged points changed.
+    for (size_t i = 0 ; i < dragPoints.GetSize () ; i++)
+      if (!UpdateMarker (dragPoints[i].idx))
+      {
+	// The markers don't match the curve anymore.
+	UpdateMarkers ();
+	break;
+      }
+  }
+  // The geometry is made in the background while dragging. The colliders
+  // are refreshed when dragging stops.
+  editingCurveFactory->GenerateGeometryAsync (mesh);
 }
 
 void CurveMode::MarkerStopDragging (iMarker* marker, iMarkerHitArea* area)
@@ -235,12 +273,41 @@ void CurveMode::AddCurrentPoint (size_t idx)
 
 void CurveMode::StopDrag ()
 {
+  if (dragPoints.GetSize () > 0)
+    FlushGeometry ();
   dragPoints.DeleteAll ();
 }
 
+void CurveMode::FlushGeometry ()
+{
+  if (!editingCurveFactory || !view3d->GetSelection ()->HasSelection ()) return;
+  iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
+  ggen->GenerateGeometry (mesh);
+  view3d->ScheduleRefreshColliders (view3d->GetSelection ()->GetFirst ());
+  view3d->FlushColliders ();
+}
+
+void CurveMode::RefreshColliders ()
+{
+  view3d->ScheduleRefreshColliders (view3d->GetSelection ()->GetFirst ());
+  // With 'Ares.ColliderRefresh' set to 'release' a drag only refreshes
+  // the colliders when it stops. Every other edit is finished here.
+  if (dragPoints.GetSize () == 0)
+    view3d->FlushColliders ();
+}
+
+bool CurveMode::IsAnimating ()
+{
+  // Frames have to continue until FramePre() picks up the finished job.
+  return editingCurveFactory && editingCurveFactory->IsGeneratingGeometry ();
+}
+
 void CurveMode::FramePre()
 {
   ViewMode::FramePre ();
+  if (editingCurveFactory && editingCurveFactory->FinishGeometry ()
+      && view3d->GetSelection ()->HasSelection ())
+    RefreshColliders ();
 }
 
 void CurveMode::Frame3D()
@@ -253,14 +320,16 @@ void CurveMode::Frame2D()
   ViewMode::Frame2D ();
 }
 
-void CurveMode::DoAutoSmooth ()
+void CurveMode::DoAutoSmooth (bool regen)
 {
   if (editingCurveFactory->GetPointCount () <= 2) return;
   for (size_t i = 1 ; i < editingCurveFactory->GetPointCount ()-1 ; i++)
     SmoothPoint (i, false);
+  UpdateMarkers ();
+  if (!regen) return;
   iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
   ggen->GenerateGeometry (mesh);
-  view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+  RefreshColliders ();
 }
 
 void CurveMode::SmoothPoint (size_t idx, bool regen)
@@ -275,12 +344,12 @@ void CurveMode::SmoothPoint (size_t idx, bool regen)
   //csVector3 right = fr % up;
   //up = - (fr % right).Unit ();
   editingCurveFactory->ChangePoint (idx, pos, fr, up);
-  UpdateMarkers ();
   if (regen)
   {
+    UpdateMarkers ();
     iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
     ggen->GenerateGeometry (mesh);
-    view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+    RefreshColliders ();
   }
 }
 
@@ -330,7 +399,7 @@ void CurveMode::RotateCurrent (float baseAngle)
   }
   iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
   ggen->GenerateGeometry (mesh);
-  view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+  RefreshColliders ();
 }
 
 void CurveMode::FlatPoint (size_t idx)
@@ -356,12 +425,11 @@ void CurveMode::FlatPoint (size_t idx)
     pos.y += sideHeight / 2.0;
     pos = meshtrans.Other2This (pos);
     editingCurveFactory->ChangePoint (idx, pos, f, u);
-    UpdateMarkers ();
-    if (autoSmooth)
-      DoAutoSmooth ();
-    else
-      ggen->GenerateGeometry (mesh);
-    view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+    // DoAutoSmooth() also updates the markers.
+    if (autoSmooth) DoAutoSmooth (false);
+    else UpdateMarkers ();
+    ggen->GenerateGeometry (mesh);
+    RefreshColliders ();
   }
 }
 
@@ -421,11 +489,11 @@ bool CurveMode::OnKeyboard (iEvent& ev, utf32_char code)
     const csVector3& front = editingCurveFactory->GetFront (id);
     const csVector3& up = editingCurveFactory->GetUp (id);
     editingCurveFactory->AddPoint (pos + front, front, up);
-    if (autoSmooth) DoAutoSmooth ();
+    if (autoSmooth) DoAutoSmooth (false);
 
     iMeshWrapper* mesh = view3d->GetSelection ()->GetFirst ()->GetMesh ();
     ggen->GenerateGeometry (mesh);
-    view3d->GetSelection ()->GetFirst ()->RefreshColliders ();
+    RefreshColliders ();
     UpdateMarkers ();
   }
   return false;
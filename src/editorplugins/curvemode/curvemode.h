@@ -84,9 +84,27 @@ private:
   void OnAutoSmoothSelected ();
 
   bool autoSmooth;
-  void DoAutoSmooth ();
+  void DoAutoSmooth (bool regen = true);
+
+  /**
+   * Finish the geometry of the curve that is still being generated in
+   * the background and refresh the colliders.
+   */
+  void FlushGeometry ();
+
+  /**
+   * Refresh the colliders of the curve after its geometry changed.
+   * While dragging this is only scheduled.
+   */
+  void RefreshColliders ();
 
   void UpdateMarkers ();
+  /**
+   * Update the lines and hit area of an existing marker in place.
+   * Returns false if the marker doesn't match the curve anymore. In that
+   * case UpdateMarkers() has to be called.
+   */
+  bool UpdateMarker (size_t idx);
   void UpdateMarkerSelection ();
 
 public:
@@ -101,6 +119,7 @@ public:
   virtual void Start ();
   virtual void Stop ();
 
+  virtual bool IsAnimating ();
   virtual void FramePre ();
   virtual void Frame3D ();
   virtual void Frame2D ();
@@ -2044,6 +2044,8 @@ void DynfactDialog::Show ()
 void DynfactDialog::Tick ()
 {
   meshView->RotateMesh (vc->GetElapsedSeconds ());
+  // The preview keeps rotating so the 3D view may not go idle.
+  app->RequestRedraw ();
 }
 
 CS::Animation::iSkeletonFactory* DynfactDialog::GetSkeletonFactory (const char* factName)
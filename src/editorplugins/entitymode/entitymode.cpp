@@ -848,6 +848,9 @@ void EntityMode::BuildMainPanel (wxWindow* parent)
 
   graphView = markerMgr->CreateGraphView ();
   graphView->Clear ();
+  csRef<iConfigManager> cfgmgr = csQueryRegistry<iConfigManager> (
+      app->GetObjectRegistry ());
+  graphView->SetThreadedLayout (cfgmgr->GetBool ("Ares.ThreadedGraphLayout", false));
   csRef<GraphNodeCallback> cb;
   cb.AttachNew (new GraphNodeCallback (this));
   graphView->AddNodeActivationCallback (cb);
@@ -1947,7 +1950,7 @@ void EntityMode::OnQuestDel (const char* questName)
     yes = ui->Ask ("Are you sure you want to remove the '%s' quest?", questName);
   if (yes)
   {
-    view3d->GetApplication ()->GetAssetManager ()->RegisterRemoval (questFact->QueryObject ());
+    view3d->GetApplication ()->RegisterRemoval (questFact->QueryObject ());
     questMgr->RemoveQuestFactory (questName);
     questsValue->Refresh ();
     editQuestMode = 0;
@@ -2082,7 +2085,7 @@ void EntityMode::OnTemplateDel (const char* tplName)
     yes = ui->Ask ("Are you sure you want to remove the '%s' template?", tpl->GetName ());
   if (yes)
   {
-    view3d->GetApplication ()->GetAssetManager ()->RegisterRemoval (tpl->QueryObject ());
+    view3d->GetApplication ()->RegisterRemoval (tpl->QueryObject ());
     view3d->GetApplication ()->UpdateTitle ();
     if (cnt > 0)
     {
@@ -288,6 +288,7 @@ public:
   virtual void AllocContextHandlers (wxFrame* frame);
   virtual void AddContextMenu (wxMenu* contextMenu, int mouseX, int mouseY);
 
+  virtual bool IsAnimating () { return graphView->IsLayoutRunning (); }
   virtual void FramePre();
   virtual void Frame3D();
   virtual void Frame2D();
@@ -33,9 +33,16 @@ LabelManager::LabelManager (iObjectRegistry* object_reg) : object_reg (object_re
 {
   markerMgr = csQueryRegistry<iMarkerManager> (object_reg);
   engine = csQueryRegistry<iEngine> (object_reg);
+  csRef<iGraphics3D> g3d = csQueryRegistry<iGraphics3D> (object_reg);
+  g2d = g3d->GetDriver2D ();
+  // The same font as the default font of the marker manager.
+  font = g2d->GetFontServer ()->LoadFont (CSFONT_LARGE);
   labelRadius = 20;
   updatecounter = UPDATECOUNTER;
 
+  csRef<iConfigManager> cfgmgr = csQueryRegistry<iConfigManager> (object_reg);
+  declutter = cfgmgr->GetBool ("Ares.LabelDeclutter", false);
+
   entityColor = markerMgr->CreateMarkerColor ("entityColor");
   entityColor->SetRGBColor (SELECTION_NONE, 0, .6, 0, 1);
   entityColor->SetRGBColor (SELECTION_SELECTED, 0, 1, 0, 1);
@@ -58,30 +65,88 @@ LabelManager::~LabelManager ()
   Cleanup ();
 }
 
-void LabelManager::GetLabelAndColor (iDynamicObject* dynobj, csStringArray& arr,
+void LabelManager::GetLabelAndColor (iDynamicObject* dynobj, csString& text,
     iMarkerColor*& color)
 {
   if (dynobj->GetEntityName () && *dynobj->GetEntityName ())
   {
     color = entityColor;
-    arr.Push (dynobj->GetEntityName ());
+    text = dynobj->GetEntityName ();
   }
   else
   {
     color = factoryColor;
-    arr.Push (dynobj->GetFactory ()->GetName ());
+    text = dynobj->GetFactory ()->GetName ();
   }
 }
 
-void LabelManager::FramePre (iPcDynamicWorld* dynworld, iCamera* camera)
+iMarker* LabelManager::AllocMarker ()
 {
-  updatecounter--;
-  if (updatecounter > 0) return;
-  updatecounter = UPDATECOUNTER;
+  if (pool.GetSize () > 0)
+  {
+    iMarker* marker = pool.Pop ();
+    marker->SetVisible (true);
+    return marker;
+  }
+  return markerMgr->CreateMarker ();
+}
+
+void LabelManager::FreeMarker (iMarker* marker)
+{
+  if (pool.GetSize () >= LABEL_POOLSIZE)
+  {
+    markerMgr->DestroyMarker (marker);
+    return;
+  }
+  marker->SetVisible (false);
+  marker->AttachMesh (0);
+  pool.Push (marker);
+}
 
+void LabelManager::UpdateLabel (Label* label, iDynamicObject* dynobj)
+{
+  int level = dynobj->IsHilight () ? SELECTION_ACTIVE : SELECTION_NONE;
+  if (level != label->selectionLevel)
+  {
+    label->selectionLevel = level;
+    label->marker->SetSelectionLevel (level);
+  }
+
+  csString text;
+  iMarkerColor* color;
+  GetLabelAndColor (dynobj, text, color);
+  if (color == label->color && text == label->text) return;
+  label->text = text;
+  label->color = color;
+  font->GetDimensions (text, label->width, label->height);
+  csStringArray t (1);
+  t.Push (text);
+  label->marker->Clear ();
+  label->marker->Text (MARKER_OBJECT, csVector3 (0), t, color);
+}
+
+void LabelManager::FramePre (iPcDynamicWorld* dynworld, iView* view)
+{
+  iCamera* camera = view->GetCamera ();
   if (!camera->GetSector ()) return;
 
-  Cleanup ();
+  // Finding the nearby meshes is expensive so the set of labels is only
+  // refreshed every few frames. The labels move on screen every time
+  // the camera moves so decluttering (which is cheap) happens every frame.
+  updatecounter--;
+  if (updatecounter <= 0)
+  {
+    updatecounter = UPDATECOUNTER;
+    UpdateLabels (dynworld, camera);
+  }
+  if (declutter) Declutter (view);
+}
+
+void LabelManager::UpdateLabels (iPcDynamicWorld* dynworld, iCamera* camera)
+{
+  csHash<Label*, csPtrKey<iMeshWrapper> >::GlobalIterator lIt = labels.GetIterator ();
+  while (lIt.HasNext ())
+    lIt.Next ()->seen = false;
 
   csRef<iMeshWrapperIterator> it = engine->GetNearbyMeshes (camera->GetSector (),
       camera->GetTransform ().GetOrigin (), labelRadius, false);
@@ -89,29 +154,127 @@ void LabelManager::FramePre (iPcDynamicWorld* dynworld, iCamera* camera)
   {
     iMeshWrapper* mesh = it->Next ();
     iDynamicObject* dynobj = dynworld->FindObject (mesh);
-    if (dynobj)
+    if (!dynobj) continue;
+    Label* label = labels.Get (mesh, 0);
+    if (label && label->mesh != mesh)
+    {
+      // The old mesh is gone and a new one got the same address.
+      label->mesh = mesh;
+      label->marker->AttachMesh (mesh);
+    }
+    if (!label)
     {
-      iMarker* marker = markerMgr->CreateMarker ();
-      marker->SetSelectionLevel (dynobj->IsHilight () ? SELECTION_ACTIVE : SELECTION_NONE);
-      marker->AttachMesh (mesh);
-      iMarkerColor* color;
-      csStringArray t (1);
-      GetLabelAndColor (dynobj, t, color);
-      marker->Text (MARKER_OBJECT, csVector3 (0), t, color);
-      markers.Put (mesh, marker);
+      label = new Label ();
+      label->marker = AllocMarker ();
+      label->mesh = mesh;
+      label->color = 0;
+      label->selectionLevel = -1;
+      label->width = label->height = 0;
+      label->marker->AttachMesh (mesh);
+      labels.Put (mesh, label);
     }
+    label->seen = true;
+    UpdateLabel (label, dynobj);
+  }
+
+  // Remove the labels of meshes that are no longer near.
+  csArray<iMeshWrapper*> toDelete;
+  lIt = labels.GetIterator ();
+  while (lIt.HasNext ())
+  {
+    csPtrKey<iMeshWrapper> key;
+    Label* label = lIt.Next (key);
+    if (label->seen) continue;
+    FreeMarker (label->marker);
+    toDelete.Push (key);
+    delete label;
+  }
+  for (size_t i = 0 ; i < toDelete.GetSize () ; i++)
+    labels.DeleteAll (toDelete[i]);
+}
+
+struct VisibleLabel
+{
+  Label* label;
+  csVector3 pos;	// Camera space.
+};
+
+static int CompareLabelDistance (VisibleLabel const& l1, VisibleLabel const& l2)
+{
+  if (l1.pos.z < l2.pos.z) return -1;
+  if (l1.pos.z > l2.pos.z) return 1;
+  return 0;
+}
+
+// Size in pixels of the cells that are used to find overlapping labels.
+#define DECLUTTER_CELL 8
+
+void LabelManager::Declutter (iView* view)
+{
+  int fw = g2d->GetWidth ();
+  int fh = g2d->GetHeight ();
+  int gw = (fw + DECLUTTER_CELL - 1) / DECLUTTER_CELL;
+  int gh = (fh + DECLUTTER_CELL - 1) / DECLUTTER_CELL;
+  csBitArray occupied (gw * gh);
+
+  // Find the camera space position of every label.
+  csArray<VisibleLabel> visible;
+  const csOrthoTransform& camtrans = view->GetCamera ()->GetTransform ();
+  csHash<Label*, csPtrKey<iMeshWrapper> >::GlobalIterator it = labels.GetIterator ();
+  while (it.HasNext ())
+  {
+    Label* label = it.Next ();
+    label->marker->SetVisible (false);
+    if (!label->mesh) continue;
+    csVector3 v = camtrans.Other2This (
+	label->mesh->GetMovable ()->GetFullPosition ());
+    if (v.z <= .5) continue;
+    VisibleLabel vl;
+    vl.label = label;
+    vl.pos = v;
+    visible.Push (vl);
+  }
+
+  // Place the labels from near to far.
+  visible.Sort (CompareLabelDistance);
+  for (size_t i = 0 ; i < visible.GetSize () ; i++)
+  {
+    Label* label = visible[i].label;
+    csVector2 s = view->Project (visible[i].pos);
+    // Texts are drawn with the top left corner at the position.
+    int x1 = int (s.x) / DECLUTTER_CELL;
+    int y1 = int (s.y) / DECLUTTER_CELL;
+    int x2 = (int (s.x) + label->width) / DECLUTTER_CELL;
+    int y2 = (int (s.y) + label->height) / DECLUTTER_CELL;
+    if (x2 < 0 || y2 < 0 || x1 >= gw || y1 >= gh) continue;
+    x1 = csMax (x1, 0); y1 = csMax (y1, 0);
+    x2 = csMin (x2, gw-1); y2 = csMin (y2, gh-1);
+    bool free = true;
+    for (int y = y1 ; free && y <= y2 ; y++)
+      for (int x = x1 ; x <= x2 ; x++)
+	if (occupied.IsBitSet (y * gw + x)) { free = false; break; }
+    // Hilighted objects always get a label.
+    if (!free && label->selectionLevel != SELECTION_ACTIVE) continue;
+    for (int y = y1 ; y <= y2 ; y++)
+      for (int x = x1 ; x <= x2 ; x++)
+	occupied.SetBit (y * gw + x);
+    label->marker->SetVisible (true);
   }
 }
 
 void LabelManager::Cleanup ()
 {
-  csHash<iMarker*, csPtrKey<iMeshWrapper> >::GlobalIterator mIt = markers.GetIterator ();
-  while (mIt.HasNext ())
+  csHash<Label*, csPtrKey<iMeshWrapper> >::GlobalIterator lIt = labels.GetIterator ();
+  while (lIt.HasNext ())
   {
-    iMarker* marker = mIt.Next ();
-    markerMgr->DestroyMarker (marker);
+    Label* label = lIt.Next ();
+    markerMgr->DestroyMarker (label->marker);
+    delete label;
   }
-  markers.Empty ();
+  labels.Empty ();
+  for (size_t i = 0 ; i < pool.GetSize () ; i++)
+    markerMgr->DestroyMarker (pool[i]);
+  pool.Empty ();
 }
 
 //---------------------------------------------------------------------------
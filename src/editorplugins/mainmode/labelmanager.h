@@ -27,38 +27,78 @@ THE SOFTWARE.
 
 #include "csutil/scfstr.h"
 #include "csutil/hash.h"
+#include "csutil/weakref.h"
 
 struct iMarkerManager;
 struct iMarkerColor;
 struct iMarker;
 struct iEngine;
+struct iFont;
+struct iGraphics2D;
 struct iPcDynamicWorld;
 struct iDynamicObject;
+struct iView;
 struct iCamera;
 
 #define UPDATECOUNTER 10
 
+// Maximum number of unused label markers that are kept for later.
+#define LABEL_POOLSIZE 256
+
+struct Label
+{
+  iMarker* marker;
+  csWeakRef<iMeshWrapper> mesh;
+  csString text;
+  iMarkerColor* color;
+  int selectionLevel;
+  // Size of the text on screen (for decluttering).
+  int width, height;
+  // Set for all labels that are still near during a refresh.
+  bool seen;
+};
+
 class LabelManager
 {
 private:
   iObjectRegistry* object_reg;
   csRef<iMarkerManager> markerMgr;
   csRef<iEngine> engine;
+  csRef<iGraphics2D> g2d;
+  csRef<iFont> font;
 
-  csHash<iMarker*, csPtrKey<iMeshWrapper> > markers;
+  csHash<Label*, csPtrKey<iMeshWrapper> > labels;
+  // Unused markers that are hidden.
+  csArray<iMarker*> pool;
   iMarkerColor* entityColor;
   iMarkerColor* factoryColor;
 
   float labelRadius;
   int updatecounter;
+  bool declutter;
+
+  void GetLabelAndColor (iDynamicObject* dynobj, csString& text, iMarkerColor*& color);
+
+  iMarker* AllocMarker ();
+  void FreeMarker (iMarker* marker);
+
+  /// Update the marker of a label if the text, color or hilight changed.
+  void UpdateLabel (Label* label, iDynamicObject* dynobj);
+
+  /// Make labels for the objects near the camera and remove the others.
+  void UpdateLabels (iPcDynamicWorld* dynworld, iCamera* camera);
 
-  void GetLabelAndColor (iDynamicObject* dynobj, csStringArray& arr, iMarkerColor*& color);
+  /**
+   * Hide labels that overlap with other labels on screen. Labels closer
+   * to the camera win.
+   */
+  void Declutter (iView* view);
 
 public:
   LabelManager (iObjectRegistry* object_reg);
   virtual ~LabelManager ();
 
-  void FramePre (iPcDynamicWorld* dynworld, iCamera* camera);
+  void FramePre (iPcDynamicWorld* dynworld, iView* view);
   void Cleanup ();
 };
 
@@ -44,6 +44,10 @@ THE SOFTWARE.
 #include <wx/listctrl.h>
 #include <wx/xrc/xmlres.h>
 
+// Objects moved with the keyboard or the tools are restored after this
+// many milliseconds without another transformation.
+#define TRANSFORM_IDLE_TIME 500
+
 //---------------------------------------------------------------------------
 
 BEGIN_EVENT_TABLE(MainMode::Panel, wxPanel)
@@ -238,6 +242,7 @@ void MainMode::Start ()
 
 void MainMode::Stop ()
 {
+  TransformTools::EndTransform ();
   ViewMode::Stop ();
   transformationMarker->SetVisible (false);
   transformationMarker->AttachMesh (0);
@@ -295,6 +300,9 @@ void MainMode::Refresh ()
 
 void MainMode::CurrentObjectsChanged (const csArray<iDynamicObject*>& current)
 {
+  // A new selection is a new edit.
+  if (dragObjects.GetSize () == 0)
+    TransformTools::EndTransform ();
   wxTextCtrl* nameText = XRCCTRL (*panel, "objectNameText", wxTextCtrl);
   wxCheckBox* staticCheck = XRCCTRL (*panel, "staticCheckBox", wxCheckBox);
   if (current.GetSize () > 1)
@@ -453,13 +461,14 @@ void MainMode::OnListSelChanged (wxListEvent& event)
   iSelection* selection = view3d->GetSelection ();
   wxListCtrl* list = XRCCTRL (*panel, "objectList", wxListCtrl);
   csArray<Ares::Value*> values = view.GetSelectedValues (list);
-  selection->SetCurrentObject (0);
+  csArray<iDynamicObject*> objects;
   for (size_t i = 0 ; i < values.GetSize () ; i++)
   {
     iDynamicObject* dynobj = view3d->GetModelRepository ()->GetDynamicObjectFromObjects (values[i]);
     if (dynobj)
-      selection->AddCurrentObject (dynobj);
+      objects.Push (dynobj);
   }
+  selection->SetObjects (objects);
   view3d->GetApplication ()->SetFocus3D ();
   changing3DSelection--;
 }
@@ -472,8 +481,6 @@ void MainMode::MarkerStartDragging (iMarker* marker, iMarkerHitArea* area,
   while (it->HasNext ())
   {
     iDynamicObject* dynobj = it->Next ();
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     AresDragObject dob;
     dob.originalTransform = dynobj->GetTransform ();
     csVector3 meshpos = dob.originalTransform.GetOrigin ();
@@ -481,6 +488,15 @@ void MainMode::MarkerStartDragging (iMarker* marker, iMarkerHitArea* area,
     dob.dynobj = dynobj;
     dragObjects.Push (dob);
   }
+  TransformTools::BeginTransform (GetDraggedObjects ());
+}
+
+csArray<iDynamicObject*> MainMode::GetDraggedObjects () const
+{
+  csArray<iDynamicObject*> objects;
+  for (size_t i = 0 ; i < dragObjects.GetSize () ; i++)
+    objects.Push (dragObjects[i].dynobj);
+  return objects;
 }
 
 void MainMode::SetDynObjOrigin (iDynamicObject* dynobj, const csVector3& pos)
@@ -488,13 +504,17 @@ void MainMode::SetDynObjOrigin (iDynamicObject* dynobj, const csVector3& pos)
   csReversibleTransform tr = dynobj->GetTransform ();
   tr.SetOrigin (pos);
   dynobj->SetTransform (tr);
-  app->RegisterModification ();
+  csArray<iDynamicObject*> objects;
+  objects.Push (dynobj);
+  app->RegisterModification (objects);
 }
 
 void MainMode::SetDynObjTransform (iDynamicObject* dynobj, const csReversibleTransform& trans)
 {
   dynobj->SetTransform (trans);
-  app->RegisterModification ();
+  csArray<iDynamicObject*> objects;
+  objects.Push (dynobj);
+  app->RegisterModification (objects);
 }
 
 void MainMode::MarkerWantsMove (iMarker* marker, iMarkerHitArea* area,
@@ -519,15 +539,9 @@ void MainMode::MarkerWantsRotate (iMarker* marker, iMarkerHitArea* area,
 
 void MainMode::MarkerStopDragging (iMarker* marker, iMarkerHitArea* area)
 {
+  TransformTools::EndTransform ();
   dragObjects.DeleteAll ();
   do_kinematic_dragging = false;
-  csRef<iSelectionIterator> it = view3d->GetSelection ()->GetIterator ();
-  while (it->HasNext ())
-  {
-    iDynamicObject* dynobj = it->Next ();
-    dynobj->UndoKinematic ();
-    dynobj->RecreatePivotJoints ();
-  }
 }
 
 void MainMode::StopDrag (bool cancel)
@@ -551,22 +565,17 @@ void MainMode::StopDrag (bool cancel)
   if (do_kinematic_dragging)
   {
     do_kinematic_dragging = false;
-    size_t i = 0;
-    csRef<iSelectionIterator> it = view3d->GetSelection ()->GetIterator ();
-    while (it->HasNext ())
+    if (cancel)
     {
-      iDynamicObject* dynobj = it->Next ();
-      if (cancel)
+      csArray<iDynamicObject*> objects;
+      for (size_t i = 0 ; i < dragObjects.GetSize () ; i++)
       {
-    	AresDragObject& dob = dragObjects[i];
-	dynobj->SetTransform (dob.originalTransform);
-	app->RegisterModification ();
+	dragObjects[i].dynobj->SetTransform (dragObjects[i].originalTransform);
+	objects.Push (dragObjects[i].dynobj);
       }
-      dynobj->UndoKinematic ();
-      dynobj->RecreatePivotJoints ();
-      if (kinematicFirstOnly) break;
-      i++;
+      app->RegisterModification (objects);
     }
+    TransformTools::EndTransform ();
   }
   dragObjects.DeleteAll ();
   view3d->GetApplication ()->ClearStatus ();
@@ -701,8 +710,13 @@ void MainMode::FramePre()
   {
     HandleKinematicDragging ();
   }
+  else if (dragObjects.GetSize () == 0 && TransformTools::IsTransforming ()
+      && csGetTicks () - TransformTools::GetLastTransformTime () > TRANSFORM_IDLE_TIME)
+  {
+    TransformTools::EndTransform ();
+  }
   if (showLabels)
-    labelMgr->FramePre (view3d->GetDynamicWorld (), view3d->GetCsCamera ());
+    labelMgr->FramePre (view3d->GetDynamicWorld (), view3d->GetView ());
 }
 
 void MainMode::Frame3D()
@@ -924,6 +938,7 @@ bool MainMode::OnKeyboard (iEvent& ev, utf32_char code)
   bool shift = kbd->GetKeyState (CSKEY_SHIFT);
   if (code == '2')
   {
+    TransformTools::EndTransform ();
     csRef<iSelectionIterator> it = view3d->GetSelection ()->GetIterator ();
     while (it->HasNext ())
     {
@@ -933,7 +948,7 @@ bool MainMode::OnKeyboard (iEvent& ev, utf32_char code)
       else
 	dynobj->MakeStatic ();
     }
-    app->RegisterModification ();
+    app->RegisterModification (view3d->GetSelection ()->GetObjects ());
     CurrentObjectsChanged (view3d->GetSelection ()->GetObjects ());
   }
   else if (code == 'h')
@@ -965,6 +980,11 @@ bool MainMode::OnKeyboard (iEvent& ev, utf32_char code)
   {
     SpawnSelectedItem ();
   }
+  else if (code == 'r')
+  {
+    if (view3d->GetPaster ()->IsPasteSelectionActive ())
+      view3d->GetPaster ()->ToggleScatterMode ();
+  }
   else if (code == 'q')
   {
     if (view3d->GetPaster ()->IsPasteSelectionActive () || do_kinematic_dragging)
@@ -1033,19 +1053,35 @@ bool MainMode::OnKeyboard (iEvent& ev, utf32_char code)
   }
   else if (code == CSKEY_UP)
   {
-    TransformTools::Move (view3d->GetSelection (), csVector3 (0, 0, 1), ctrl, shift);
+    iPaster* paster = view3d->GetPaster ();
+    if (paster->IsPasteSelectionActive ())
+      paster->SetPasteGrid (paster->GetPasteColumns (), paster->GetPasteRows () + 1);
+    else
+      TransformTools::Move (view3d->GetSelection (), csVector3 (0, 0, 1), ctrl, shift);
   }
   else if (code == CSKEY_DOWN)
   {
-    TransformTools::Move (view3d->GetSelection (), csVector3 (0, 0, -1), ctrl, shift);
+    iPaster* paster = view3d->GetPaster ();
+    if (paster->IsPasteSelectionActive ())
+      paster->SetPasteGrid (paster->GetPasteColumns (), paster->GetPasteRows () - 1);
+    else
+      TransformTools::Move (view3d->GetSelection (), csVector3 (0, 0, -1), ctrl, shift);
   }
   else if (code == CSKEY_LEFT)
   {
-    TransformTools::Move (view3d->GetSelection (), csVector3 (-1, 0, 0), ctrl, shift);
+    iPaster* paster = view3d->GetPaster ();
+    if (paster->IsPasteSelectionActive ())
+      paster->SetPasteGrid (paster->GetPasteColumns () - 1, paster->GetPasteRows ());
+    else
+      TransformTools::Move (view3d->GetSelection (), csVector3 (-1, 0, 0), ctrl, shift);
   }
   else if (code == CSKEY_RIGHT)
   {
-    TransformTools::Move (view3d->GetSelection (), csVector3 (1, 0, 0), ctrl, shift);
+    iPaster* paster = view3d->GetPaster ();
+    if (paster->IsPasteSelectionActive ())
+      paster->SetPasteGrid (paster->GetPasteColumns () + 1, paster->GetPasteRows ());
+    else
+      TransformTools::Move (view3d->GetSelection (), csVector3 (1, 0, 0), ctrl, shift);
   }
   else if (code == '<' || code == ',')
   {
@@ -1068,12 +1104,12 @@ void MainMode::OnSnapObjects ()
     return;
   }
   const csArray<iDynamicObject*>& ob = selection->GetObjects ();
+  csArray<iDynamicObject*> objects;
   for (size_t i = 1 ; i < ob.GetSize () ; i++)
-  {
-    ob[i]->MakeKinematic ();
-    ob[i]->SetTransform (ob[0]->GetTransform ());
-    ob[i]->UndoKinematic ();
-  }
+    objects.Push (ob[i]);
+  TransformTools::BeginTransform (objects);
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+    objects[i]->SetTransform (ob[0]->GetTransform ());
 }
 
 csRef<iString> MainMode::GetStatusLine ()
@@ -1097,9 +1133,6 @@ void MainMode::StartKinematicDragging (bool restrictY,
   while (it->HasNext ())
   {
     iDynamicObject* dynobj = it->Next ();
-    // First remove all pivot joints before starting to drag.
-    dynobj->RemovePivotJoints ();
-    dynobj->MakeKinematic ();
     AresDragObject dob;
     dob.originalTransform = dynobj->GetTransform ();
     csVector3 meshpos = dob.originalTransform.GetOrigin ();
@@ -1108,6 +1141,7 @@ void MainMode::StartKinematicDragging (bool restrictY,
     dragObjects.Push (dob);
     if (kinematicFirstOnly) break;
   }
+  TransformTools::BeginTransform (GetDraggedObjects ());
 
   dragDistance = (isect - beam.Start ()).Norm ();
   dragRestrict = isect;
@@ -27,6 +27,7 @@ THE SOFTWARE.
 
 #include "csutil/scfstr.h"
 #include "edcommon/viewmode.h"
+#include "edcommon/transformtools.h"
 
 #include "labelmanager.h"
 
@@ -70,6 +71,7 @@ private:
   bool do_kinematic_dragging;
   bool kinematicFirstOnly;
   csArray<AresDragObject> dragObjects;
+  csArray<iDynamicObject*> GetDraggedObjects () const;
 
   bool doDragLocal;	// Drag restrict in local space.
   bool doDragRestrict[3];  // Restrict dragging on a plane.
@@ -131,6 +133,11 @@ public:
   {
     return !(do_dragging || do_kinematic_dragging);
   }
+  virtual bool IsAnimating ()
+  {
+    // Keep the frames going until the moved objects are restored.
+    return do_dragging || TransformTools::IsTransforming ();
+  }
 
   virtual void CurrentObjectsChanged (const csArray<iDynamicObject*>& current);
 
@@ -42,8 +42,41 @@ SCF_IMPLEMENT_FACTORY (PlayMode)
 
 //---------------------------------------------------------------------------
 
+void DynworldSnapshot::VisualState::Fetch (iDynamicObject* dynobj)
+{
+  iMeshWrapper* mesh = dynobj->GetMesh ();
+  hasMesh = mesh != 0;
+  iLight* light = dynobj->GetLight ();
+  hasLight = light != 0;
+  hasColor = false;
+  if (mesh)
+  {
+    flags = mesh->GetFlags ().Get ();
+    material = mesh->GetMeshObject ()->GetMaterialWrapper ();
+    hasColor = mesh->GetMeshObject ()->GetColor (color);
+  }
+  else if (light)
+  {
+    color = light->GetColor ();
+    hasColor = true;
+  }
+}
+
+bool DynworldSnapshot::VisualState::Differs (const VisualState& other) const
+{
+  // A mesh or light that isn't there (because it is too far away) was
+  // not changed by an entity.
+  if (hasMesh && other.hasMesh)
+    return flags != other.flags || material != other.material
+      || hasColor != other.hasColor || (hasColor && !(color == other.color));
+  if (hasLight && other.hasLight)
+    return !(color == other.color);
+  return false;
+}
+
 DynworldSnapshot::DynworldSnapshot (iPcDynamicWorld* dynworld)
 {
+  csHash<size_t,csPtrKey<iDynamicObject> > indices;
   csRef<iDynamicCellIterator> cellIt = dynworld->GetCells ();
   while (cellIt->HasNext ())
   {
@@ -51,78 +84,158 @@ DynworldSnapshot::DynworldSnapshot (iPcDynamicWorld* dynworld)
     for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
     {
       iDynamicObject* dynobj = cell->GetObject (i);
-      Obj obj;
+      indices.Put (dynobj, objects.GetSize ());
+      Obj& obj = objects.GetExtend (objects.GetSize ());
+      obj.dynobj = dynobj;
       obj.cell = dynobj->GetCell ();
       obj.fact = dynobj->GetFactory ();
       obj.isStatic = dynobj->IsStatic ();
       obj.trans = dynobj->GetTransform ();
-      if (dynobj->GetEntityTemplate ())
-        obj.templateName = dynobj->GetEntityTemplate ()->GetName ();
+      obj.tpl = dynobj->GetEntityTemplate ();
       obj.entityName = dynobj->GetEntityName ();
       obj.params = dynobj->GetEntityParameters ();
-      for (size_t j = 0 ; j < dynobj->GetFactory ()->GetJointCount () ; j++)
-      {
-	obj.connectedObjects.Push (FindObjIndex (dynobj->GetCell (), dynobj->GetConnectedObject (j)));
-      }
-      objects.Push (obj);
+      obj.visual.Fetch (dynobj);
     }
   }
-}
 
-size_t DynworldSnapshot::FindObjIndex (iDynamicCell* cell, iDynamicObject* dynobj)
-{
-  if (dynobj == 0) return csArrayItemNotFound;
-  for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+  // Now that all objects have an index we can resolve the joints.
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    if (dynobj == cell->GetObject (i)) return i;
+    Obj& obj = objects[i];
+    iDynamicObject* dynobj = obj.dynobj;
+    for (size_t j = 0 ; j < obj.fact->GetJointCount () ; j++)
+    {
+      iDynamicObject* other = dynobj->GetConnectedObject (j);
+      obj.connectedObjects.Push (other ?
+	  indices.Get (other, csArrayItemNotFound) : csArrayItemNotFound);
+    }
   }
-  return csArrayItemNotFound;
 }
 
-struct DynIdx { iDynamicObject* dynobj; size_t idx; };
+iDynamicObject* DynworldSnapshot::Recreate (Obj& obj)
+{
+  iDynamicObject* dynobj = obj.cell->AddObject (obj.fact->GetName (), obj.trans);
+
+  if (obj.tpl || obj.params)
+    dynobj->SetEntity (obj.entityName, obj.tpl ? obj.tpl->GetName () : (const char*)0,
+	obj.params);
+  else if (!obj.entityName.IsEmpty ())
+    dynobj->SetEntityName (obj.entityName);
+
+  if (obj.isStatic)
+    dynobj->MakeStatic ();
+  else
+    dynobj->MakeDynamic ();
+  obj.dynobj = dynobj;
+  return dynobj;
+}
 
-void DynworldSnapshot::Restore (iPcDynamicWorld* dynworld)
+static bool TransformEquals (const csReversibleTransform& t1,
+    const csReversibleTransform& t2)
 {
+  const csMatrix3& m1 = t1.GetO2T ();
+  const csMatrix3& m2 = t2.GetO2T ();
+  return t1.GetOrigin () == t2.GetOrigin ()
+    && m1.m11 == m2.m11 && m1.m12 == m2.m12 && m1.m13 == m2.m13
+    && m1.m21 == m2.m21 && m1.m22 == m2.m22 && m1.m23 == m2.m23
+    && m1.m31 == m2.m31 && m1.m32 == m2.m32 && m1.m33 == m2.m33;
+}
+
+void DynworldSnapshot::Restore (iPcDynamicWorld* dynworld, iCelPlLayer* pl)
+{
+  csHash<size_t,csPtrKey<iDynamicObject> > indices;
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
+  {
+    iDynamicObject* dynobj = objects[i].dynobj;
+    if (dynobj) indices.Put (dynobj, i);
+  }
+
+  // Delete the objects that were created while playing. Objects from the
+  // snapshot that are still in their cell are marked as present.
+  csBitArray present (objects.GetSize ());
   csRef<iDynamicCellIterator> cellIt = dynworld->GetCells ();
   while (cellIt->HasNext ())
   {
     iDynamicCell* cell = cellIt->NextCell ();
-    cell->DeleteObjects ();
+    csArray<iDynamicObject*> toDelete;
+    for (size_t i = 0 ; i < cell->GetObjectCount () ; i++)
+    {
+      iDynamicObject* dynobj = cell->GetObject (i);
+      size_t idx = indices.Get (dynobj, csArrayItemNotFound);
+      if (idx != csArrayItemNotFound && objects[idx].cell == cell)
+	present.SetBit (idx);
+      else
+	toDelete.Push (dynobj);
+    }
+    view3d->GetApplication ()->RegisterRemoval (toDelete);
+    for (size_t i = 0 ; i < toDelete.GetSize () ; i++)
+      cell->DeleteObject (toDelete[i]);
   }
-  csArray<DynIdx> dynidx;
+
+  // Objects that were deleted, moved (the physics state of a moved object
+  // can't be restored from the transform alone), made static/dynamic or
+  // that had their mesh or light changed by their entity are recreated.
+  // For the others we only have to drop the entity that was created for
+  // playing and restore the entity settings if needed.
+  csBitArray recreated (objects.GetSize ());
   for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
     Obj& obj = objects[i];
-    iDynamicObject* dynobj = obj.cell->AddObject (obj.fact->GetName (), obj.trans);
-
-    if (!obj.templateName.IsEmpty () || obj.params)
-      dynobj->SetEntity (obj.entityName, obj.templateName, obj.params);
-    else if (!obj.entityName.IsEmpty ())
-      dynobj->SetEntityName (obj.entityName);
+    iDynamicObject* dynobj = present.IsBitSet (i) ? (iDynamicObject*)obj.dynobj : 0;
+    VisualState visual;
+    if (dynobj) visual.Fetch (dynobj);
+    if (dynobj && (dynobj->IsStatic () != obj.isStatic
+	  || !TransformEquals (dynobj->GetTransform (), obj.trans)
+	  || visual.Differs (obj.visual)))
+    {
+      csArray<iDynamicObject*> removed;
+      removed.Push (dynobj);
+      view3d->GetApplication ()->RegisterRemoval (removed);
+      obj.cell->DeleteObject (dynobj);
+      dynobj = 0;
+    }
+    if (!dynobj)
+    {
+      Recreate (obj);
+      recreated.SetBit (i);
+      continue;
+    }
 
-    if (obj.isStatic)
-      dynobj->MakeStatic ();
-    else
-      dynobj->MakeDynamic ();
-    if (obj.connectedObjects.GetSize () > 0)
+    iCelEntity* entity = dynobj->GetEntity ();
+    if (entity)
     {
-      DynIdx di;
-      di.dynobj = dynobj;
-      di.idx = i;
-      dynidx.Push (di);
+      dynobj->UnlinkEntity ();
+      pl->RemoveEntity (entity);
+    }
+    if (dynobj->GetEntityTemplate () != obj.tpl
+	|| dynobj->GetEntityParameters () != obj.params
+	|| obj.entityName != dynobj->GetEntityName ())
+    {
+      if (obj.tpl || obj.params)
+	dynobj->SetEntity (obj.entityName, obj.tpl ? obj.tpl->GetName () : (const char*)0,
+	    obj.params);
+      else
+	dynobj->SetEntityName (obj.entityName);
     }
   }
-  // Connect all joints.
-  for (size_t i = 0 ; i < dynidx.GetSize () ; i++)
+
+  // Restore the joints. Joints of recreated objects have to be made
+  // again. Kept objects can have been connected or disconnected while
+  // playing so their joints are compared with the snapshot.
+  for (size_t i = 0 ; i < objects.GetSize () ; i++)
   {
-    DynIdx& dy = dynidx[i];
-    for (size_t j = 0 ; j < objects[dy.idx].connectedObjects.GetSize () ; j++)
+    Obj& obj = objects[i];
+    for (size_t j = 0 ; j < obj.connectedObjects.GetSize () ; j++)
     {
-      size_t idx = objects[dy.idx].connectedObjects[j];
-      if (idx != csArrayItemNotFound)
+      size_t idx = obj.connectedObjects[j];
+      iDynamicObject* other = idx == csArrayItemNotFound ? 0
+	: (iDynamicObject*)objects[idx].dynobj;
+      if (recreated.IsBitSet (i))
       {
-        dy.dynobj->Connect (j, dy.dynobj->GetCell ()->GetObject (idx));
+	if (other) obj.dynobj->Connect (j, other);
       }
+      else if (obj.dynobj->GetConnectedObject (j) != other)
+	obj.dynobj->Connect (j, other);
     }
   }
 }
@@ -203,6 +316,9 @@ void PlayMode::Start ()
   if (foundPlayerDynobj)
   {
     dynworld->SetCurrentCell (foundCell);
+    csArray<iDynamicObject*> removed;
+    removed.Push (foundPlayerDynobj);
+    view3d->GetApplication ()->RegisterRemoval (removed);
     foundCell->DeleteObject (foundPlayerDynobj);
   }
   else
@@ -280,7 +396,7 @@ void PlayMode::Stop ()
   iPcDynamicWorld* dynworld = view3d->GetDynamicWorld ();
   dynworld->InhibitEntities (true);
   dynworld->EnableGameMode (false);
-  snapshot->Restore (dynworld);
+  snapshot->Restore (dynworld, pl);
   delete snapshot;
   snapshot = 0;
 
@@ -32,34 +32,55 @@ THE SOFTWARE.
 
 struct iPcDynamicWorld;
 struct iCelEntity;
+struct iCelEntityTemplate;
 
 /**
  * A snapshot of the current objects. This is used to remember the situation
- * before 'Play' is selected.
+ * before 'Play' is selected. Only a small record is kept for every object
+ * and on restore only the objects that were moved, changed, created or
+ * deleted while playing are recreated.
  */
 class DynworldSnapshot
 {
 private:
+  /**
+   * The state of the mesh or light of an object that an entity can
+   * change while playing.
+   */
+  struct VisualState
+  {
+    bool hasMesh, hasLight;
+    uint32 flags;
+    iMaterialWrapper* material;
+    csColor color;
+    bool hasColor;
+    VisualState () : hasMesh (false), hasLight (false) { }
+    void Fetch (iDynamicObject* dynobj);
+    bool Differs (const VisualState& other) const;
+  };
+
   struct Obj
   {
+    csWeakRef<iDynamicObject> dynobj;
     iDynamicCell* cell;
     iDynamicFactory* fact;
     bool isStatic;
     csReversibleTransform trans;
     csString entityName;
-    csString templateName;
+    iCelEntityTemplate* tpl;
     csRef<iCelParameterBlock> params;
-    // Indices of connected objects.
+    // Indices (in the snapshot) of connected objects.
     csArray<size_t> connectedObjects;
+    VisualState visual;
   };
   csArray<Obj> objects;
 
-  // Find the index of a given object in this cell.
-  size_t FindObjIndex (iDynamicCell* cell, iDynamicObject* dynobj);
+  // Recreate an object as it was in the snapshot.
+  iDynamicObject* Recreate (Obj& obj);
 
 public:
   DynworldSnapshot (iPcDynamicWorld* dynworld);
-  void Restore (iPcDynamicWorld* dynworld);
+  void Restore (iPcDynamicWorld* dynworld, iCelPlLayer* pl);
 };
 
 
@@ -86,6 +107,8 @@ public:
   virtual void FramePre ();
 
   virtual bool IsContextMenuAllowed () { return false; }
+  // The game keeps running even without input.
+  virtual bool IsAnimating () { return true; }
 
   virtual csRef<iString> GetStatusLine ()
   {
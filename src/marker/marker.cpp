@@ -165,6 +165,7 @@ GraphView::GraphView (MarkerManager* mgr) :
   linkForceFactor = 0.15;
 
   secondsTodo = 0.0f;
+  threadedLayout = false;
 
   draggingMarker = 0;
   activeMarker = 0;
@@ -285,94 +286,208 @@ static float CalculateIntersectingArea (
   return 1.0f;
 }
 
-void GraphView::HandlePushingForces ()
+// Cells smaller then this are not split anymore. Nodes at (nearly) the
+// same position are then kept together in one leaf.
+#define LAYOUT_MAXDEPTH 20
+// Barnes-Hut opening criterion. A cell is treated as a single mass if
+// its size divided by the distance to the node is smaller then this.
+#define LAYOUT_THETA 0.7f
+
+size_t GraphLayout::NewCell (const csBox2& box)
 {
-  int fw = mgr->GetG2D ()->GetWidth ();
-  int fh = mgr->GetG2D ()->GetHeight ();
-  // Handle all pushing forces.
-  csHash<GraphNode*,csString>::GlobalIterator it = nodes.GetIterator ();
-  while (it.HasNext ())
+  LayoutCell cell;
+  cell.box = box;
+  cell.nodeBox.StartBoundingBox ();
+  cell.center.Set (0, 0);
+  cell.weight = 0.0f;
+  cell.first = LAYOUT_NONE;
+  for (int i = 0 ; i < 4 ; i++) cell.children[i] = LAYOUT_NONE;
+  return cells.Push (cell);
+}
+
+void GraphLayout::InsertNode (size_t cell, size_t idx, int depth)
+{
+  // Don't keep references to cells here since NewCell() can move them.
+  if (cells[cell].children[0] == LAYOUT_NONE)
   {
-    csString key;
-    GraphNode* node = it.Next (key);
-    if (node->marker == draggingMarker || node->frozen) continue;
+    if (cells[cell].first == LAYOUT_NONE || depth >= LAYOUT_MAXDEPTH)
+    {
+      nextInCell[idx] = cells[cell].first;
+      cells[cell].first = idx;
+      return;
+    }
+    // Split this leaf and move the node that was in it to a child.
+    csBox2 box = cells[cell].box;
+    csVector2 c = box.GetCenter ();
+    for (int i = 0 ; i < 4 ; i++)
+    {
+      csBox2 childBox (
+	  (i & 1) ? c.x : box.MinX (), (i & 2) ? c.y : box.MinY (),
+	  (i & 1) ? box.MaxX () : c.x, (i & 2) ? box.MaxY () : c.y);
+      size_t child = NewCell (childBox);
+      cells[cell].children[i] = child;
+    }
+    size_t old = cells[cell].first;
+    cells[cell].first = LAYOUT_NONE;
+    InsertNode (cell, old, depth);
+  }
+  const csVector2& c = cells[cell].box.GetCenter ();
+  const csVector2& pos = nodes[idx].pos;
+  int i = (pos.x >= c.x ? 1 : 0) + (pos.y >= c.y ? 2 : 0);
+  InsertNode (cells[cell].children[i], idx, depth+1);
+}
 
-    const csVector2& pos = node->marker->GetPosition ();
-    const csVector2& size = node->size;
-    node->netForce.Set (0, 0);
+void GraphLayout::FinishCell (size_t cell)
+{
+  LayoutCell& lc = cells[cell];
+  if (lc.children[0] == LAYOUT_NONE)
+  {
+    for (size_t idx = lc.first ; idx != LAYOUT_NONE ; idx = nextInCell[idx])
+    {
+      const LayoutNode& node = nodes[idx];
+      lc.center += node.pos * node.weightFactor;
+      lc.weight += node.weightFactor;
+      lc.nodeBox.AddBoundingVertex (node.pos - node.size / 2);
+      lc.nodeBox.AddBoundingVertex (node.pos + node.size / 2);
+    }
+  }
+  else
+  {
+    for (int i = 0 ; i < 4 ; i++)
+    {
+      FinishCell (lc.children[i]);
+      const LayoutCell& child = cells[lc.children[i]];
+      lc.center += child.center * child.weight;
+      lc.weight += child.weight;
+      if (!child.nodeBox.Empty ())
+	lc.nodeBox += child.nodeBox;
+    }
+  }
+  if (lc.weight > 0.0f) lc.center /= lc.weight;
+}
 
-    // The border pushes too.
-    node->netForce += (pos - csVector2 (0, pos.y)) * nodeForceFactor / (pos.x * pos.x);
-    node->netForce += (pos - csVector2 (fw, pos.y)) * nodeForceFactor / ((fw-pos.x) * (fw-pos.x));
-    node->netForce += (pos - csVector2 (pos.x, 0)) * nodeForceFactor / (pos.y * pos.y);
-    node->netForce += (pos - csVector2 (pos.x, fh)) * nodeForceFactor / ((fh-pos.y) * (fh-pos.y));
+void GraphLayout::BuildTree ()
+{
+  cells.Empty ();
+  nextInCell.SetSize (nodes.GetSize ());
+  csBox2 box;
+  box.StartBoundingBox ();
+  for (size_t i = 0 ; i < nodes.GetSize () ; i++)
+    box.AddBoundingVertex (nodes[i].pos);
+  // Make the root square so that the cells don't degenerate.
+  float size = csMax (box.MaxX () - box.MinX (), box.MaxY () - box.MinY ()) + 1.0f;
+  box.Set (box.MinX (), box.MinY (), box.MinX () + size, box.MinY () + size);
+  NewCell (box);
+  for (size_t i = 0 ; i < nodes.GetSize () ; i++)
+    InsertNode (0, i, 0);
+  FinishCell (0);
+}
+
+static float CalculatePushFactor (const LayoutNode& node, const LayoutNode& node2)
+{
+  float factor = CalculateIntersectingArea (node.pos, node.size,
+      node2.pos, node2.size);
+  if (factor < .1f) factor = .1f;
+  return factor;
+}
+
+void GraphLayout::PushNode (size_t cell, size_t idx)
+{
+  const LayoutCell& lc = cells[cell];
+  if (lc.weight <= 0.0f && lc.first == LAYOUT_NONE) return;
+  LayoutNode& node = nodes[idx];
+  const csVector2& pos = node.pos;
 
-    csHash<GraphNode*,csString>::GlobalIterator it2 = nodes.GetIterator ();
-    while (it2.HasNext ())
+  if (lc.children[0] == LAYOUT_NONE)
+  {
+    for (size_t i = lc.first ; i != LAYOUT_NONE ; i = nextInCell[i])
     {
-      csString key2;
-      GraphNode* node2 = it2.Next (key2);
-      if (node->marker != node2->marker)
-      {
-	const csVector2& pos2 = node2->marker->GetPosition ();
-        const csVector2& size2 = node2->size;
-	float sqdist = SqDistance2d (pos, pos2);
-	if (sqdist < .0001) sqdist = .0001;
-        float factor = CalculateIntersectingArea (pos, size, pos2, size2);
-	if (factor < .1f) factor = .1f;
-	node->netForce += (pos-pos2) * node->externalInfluenceFactor *
-	    node2->weightFactor * (nodeForceFactor / sqdist) / factor;
-      }
+      if (i == idx) continue;
+      const LayoutNode& node2 = nodes[i];
+      float sqdist = SqDistance2d (pos, node2.pos);
+      if (sqdist < .0001) sqdist = .0001;
+      float factor = CalculatePushFactor (node, node2);
+      node.netForce += (pos-node2.pos) * node.externalInfluenceFactor *
+	node2.weightFactor * (nodeForceFactor / sqdist) / factor;
     }
+    return;
+  }
+
+  // If the cell is far enough and none of its nodes overlap with this
+  // node then all nodes in it can be treated as one.
+  float sqdist = SqDistance2d (pos, lc.center);
+  float cellSize = lc.box.MaxX () - lc.box.MinX ();
+  csBox2 box (pos.x - node.size.x / 2, pos.y - node.size.y / 2,
+      pos.x + node.size.x / 2, pos.y + node.size.y / 2);
+  if (cellSize * cellSize < LAYOUT_THETA * LAYOUT_THETA * sqdist
+      && !box.TestIntersect (lc.nodeBox))
+  {
+    node.netForce += (pos-lc.center) * node.externalInfluenceFactor *
+      lc.weight * (nodeForceFactor / sqdist);
+    return;
   }
+
+  for (int i = 0 ; i < 4 ; i++)
+    PushNode (lc.children[i], idx);
 }
 
-void GraphView::HandlePullingLinks ()
+void GraphLayout::HandlePushingForces ()
+{
+  BuildTree ();
+  int fw = width;
+  int fh = height;
+  for (size_t i = 0 ; i < nodes.GetSize () ; i++)
+  {
+    LayoutNode& node = nodes[i];
+    if (node.fixed) continue;
+
+    const csVector2& pos = node.pos;
+    node.netForce.Set (0, 0);
+
+    // The border pushes too.
+    node.netForce += (pos - csVector2 (0, pos.y)) * nodeForceFactor / (pos.x * pos.x);
+    node.netForce += (pos - csVector2 (fw, pos.y)) * nodeForceFactor / ((fw-pos.x) * (fw-pos.x));
+    node.netForce += (pos - csVector2 (pos.x, 0)) * nodeForceFactor / (pos.y * pos.y);
+    node.netForce += (pos - csVector2 (pos.x, fh)) * nodeForceFactor / ((fh-pos.y) * (fh-pos.y));
+
+    PushNode (0, i);
+  }
+}
+
+void GraphLayout::HandlePullingLinks ()
 {
-  // Handle all links.
   for (size_t i = 0 ; i < links.GetSize () ; i++)
   {
-    GraphLink& l = links[i];
-    GraphNode* node1 = nodes.Get (l.node1, 0);
-    GraphNode* node2 = nodes.Get (l.node2, 0);
-    if (node1 && node2 && node1->marker && node2->marker)
-    {
-      const csVector2& pos1 = node1->marker->GetPosition ();
-      const csVector2& pos2 = node2->marker->GetPosition ();
-      const csVector2& size1 = node1->size;
-      const csVector2& size2 = node2->size;
-      float factor = CalculateIntersectingArea (pos1, size1, pos2, size2);
-      csVector2 force = (pos2-pos1) * l.strength * linkForceFactor * factor;
-
-      node1->netForce += force;
-      node2->netForce -= force;
-    }
+    const LayoutLink& l = links[i];
+    LayoutNode& node1 = nodes[l.node1];
+    LayoutNode& node2 = nodes[l.node2];
+    float factor = CalculateIntersectingArea (node1.pos, node1.size,
+	node2.pos, node2.size);
+    csVector2 force = (node2.pos-node1.pos) * l.strength * linkForceFactor * factor;
+    node1.netForce += force;
+    node2.netForce -= force;
   }
 }
 
-bool GraphView::MoveNodes (float seconds)
+bool GraphLayout::MoveNodes (float seconds)
 {
-  int fw = mgr->GetG2D ()->GetWidth ();
-  int fh = mgr->GetG2D ()->GetHeight ();
+  int fw = width;
+  int fh = height;
   bool allCool = true;
-  csHash<GraphNode*,csString>::GlobalIterator it = nodes.GetIterator ();
-  while (it.HasNext ())
+  for (size_t i = 0 ; i < nodes.GetSize () ; i++)
   {
-    csString key;
-    GraphNode* node = it.Next (key);
-    if (node->marker == draggingMarker || node->frozen) continue;
+    LayoutNode& node = nodes[i];
+    if (node.fixed) continue;
 
-    node->velocity = (node->velocity + node->netForce) * 0.85f;
-    csVector2 pos = node->marker->GetPosition ();
+    node.velocity = (node.velocity + node.netForce) * 0.85f;
+    csVector2& pos = node.pos;
     csVector2 oldpos = pos;
-    pos += node->velocity * (seconds * 50.0f);
+    pos += node.velocity * (seconds * 50.0f);
 #   define NODE_MARGIN 10
-    if (pos.x > fw-node->size.x/2-NODE_MARGIN) pos.x = fw-node->size.x/2-NODE_MARGIN;
-    else if (pos.x < node->size.x/2+NODE_MARGIN) pos.x = node->size.x/2+NODE_MARGIN;
-    if (pos.y > fh-node->size.y/2-NODE_MARGIN) pos.y = fh-node->size.y/2-NODE_MARGIN;
-    else if (pos.y < node->size.y/2+NODE_MARGIN) pos.y = node->size.y/2+NODE_MARGIN;
-    node->marker->SetPosition (pos);
-    UpdateSubNodePositions (node);
+    if (pos.x > fw-node.size.x/2-NODE_MARGIN) pos.x = fw-node.size.x/2-NODE_MARGIN;
+    else if (pos.x < node.size.x/2+NODE_MARGIN) pos.x = node.size.x/2+NODE_MARGIN;
+    if (pos.y > fh-node.size.y/2-NODE_MARGIN) pos.y = fh-node.size.y/2-NODE_MARGIN;
+    else if (pos.y < node.size.y/2+NODE_MARGIN) pos.y = node.size.y/2+NODE_MARGIN;
     if (coolDownPeriod)
     {
       float d = SqDistance2d (pos, oldpos);
@@ -382,14 +497,8 @@ bool GraphView::MoveNodes (float seconds)
   return allCool;
 }
 
-void GraphView::UpdateFrame ()
+void GraphLayout::Run ()
 {
-  float seconds = mgr->GetVC ()->GetElapsedSeconds ();
-  secondsTodo += seconds;
-  // Protection to make sure we don't get an excessive elapsed time.
-  // This is needed because frame updating stops while we're in a context menu.
-  if (secondsTodo > .1) secondsTodo = .1;
-
   bool loop = true;
   int maxLoop = 20;
   while (loop)
@@ -410,6 +519,129 @@ void GraphView::UpdateFrame ()
   }
 }
 
+void GraphLayoutJob::Run ()
+{
+  layout.Run ();
+  CS::Threading::AtomicOperations::Set (&done, 1);
+}
+
+//--------------------------------------------------------------------------------
+
+void GraphView::FillLayout (GraphLayout& layout)
+{
+  layout.nodes.Empty ();
+  layout.links.Empty ();
+  layout.nodeForceFactor = nodeForceFactor;
+  layout.linkForceFactor = linkForceFactor;
+  layout.width = mgr->GetG2D ()->GetWidth ();
+  layout.height = mgr->GetG2D ()->GetHeight ();
+  layout.coolDownPeriod = coolDownPeriod;
+  layout.secondsTodo = secondsTodo;
+
+  csHash<size_t,csString> indices;
+  csHash<GraphNode*,csString>::GlobalIterator it = nodes.GetIterator ();
+  while (it.HasNext ())
+  {
+    csString key;
+    GraphNode* node = it.Next (key);
+    if (!node->marker) continue;
+    LayoutNode ln;
+    ln.node = node;
+    ln.pos = node->marker->GetPosition ();
+    ln.size = node->size;
+    ln.velocity = node->velocity;
+    ln.netForce.Set (0, 0);
+    ln.weightFactor = node->weightFactor;
+    ln.externalInfluenceFactor = node->externalInfluenceFactor;
+    ln.fixed = node->marker == draggingMarker || node->frozen;
+    indices.Put (key, layout.nodes.Push (ln));
+  }
+
+  for (size_t i = 0 ; i < links.GetSize () ; i++)
+  {
+    GraphLink& l = links[i];
+    size_t idx1 = indices.Get (l.node1, LAYOUT_NONE);
+    size_t idx2 = indices.Get (l.node2, LAYOUT_NONE);
+    if (idx1 == LAYOUT_NONE || idx2 == LAYOUT_NONE) continue;
+    LayoutLink ll;
+    ll.node1 = idx1;
+    ll.node2 = idx2;
+    ll.strength = l.strength;
+    layout.links.Push (ll);
+  }
+}
+
+void GraphView::ApplyLayout (const GraphLayout& layout)
+{
+  for (size_t i = 0 ; i < layout.nodes.GetSize () ; i++)
+  {
+    const LayoutNode& ln = layout.nodes[i];
+    if (ln.fixed) continue;
+    GraphNode* node = ln.node;
+    // The node could have been frozen or grabbed while a job was running.
+    if (node->marker == draggingMarker || node->frozen) continue;
+    node->velocity = ln.velocity;
+    node->marker->SetPosition (ln.pos);
+    UpdateSubNodePositions (node);
+  }
+  coolDownPeriod = layout.coolDownPeriod;
+  secondsTodo = layout.secondsTodo;
+}
+
+void GraphView::CancelLayout ()
+{
+  if (!layoutJob) return;
+  mgr->GetJobQueue ()->PullAndRun (layoutJob);
+  layoutJob = 0;
+}
+
+void GraphView::SetThreadedLayout (bool t)
+{
+  if (!t) CancelLayout ();
+  threadedLayout = t;
+}
+
+bool GraphView::IsLayoutRunning () const
+{
+  if (!visible) return false;
+  if (layoutJob || coolDownPeriod) return true;
+  csHash<GraphNode*,csString>::ConstGlobalIterator it = nodes.GetIterator ();
+  while (it.HasNext ())
+  {
+    GraphNode* node = it.Next ();
+    if (node->frozen || node->marker == draggingMarker) continue;
+    if (node->velocity.SquaredNorm () > .0001f) return true;
+  }
+  return false;
+}
+
+void GraphView::UpdateFrame ()
+{
+  float seconds = mgr->GetVC ()->GetElapsedSeconds ();
+  secondsTodo += seconds;
+  // Protection to make sure we don't get an excessive elapsed time.
+  // This is needed because frame updating stops while we're in a context menu.
+  if (secondsTodo > .1) secondsTodo = .1;
+
+  if (threadedLayout)
+  {
+    if (layoutJob)
+    {
+      if (!layoutJob->IsDone ()) return;
+      ApplyLayout (layoutJob->layout);
+      layoutJob = 0;
+    }
+    layoutJob.AttachNew (new GraphLayoutJob ());
+    FillLayout (layoutJob->layout);
+    mgr->GetJobQueue ()->Enqueue (layoutJob);
+    return;
+  }
+
+  FillLayout (mainLayout);
+  mainLayout.Run ();
+  ApplyLayout (mainLayout);
+}
+
 bool GraphView::GetNodeLinkPosition (const char* nodeName, csVector2& pos,
     bool& secondary, csVector2& spos)
 {
@@ -716,6 +948,7 @@ void GraphView::SetVisible (bool v)
 
 void GraphView::Clear ()
 {
+  CancelLayout ();
   csHash<GraphNode*,csString>::GlobalIterator it = nodes.GetIterator ();
   while (it.HasNext ())
   {
@@ -979,6 +1212,7 @@ void GraphView::CreateNode (const char* name, const char* label,
 
 void GraphView::RemoveNode (const char* name)
 {
+  CancelLayout ();
   GraphNode* node = nodes.Get (name, 0);
   if (node && node->marker)
   {
@@ -1084,7 +1318,6 @@ void GraphView::ReplaceNode (const char* oldNode, const char* newNode,
   GraphNode* nodeNew = nodes.Get (newNode, 0);
   if (!nodeNew) return;	// @@@ Error?
   nodeNew->velocity = nodeOld->velocity;
-  nodeNew->netForce = nodeOld->netForce;
   if (nodeOld->marker)
     nodeNew->marker->SetPosition (nodeOld->marker->GetPosition ());
   if (nodeOld->marker == activeMarker)
@@ -1257,8 +1490,44 @@ float InvBoxMarkerHitArea::CheckHit (int x, int y,
   return -1.0f;
 }
 
+bool InvBoxMarkerHitArea::GetScreenBox (const csOrthoTransform& camtrans,
+    const csReversibleTransform& meshtrans, MarkerManager* mgr,
+    const csVector2& pos, csBox2& sbox)
+{
+  csVector3 c1 = TransPointCam (camtrans, meshtrans, space, box.Min ());
+  csVector3 c2 = TransPointCam (camtrans, meshtrans, space, box.Max ());
+  if (space != MARKER_2D && (c1.z <= .5 || c2.z <= .5)) return false;
+  csVector2 s1, s2;
+  if (space != MARKER_2D)
+  {
+    s1 = mgr->view->Project (c1) + pos;
+    s2 = mgr->view->Project (c2) + pos;
+  }
+  else
+  {
+    s1.Set (pos.x + c1.x, pos.y + c1.y);
+    s2.Set (pos.x + c2.x, pos.y + c2.y);
+  }
+  sbox.StartBoundingBox (s1);
+  sbox.AddBoundingVertex (s2);
+  return true;
+}
+
+void InvBoxMarkerHitArea::SetCenter (const csVector3& center)
+{
+  box.SetCenter (center);
+  InvBoxMarkerHitArea::center = center;
+  marker->InvalidateHitAreas ();
+}
+
 //--------------------------------------------------------------------------
 
+void CircleMarkerHitArea::SetCenter (const csVector3& center)
+{
+  CircleMarkerHitArea::center = center;
+  marker->InvalidateHitAreas ();
+}
+
 csVector2 CircleMarkerHitArea::GetPerspectiveRadius (iView* view, float z) const
 {
   iCamera* camera = view->GetCamera ();
@@ -1325,8 +1594,46 @@ float CircleMarkerHitArea::CheckHit (int x, int y,
   return -1.0f;
 }
 
+bool CircleMarkerHitArea::GetScreenBox (const csOrthoTransform& camtrans,
+    const csReversibleTransform& meshtrans, MarkerManager* mgr,
+    const csVector2& pos, csBox2& box)
+{
+  csVector3 c = TransPointCam (camtrans, meshtrans, space, center);
+  if (space != MARKER_2D && c.z <= .5) return false;
+  csVector2 s;
+  csVector2 r;
+  if (space != MARKER_2D)
+  {
+    s = mgr->view->Project (c) + pos;
+    r = GetPerspectiveRadius (mgr->view, c.z);
+  }
+  else
+  {
+    s.Set (pos.x + c.x, pos.y + c.y);
+    r.Set (radius, radius);
+  }
+  // CheckHit() uses the average of both radii so this is conservative.
+  float rad = csMax (fabs (r.x), fabs (r.y));
+  box.Set (s.x - rad, s.y - rad, s.x + rad, s.y + rad);
+  return true;
+}
+
 //------------------------------------------------------------------------------
 
+void MarkerLines::BuildCache ()
+{
+  cache.Empty ();
+  for (size_t i = SELECTION_NONE ; i <= SELECTION_SELECTED ; i++)
+  {
+    csPen3D* pen3d = color->GetPen3D (i);
+    csPenCache* c = new csPenCache ();
+    cache.Push (c);
+    pen3d->SetActiveCache (c);
+    pen3d->DrawLines (pairs);
+    pen3d->SetActiveCache (0);
+  }
+}
+
 void MarkerLines::Render3D (const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos, int selectionLevel)
@@ -1527,18 +1834,37 @@ void Marker::Lines (MarkerSpace space,
   MarkerLines* lines = new MarkerLines ();
   lines->space = space;
   lines->color = static_cast<MarkerColor*> (color);
-  for (size_t i = SELECTION_NONE ; i <= SELECTION_SELECTED ; i++)
-  {
-    csPen3D* pen3d = lines->color->GetPen3D (i);
-    csPenCache* cache = new csPenCache ();
-    lines->cache.Push (cache);
-    pen3d->SetActiveCache (cache);
-    pen3d->DrawLines (pairs);
-    pen3d->SetActiveCache (0);
-  }
+  lines->pairs = pairs;
+  lines->BuildCache ();
   primitives.Push (lines);
 }
 
+bool Marker::UpdateLines (size_t idx,
+      const csArray<csPen3DCoordinatePair>& pairs)
+{
+  if (idx >= primitives.GetSize ()) return false;
+  MarkerLines* lines = primitives[idx]->GetLines ();
+  if (!lines) return false;
+  if (lines->pairs.GetSize () == pairs.GetSize () && (pairs.GetSize () == 0
+	|| memcmp (lines->pairs.GetArray (), pairs.GetArray (),
+	  pairs.GetSize () * sizeof (csPen3DCoordinatePair)) == 0))
+    return true;
+  lines->pairs = pairs;
+  lines->BuildCache ();
+  return true;
+}
+
+bool Marker::UpdateLine (size_t idx, const csVector3& v1,
+      const csVector3& v2)
+{
+  if (idx >= primitives.GetSize ()) return false;
+  MarkerLine* line = primitives[idx]->GetLine ();
+  if (!line) return false;
+  line->vec1 = v1;
+  line->vec2 = v2;
+  return true;
+}
+
 void Marker::Line (MarkerSpace space,
       const csVector3& v1, const csVector3& v2, iMarkerColor* color,
       bool arrow)
@@ -1595,6 +1921,7 @@ iMarkerHitArea* Marker::HitArea (MarkerSpace space, const csVector3& center,
   hitArea->SetData (data);
   hitArea->SetColor (static_cast<MarkerColor*> (color));
   hitAreas.Push (hitArea);
+  InvalidateHitAreas ();
   return hitArea;
 }
 
@@ -1607,33 +1934,19 @@ iMarkerHitArea* Marker::HitArea (MarkerSpace space, const csBox3& box,
   hitArea->SetBox (box);
   hitArea->SetData (data);
   hitAreas.Push (hitArea);
+  InvalidateHitAreas ();
   return hitArea;
 }
 
 void Marker::ClearHitAreas ()
 {
   hitAreas.Empty ();
+  InvalidateHitAreas ();
 }
 
-float Marker::CheckHitAreas (int x, int y, iMarkerHitArea*& bestHitArea)
+void Marker::InvalidateHitAreas ()
 {
-  const csOrthoTransform& camtrans = mgr->camera->GetTransform ();
-  const csReversibleTransform& meshtrans = GetTransform ();
-  bestHitArea = 0;
-  float bestRadius = 10000000.0f;
-  for (size_t i = 0 ; i < hitAreas.GetSize () ; i++)
-  {
-    InternalMarkerHitArea* hitArea = static_cast<InternalMarkerHitArea*> (
-	hitAreas[i]);
-    float r = hitArea->CheckHit (x, y, camtrans, meshtrans, mgr, pos);
-    if (r < bestRadius && r >= 0.0f)
-    {
-      bestRadius = r;
-      bestHitArea = hitArea;
-    }
-  }
-  if (bestHitArea) return bestRadius;
-  else return -1.0f;
+  mgr->InvalidateHitGrid ();
 }
 
 //---------------------------------------------------------------------------------------
@@ -1647,6 +1960,10 @@ MarkerManager::MarkerManager (iBase *iParent)
   camera = 0;
   currentDraggingHitArea = 0;
   currentDraggingMode = 0;
+  hitGridDirty = true;
+  hitGridCameraNumber = -1;
+  hitGridViewWidth = hitGridViewHeight = 0;
+  hitGridWidth = hitGridHeight = 0;
 }
 
 MarkerManager::~MarkerManager ()
@@ -1670,6 +1987,14 @@ bool MarkerManager::Initialize (iObjectRegistry *object_reg)
   return true;
 }
 
+iJobQueue* MarkerManager::GetJobQueue ()
+{
+  if (!jobQueue)
+    jobQueue.AttachNew (new CS::Threading::ThreadedJobQueue (1,
+	CS::Threading::THREAD_PRIO_NORMAL, "graphlayout"));
+  return jobQueue;
+}
+
 void MarkerManager::SetView (iView* view)
 {
   MarkerManager::view = view;
@@ -1873,6 +2198,14 @@ void MarkerManager::Frame2D ()
     markers[i]->Render2D ();
 }
 
+bool MarkerManager::IsAnimating () const
+{
+  for (size_t i = 0 ; i < graphViews.GetSize () ; i++)
+    if (graphViews[i]->IsLayoutRunning ())
+      return true;
+  return false;
+}
+
 void MarkerManager::Frame3D ()
 {
   for (size_t i = 0 ; i < graphViews.GetSize () ; i++)
@@ -1948,41 +2281,124 @@ bool MarkerManager::OnMouseMove (iEvent& ev, int mouseX, int mouseY)
   return false;
 }
 
-iMarkerHitArea* MarkerManager::FindHitArea (int x, int y)
+#define HITGRID_CELLSIZE 32
+
+bool MarkerManager::IsHitGridValid () const
 {
-  iMarkerHitArea* bestHitArea = 0;
-  float bestRadius = 10000000.0f;
+  if (hitGridDirty) return false;
+  if (camera->GetCameraNumber () != hitGridCameraNumber) return false;
+  if (g2d->GetWidth () != hitGridViewWidth) return false;
+  if (g2d->GetHeight () != hitGridViewHeight) return false;
+  // Meshes can move without the marker knowing about it.
+  for (size_t i = 0 ; i < hitGridMeshes.GetSize () ; i++)
+  {
+    const HitGridMesh& hm = hitGridMeshes[i];
+    iMeshWrapper* mesh = hm.marker->GetAttachedMesh ();
+    if (!mesh || mesh->GetMovable ()->GetUpdateNumber () != hm.updateNumber)
+      return false;
+  }
+  return true;
+}
+
+void MarkerManager::UpdateHitGrid ()
+{
+  hitGridDirty = false;
+  hitGridCameraNumber = camera->GetCameraNumber ();
+  hitGridViewWidth = g2d->GetWidth ();
+  hitGridViewHeight = g2d->GetHeight ();
+  hitGridWidth = (hitGridViewWidth + HITGRID_CELLSIZE - 1) / HITGRID_CELLSIZE;
+  hitGridHeight = (hitGridViewHeight + HITGRID_CELLSIZE - 1) / HITGRID_CELLSIZE;
+  hitGridCells.SetSize (hitGridWidth * hitGridHeight);
+  for (size_t i = 0 ; i < hitGridCells.GetSize () ; i++)
+    hitGridCells[i].Truncate (0);
+  hitGridEntries.Truncate (0);
+  hitGridMeshes.Truncate (0);
+
+  const csOrthoTransform& camtrans = camera->GetTransform ();
   for (size_t i = 0 ; i < markers.GetSize () ; i++)
-    if (markers[i]->IsVisible ())
+  {
+    Marker* marker = markers[i];
+    if (!marker->IsVisible ()) continue;
+    iMeshWrapper* mesh = marker->GetAttachedMesh ();
+    if (mesh)
     {
-      iMarkerHitArea* hitArea;
-      float d = markers[i]->CheckHitAreas (x, y, hitArea);
-      if (d >= 0.0f && d < bestRadius)
-      {
-        bestRadius = d;
-        bestHitArea = hitArea;
-      }
+      HitGridMesh hm;
+      hm.marker = marker;
+      hm.updateNumber = mesh->GetMovable ()->GetUpdateNumber ();
+      hitGridMeshes.Push (hm);
     }
-  return bestHitArea;
+    const csReversibleTransform& meshtrans = marker->GetTransform ();
+    const csVector2& pos = marker->GetPosition ();
+    for (size_t j = 0 ; j < marker->GetHitAreaCount () ; j++)
+    {
+      InternalMarkerHitArea* hitArea = static_cast<InternalMarkerHitArea*> (
+	  marker->GetHitArea (j));
+      csBox2 box;
+      if (!hitArea->GetScreenBox (camtrans, meshtrans, this, pos, box))
+	continue;
+      int minx = csMax (0, int (floor (box.MinX ())) / HITGRID_CELLSIZE);
+      int miny = csMax (0, int (floor (box.MinY ())) / HITGRID_CELLSIZE);
+      int maxx = csMin (hitGridWidth-1, int (ceil (box.MaxX ())) / HITGRID_CELLSIZE);
+      int maxy = csMin (hitGridHeight-1, int (ceil (box.MaxY ())) / HITGRID_CELLSIZE);
+      if (minx > maxx || miny > maxy) continue;
+      HitGridEntry entry;
+      entry.marker = marker;
+      entry.hitArea = hitArea;
+      size_t idx = hitGridEntries.Push (entry);
+      for (int y = miny ; y <= maxy ; y++)
+	for (int x = minx ; x <= maxx ; x++)
+	  hitGridCells[y * hitGridWidth + x].Push (idx);
+    }
+  }
 }
 
-iMarker* MarkerManager::FindHitMarker (int x, int y, int& data)
+float MarkerManager::FindBestHit (int x, int y, Marker*& bestMarker,
+    InternalMarkerHitArea*& bestHitArea)
 {
-  iMarker* bestMarker = 0;
+  bestMarker = 0;
+  bestHitArea = 0;
+  if (!IsHitGridValid ()) UpdateHitGrid ();
+  if (x < 0 || y < 0) return -1.0f;
+  int cx = x / HITGRID_CELLSIZE;
+  int cy = y / HITGRID_CELLSIZE;
+  if (cx >= hitGridWidth || cy >= hitGridHeight) return -1.0f;
+
+  // The entries in a cell are in marker order so ties are resolved
+  // in the same way as when testing all markers.
+  const csOrthoTransform& camtrans = camera->GetTransform ();
+  const csArray<size_t>& cell = hitGridCells[cy * hitGridWidth + cx];
   float bestRadius = 10000000.0f;
-  for (size_t i = 0 ; i < markers.GetSize () ; i++)
-    if (markers[i]->IsVisible ())
+  for (size_t i = 0 ; i < cell.GetSize () ; i++)
+  {
+    const HitGridEntry& entry = hitGridEntries[cell[i]];
+    float d = entry.hitArea->CheckHit (x, y, camtrans,
+	entry.marker->GetTransform (), this, entry.marker->GetPosition ());
+    if (d >= 0.0f && d < bestRadius)
     {
-      iMarkerHitArea* hitArea;
-      float d = markers[i]->CheckHitAreas (x, y, hitArea);
-      if (d >= 0.0f && d < bestRadius)
-      {
-        bestRadius = d;
-        bestMarker = markers[i];
-        data = hitArea->GetData ();
-      }
+      bestRadius = d;
+      bestMarker = entry.marker;
+      bestHitArea = entry.hitArea;
     }
-  return bestMarker;
+  }
+  if (bestHitArea) return bestRadius;
+  else return -1.0f;
+}
+
+iMarkerHitArea* MarkerManager::FindHitArea (int x, int y)
+{
+  Marker* marker;
+  InternalMarkerHitArea* hitArea;
+  FindBestHit (x, y, marker, hitArea);
+  return hitArea;
+}
+
+iMarker* MarkerManager::FindHitMarker (int x, int y, int& data)
+{
+  Marker* marker;
+  InternalMarkerHitArea* hitArea;
+  if (FindBestHit (x, y, marker, hitArea) < 0.0f) return 0;
+  data = hitArea->GetData ();
+  return marker;
 }
 
 void MarkerManager::SetSelectionLevel (int level)
@@ -31,10 +31,13 @@ THE SOFTWARE.
 #include "csutil/randomgen.h"
 #include "csutil/hash.h"
 #include "csutil/stringarray.h"
+#include "csutil/threadjobqueue.h"
+#include "csutil/threading/atomicops.h"
 #include "iengine/engine.h"
 #include "iutil/virtclk.h"
 #include "iutil/comp.h"
 #include "ivaria/view.h"
+#include "cstool/pen.h"
 
 #include "include/imarker.h"
 
@@ -88,8 +91,13 @@ public:
   }
 };
 
+struct MarkerLine;
+struct MarkerLines;
+
 struct MarkerPrimitive
 {
+  virtual MarkerLine* GetLine () { return 0; }
+  virtual MarkerLines* GetLines () { return 0; }
   virtual void Render2D (const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos, int selectionLevel) { }
@@ -106,6 +114,7 @@ struct MarkerLine : public MarkerPrimitive
   bool arrow;
 
   virtual ~MarkerLine () { }
+  virtual MarkerLine* GetLine () { return this; }
   virtual void Render3D (const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos, int selectionLevel);
@@ -116,8 +125,14 @@ struct MarkerLines : public MarkerPrimitive
   MarkerSpace space;
   csPDelArray<csPenCache> cache;
   MarkerColor* color;
+  // The lines from which the cache was built.
+  csArray<csPen3DCoordinatePair> pairs;
 
   virtual ~MarkerLines () { }
+  virtual MarkerLines* GetLines () { return this; }
+
+  /// Rebuild the pen caches for all selection levels.
+  void BuildCache ();
   virtual void Render3D (const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos, int selectionLevel);
@@ -180,6 +195,13 @@ public:
   virtual float CheckHit (int x, int y, const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos) = 0;
+  /**
+   * Calculate the screen space box in which CheckHit() can succeed.
+   * Returns false if the hit area is not visible.
+   */
+  virtual bool GetScreenBox (const csOrthoTransform& camtrans,
+      const csReversibleTransform& meshtrans, MarkerManager* mgr,
+      const csVector2& pos, csBox2& box) = 0;
 
   virtual void DefineDrag (uint button, uint32 modifiers,
       MarkerSpace constrainSpace, uint32 constrainPlane,
@@ -194,7 +216,7 @@ public:
   void SetSpace (MarkerSpace space) { InternalMarkerHitArea::space = space; }
   virtual MarkerSpace GetSpace () const { return space; }
 
-  void SetData (int data) { InternalMarkerHitArea::data = data; }
+  virtual void SetData (int data) { InternalMarkerHitArea::data = data; }
   virtual int GetData () const { return data; }
 };
 
@@ -214,6 +236,7 @@ public:
     center = box.GetCenter ();
   }
   virtual const csVector3& GetCenter () const { return center; }
+  virtual void SetCenter (const csVector3& center);
 
   // For InternalMarkerHitArea
   virtual void Render3D (const csOrthoTransform& camtrans,
@@ -222,6 +245,9 @@ public:
   virtual float CheckHit (int x, int y, const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos);
+  virtual bool GetScreenBox (const csOrthoTransform& camtrans,
+      const csReversibleTransform& meshtrans, MarkerManager* mgr,
+      const csVector2& pos, csBox2& box);
   virtual bool HitAreaHiLightsMarker () const { return true; }
 };
 
@@ -239,7 +265,7 @@ public:
   void SetColor (MarkerColor* color) { CircleMarkerHitArea::color = color; }
   MarkerColor* GetColor () const { return color; }
 
-  void SetCenter (const csVector3& center) { CircleMarkerHitArea::center = center; }
+  virtual void SetCenter (const csVector3& center);
   virtual const csVector3& GetCenter () const { return center; }
 
   void SetRadius (float radius) { CircleMarkerHitArea::radius = radius; }
@@ -253,6 +279,9 @@ public:
   virtual float CheckHit (int x, int y, const csOrthoTransform& camtrans,
       const csReversibleTransform& meshtrans, MarkerManager* mgr,
       const csVector2& pos);
+  virtual bool GetScreenBox (const csOrthoTransform& camtrans,
+      const csReversibleTransform& meshtrans, MarkerManager* mgr,
+      const csVector2& pos, csBox2& box);
   virtual bool HitAreaHiLightsMarker () const { return false; }
 };
 
@@ -279,21 +308,30 @@ public:
 
   MarkerManager* GetMarkerManager () const { return mgr; }
 
-  virtual void SetVisible (bool v) { visible = v; }
+  /// The hit areas of this marker moved on screen.
+  void InvalidateHitAreas ();
+
+  virtual void SetVisible (bool v) { visible = v; InvalidateHitAreas (); }
   virtual bool IsVisible () const { return visible; }
 
   virtual void SetSelectionLevel (int level) { selectionLevel = level; }
   virtual int GetSelectionLevel () const { return selectionLevel; }
-  virtual void AttachMesh (iMeshWrapper* mesh) { attachedMesh = mesh; }
+  virtual void AttachMesh (iMeshWrapper* mesh)
+  {
+    attachedMesh = mesh;
+    InvalidateHitAreas ();
+  }
   virtual iMeshWrapper* GetAttachedMesh () const { return attachedMesh; }
   virtual void SetTransform (const csReversibleTransform& trans)
   {
     Marker::trans = trans;
+    InvalidateHitAreas ();
   }
   virtual const csReversibleTransform& GetTransform () const;
   virtual void SetPosition (const csVector2& pos)
   {
     Marker::pos = pos;
+    InvalidateHitAreas ();
   }
   virtual const csVector2& GetPosition () const { return pos; }
   virtual void Line (MarkerSpace space,
@@ -311,20 +349,24 @@ public:
       const csStringArray& text, iMarkerColor* color, bool centered = false,
       iFont* font = 0);
   virtual void Clear ();
+  virtual size_t GetPrimitiveCount () const { return primitives.GetSize (); }
+  virtual bool UpdateLine (size_t idx, const csVector3& v1,
+      const csVector3& v2);
+  virtual bool UpdateLines (size_t idx,
+      const csArray<csPen3DCoordinatePair>& lines);
   virtual iMarkerHitArea* HitArea (MarkerSpace space, const csVector3& center,
       float radius, int data, iMarkerColor* color);
   virtual iMarkerHitArea* HitArea (MarkerSpace space, const csBox3& box,
       int data);
   virtual void ClearHitAreas ();
+  virtual size_t GetHitAreaCount () const { return hitAreas.GetSize (); }
+  virtual iMarkerHitArea* GetHitArea (size_t idx) const
+  {
+    return idx < hitAreas.GetSize () ? hitAreas[idx] : 0;
+  }
 
   void Render2D ();
   void Render3D ();
-
-  /**
-   * Check if a hit area was hit and return the distance.
-   * Returns negative number if there was no hit.
-   */
-  float CheckHitAreas (int x, int y, iMarkerHitArea*& bestHitArea);
 };
 
 struct SubNode
@@ -342,7 +384,7 @@ struct GraphNode
 {
   csString name;
   iMarker* marker;
-  csVector2 velocity, netForce;
+  csVector2 velocity;
   bool frozen;
   csVector2 size;
   float weightFactor;
@@ -368,6 +410,107 @@ struct GraphLink
     strength (1.0f), maybeDelete (false) { }
 };
 
+/**
+ * A node in the flat array on which the layout of a graph view is
+ * simulated. This is a copy of the data of a GraphNode so that the
+ * simulation can run without touching the markers (and so on another
+ * thread).
+ */
+struct LayoutNode
+{
+  GraphNode* node;
+  csVector2 pos, size;
+  csVector2 velocity, netForce;
+  float weightFactor;
+  float externalInfluenceFactor;
+  // Frozen or dragged nodes push other nodes but don't move.
+  bool fixed;
+};
+
+struct LayoutLink
+{
+  size_t node1, node2;
+  float strength;
+};
+
+#define LAYOUT_NONE ((size_t)~0)
+
+/**
+ * A cell of the quadtree that is used for the Barnes-Hut approximation
+ * of the pushing forces between the nodes.
+ */
+struct LayoutCell
+{
+  csBox2 box;		// Area covered by this cell.
+  csBox2 nodeBox;	// Bounding box of the nodes (with their size) in this cell.
+  csVector2 center;	// Weighted center of the nodes in this cell.
+  float weight;		// Sum of the weight factors of the nodes.
+  size_t first;		// First node of a leaf (LAYOUT_NONE otherwise).
+  size_t children[4];	// Child cells (LAYOUT_NONE for a leaf).
+};
+
+/**
+ * The force based layout simulation of a graph view.
+ */
+class GraphLayout
+{
+private:
+  csArray<LayoutCell> cells;
+  // Next node in the same leaf cell (LAYOUT_NONE for the last one).
+  csArray<size_t> nextInCell;
+
+  size_t NewCell (const csBox2& box);
+  void InsertNode (size_t cell, size_t idx, int depth);
+  void FinishCell (size_t cell);
+  void BuildTree ();
+  void PushNode (size_t cell, size_t idx);
+
+  void HandlePushingForces ();
+  void HandlePullingLinks ();
+
+  /**
+   * Update the velocities of all nodes and move them according to those
+   * velocities. Returns true if the simulation appears cool enough (not
+   * a lot of movement).
+   */
+  bool MoveNodes (float seconds);
+
+public:
+  csArray<LayoutNode> nodes;
+  csArray<LayoutLink> links;
+  float nodeForceFactor;
+  float linkForceFactor;
+  int width, height;
+  bool coolDownPeriod;
+  float secondsTodo;
+
+  /**
+   * Run the simulation for 'secondsTodo'. During the cool down period
+   * this continues until the nodes stop moving.
+   */
+  void Run ();
+};
+
+/**
+ * A job to run the layout of a graph view on a worker thread.
+ */
+class GraphLayoutJob : public scfImplementation1<GraphLayoutJob, iJob>
+{
+private:
+  int32 done;
+
+public:
+  GraphLayout layout;
+
+  GraphLayoutJob () : scfImplementationType (this), done (0) { }
+  virtual ~GraphLayoutJob () { }
+
+  virtual void Run ();
+
+  /// Return true if Run() has finished.
+  bool IsDone () { return CS::Threading::AtomicOperations::Read (&done) != 0; }
+};
+
 class GraphView : public scfImplementation1<GraphView, iGraphView>
 {
 private:
@@ -397,18 +540,17 @@ private:
 
   csString currentNode;	// String as returned to the caller in FindHitNode().
 
-  /**
-   * Handle forces.
-   */
-  void HandlePushingForces ();
-  void HandlePullingLinks ();
+  // Layout that is used when the layout is not threaded.
+  GraphLayout mainLayout;
+  bool threadedLayout;
+  csRef<GraphLayoutJob> layoutJob;
 
-  /**
-   * Update the velocities of all nodes and move them according to those
-   * velocities. Returns true if the simulation appears cool enough (not
-   * a lot of movement).
-   */
-  bool MoveNodes (float seconds);
+  /// Copy the nodes and links to the flat arrays of a layout.
+  void FillLayout (GraphLayout& layout);
+  /// Move the nodes to the positions calculated by a layout.
+  void ApplyLayout (const GraphLayout& layout);
+  /// Wait for a running layout job and throw away its result.
+  void CancelLayout ();
 
   /// Update the positions of subnodes of a given node.
   void UpdateSubNodePositions (GraphNode* node);
@@ -517,6 +659,9 @@ public:
   virtual void SetLinkForceFactor (float f) { linkForceFactor = f; }
   virtual float GetLinkForceFactor () const { return linkForceFactor; }
   virtual void AddNodeActivationCallback (iGraphNodeCallback* cb);
+  virtual void SetThreadedLayout (bool t);
+  virtual bool IsThreadedLayout () const { return threadedLayout; }
+  virtual bool IsLayoutRunning () const;
 };
 
 class MarkerManager : public scfImplementation2<MarkerManager, iMarkerManager, iComponent>
@@ -536,6 +681,7 @@ public:
   csRefArray<Marker> markers;
   csRefArray<MarkerColor> markerColors;
   csRefArray<GraphView> graphViews;
+  csRef<iJobQueue> jobQueue;
 
   iMarkerHitArea* currentDraggingHitArea;
   MarkerDraggingMode* currentDraggingMode;
@@ -543,6 +689,41 @@ public:
   csVector3 dragRestrict;
   csVector2 dragOffset;
 
+  /**
+   * Screen space grid with the projected hit areas of all visible
+   * markers. Every cell contains the indices in 'hitGridEntries' of the
+   * hit areas that overlap it. The grid is rebuilt lazily when a query
+   * is done after the camera, the view or a marker changed.
+   */
+  struct HitGridEntry
+  {
+    Marker* marker;
+    InternalMarkerHitArea* hitArea;
+  };
+  struct HitGridMesh
+  {
+    Marker* marker;
+    long updateNumber;
+  };
+  bool hitGridDirty;
+  long hitGridCameraNumber;
+  int hitGridViewWidth, hitGridViewHeight;
+  int hitGridWidth, hitGridHeight;
+  csArray<HitGridEntry> hitGridEntries;
+  csArray<csArray<size_t> > hitGridCells;
+  // Markers that follow a mesh and the movable update number of that mesh.
+  csArray<HitGridMesh> hitGridMeshes;
+
+  bool IsHitGridValid () const;
+  void UpdateHitGrid ();
+
+  /**
+   * Find the closest hit area at a screen position. Returns the distance
+   * or a negative number if nothing was hit.
+   */
+  float FindBestHit (int x, int y, Marker*& bestMarker,
+      InternalMarkerHitArea*& bestHitArea);
+
   void StopDrag ();
   void HandleDrag ();
   iMarker* GetDraggingMarker ();
@@ -576,9 +757,12 @@ public:
   iGraphics3D* GetG3D () const { return g3d; }
   iGraphics2D* GetG2D () const { return g2d; }
   iVirtualClock* GetVC () const { return vc; }
+  /// Get the queue for the layout jobs of the graph views.
+  iJobQueue* GetJobQueue ();
 
   virtual void Frame2D ();
   virtual void Frame3D ();
+  virtual bool IsAnimating () const;
   virtual bool OnMouseDown (iEvent& ev, uint but, int mouseX, int mouseY);
   virtual bool OnMouseUp (iEvent& ev, uint but, int mouseX, int mouseY);
   virtual bool OnMouseMove (iEvent& ev, int mouseX, int mouseY);
@@ -598,12 +782,17 @@ public:
     Marker* m = new Marker (this);
     markers.Push (m);
     m->DecRef ();
+    hitGridDirty = true;
     return m;
   }
   virtual void DestroyMarker (iMarker* marker)
   {
     markers.Delete (static_cast<Marker*> (marker));
+    hitGridDirty = true;
   }
+
+  /// Force a rebuild of the hit grid on the next query.
+  void InvalidateHitGrid () { hitGridDirty = true; }
   virtual iMarker* FindHitMarker (int x, int y, int& data);
 
   virtual iGraphView* CreateGraphView ();
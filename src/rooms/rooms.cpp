@@ -40,21 +40,123 @@ THE SOFTWARE.
 #include "imap/services.h"
 #include "iengine/movable.h"
 #include "iengine/sector.h"
+#include "iengine/portal.h"
 
+#include "include/binlevel.h"
 #include "rooms.h"
 
 #define VERBOSE 0
 
+#define ROOM_EPSILON .0001f
+
 
 CS_PLUGIN_NAMESPACE_BEGIN(RoomMesh)
 {
 
 //---------------------------------------------------------------------------------------
 
+int RoomTree::CompareRefs (const void* a, const void* b)
+{
+  float ka = ((const RoomRef*)a)->key;
+  float kb = ((const RoomRef*)b)->key;
+  if (ka < kb) return -1;
+  if (ka > kb) return 1;
+  return 0;
+}
+
+size_t RoomTree::Build (const csArray<RoomEntry>& rooms, RoomRef* refs, size_t count)
+{
+  size_t nodeIdx = nodes.Push (Node ());
+  csBox3 box;
+  csBox3 centers;
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    const csBox3& b = rooms[refs[i].room].box;
+    box += b;
+    centers.AddBoundingVertex (b.GetCenter ());
+  }
+  nodes[nodeIdx].box = box;
+  if (count == 1)
+  {
+    nodes[nodeIdx].room = refs[0].room;
+    nodes[nodeIdx].left = nodes[nodeIdx].right = csArrayItemNotFound;
+    return nodeIdx;
+  }
+
+  // Split at the median on the axis where the rooms are most spread out.
+  csVector3 size = centers.Max () - centers.Min ();
+  int axis = 0;
+  if (size.y > size[axis]) axis = 1;
+  if (size.z > size[axis]) axis = 2;
+  for (size_t i = 0 ; i < count ; i++)
+    refs[i].key = rooms[refs[i].room].box.GetCenter ()[axis];
+  qsort (refs, count, sizeof (RoomRef), CompareRefs);
+
+  size_t half = count / 2;
+  size_t left = Build (rooms, refs, half);
+  size_t right = Build (rooms, refs+half, count-half);
+  nodes[nodeIdx].room = csArrayItemNotFound;
+  nodes[nodeIdx].left = left;
+  nodes[nodeIdx].right = right;
+  return nodeIdx;
+}
+
+void RoomTree::Build (const csArray<RoomEntry>& rooms)
+{
+  nodes.Empty ();
+  if (rooms.GetSize () == 0) return;
+  csArray<RoomRef> refs;
+  refs.SetSize (rooms.GetSize ());
+  for (size_t i = 0 ; i < rooms.GetSize () ; i++)
+  {
+    refs[i].key = 0.0f;
+    refs[i].room = i;
+  }
+  Build (rooms, refs.GetArray (), refs.GetSize ());
+}
+
+size_t RoomTree::FindPoint (const csVector3& pos) const
+{
+  if (nodes.GetSize () == 0) return csArrayItemNotFound;
+  csArray<size_t> stack;
+  stack.Push (0);
+  while (stack.GetSize () > 0)
+  {
+    const Node& node = nodes[stack.Pop ()];
+    if (!node.box.In (pos)) continue;
+    if (node.room != csArrayItemNotFound) return node.room;
+    stack.Push (node.left);
+    stack.Push (node.right);
+  }
+  return csArrayItemNotFound;
+}
+
+void RoomTree::FindOverlap (const csBox3& box, csArray<size_t>& result) const
+{
+  if (nodes.GetSize () == 0) return;
+  csArray<size_t> stack;
+  stack.Push (0);
+  while (stack.GetSize () > 0)
+  {
+    const Node& node = nodes[stack.Pop ()];
+    if (!node.box.TestIntersect (box)) continue;
+    if (node.room != csArrayItemNotFound)
+      result.Push (node.room);
+    else
+    {
+      stack.Push (node.left);
+      stack.Push (node.right);
+    }
+  }
+}
+
+//---------------------------------------------------------------------------------------
+
 RoomFactory::RoomFactory (RoomMeshCreator* creator, const char* name) :
   scfImplementationType (this), creator (creator), name (name)
 {
   material = 0;
+  treeValid = false;
 
   factory = creator->engine->CreateMeshFactory (
 	"crystalspace.mesh.object.genmesh", name);
@@ -65,8 +167,338 @@ RoomFactory::~RoomFactory ()
 {
 }
 
+//---------------------------------------------------------------------------------------
+
+/**
+ * Key to weld vertices that are at the same spot on the same plane.
+ */
+struct WeldKey
+{
+  int x, y, z;
+  int side;
+  WeldKey (const csVector3& pos, int side) : side (side)
+  {
+    x = int (floor (pos.x * 1000.0f + .5f));
+    y = int (floor (pos.y * 1000.0f + .5f));
+    z = int (floor (pos.z * 1000.0f + .5f));
+  }
+  uint GetHash () const
+  {
+    return uint (x) * 73856093u ^ uint (y) * 19349663u ^ uint (z) * 83492791u
+      ^ uint (side);
+  }
+  bool operator< (const WeldKey& o) const
+  {
+    if (x != o.x) return x < o.x;
+    if (y != o.y) return y < o.y;
+    if (z != o.z) return z < o.z;
+    return side < o.side;
+  }
+};
+
+/**
+ * Collects the welded vertices and triangles for the room geometry.
+ */
+struct RoomGeometry
+{
+  csDirtyAccessArray<csVector3> vertices;
+  csDirtyAccessArray<csVector3> normals;
+  csDirtyAccessArray<csVector2> texels;
+  csDirtyAccessArray<csTriangle> triangles;
+  csHash<int,WeldKey> welded;
+
+  int AddVertex (const csVector3& pos, const csVector3& normal, int side,
+      int u, int v)
+  {
+    WeldKey key (pos, side);
+    const int* idx = welded.GetElementPointer (key);
+    if (idx) return *idx;
+    int i = int (vertices.Push (pos));
+    normals.Push (normal);
+    texels.Push (csVector2 (pos[u], pos[v]));
+    welded.Put (key, i);
+    return i;
+  }
+
+  /**
+   * Add a rectangle on a plane perpendicular to 'axis' that faces
+   * the given normal.
+   */
+  void AddRect (int axis, float plane, const csVector3& normal, int side,
+      const csBox2& rect)
+  {
+    int u = (axis+1) % 3;
+    int v = (axis+2) % 3;
+    csVector3 p[4];
+    RectCorners (axis, plane, normal, rect, p);
+    int idx[4];
+    for (int i = 0 ; i < 4 ; i++)
+      idx[i] = AddVertex (p[i], normal, side, u, v);
+    triangles.Push (csTriangle (idx[0], idx[1], idx[2]));
+    triangles.Push (csTriangle (idx[0], idx[2], idx[3]));
+  }
+
+  /**
+   * Calculate the corners of a rectangle on a plane perpendicular to
+   * 'axis' in such an order that it is visible from the side the
+   * normal points to.
+   */
+  static void RectCorners (int axis, float plane, const csVector3& normal,
+      const csBox2& rect, csVector3* p)
+  {
+    int u = (axis+1) % 3;
+    int v = (axis+2) % 3;
+    for (int i = 0 ; i < 4 ; i++)
+    {
+      p[i][axis] = plane;
+      p[i][u] = (i == 1 || i == 2) ? rect.MaxX () : rect.MinX ();
+      p[i][v] = (i >= 2) ? rect.MaxY () : rect.MinY ();
+    }
+    // Polygons are visible when the cross product of their edges points
+    // towards the viewer.
+    if (((p[1]-p[0]) % (p[2]-p[0])) * normal < 0)
+    {
+      csVector3 t = p[1];
+      p[1] = p[3];
+      p[3] = t;
+    }
+  }
+
+  /// Copy the geometry to a genmesh factory.
+  void Write (iGeneralFactoryState* state)
+  {
+    state->SetVertexCount (int (vertices.GetSize ()));
+    state->SetTriangleCount (int (triangles.GetSize ()));
+    if (vertices.GetSize () > 0)
+    {
+      memcpy (state->GetVertices (), vertices.GetArray (),
+	  sizeof (csVector3) * vertices.GetSize ());
+      memcpy (state->GetNormals (), normals.GetArray (),
+	  sizeof (csVector3) * normals.GetSize ());
+      memcpy (state->GetTexels (), texels.GetArray (),
+	  sizeof (csVector2) * texels.GetSize ());
+      memcpy (state->GetTriangles (), triangles.GetArray (),
+	  sizeof (csTriangle) * triangles.GetSize ());
+    }
+    state->Invalidate ();
+  }
+};
+
+static void AddUnique (csArray<float>& values, float v)
+{
+  for (size_t i = 0 ; i < values.GetSize () ; i++)
+    if (fabs (values[i]-v) < ROOM_EPSILON) return;
+  values.Push (v);
+}
+
+/**
+ * Subtract a number of holes from a rectangle. The remaining area is
+ * returned as a small number of rectangles.
+ */
+static void SubtractRects (const csBox2& rect, const csArray<csBox2>& holes,
+    csArray<csBox2>& result)
+{
+  // Split the rectangle in a grid on all hole edges.
+  csArray<float> us, vs;
+  AddUnique (us, rect.MinX ());
+  AddUnique (us, rect.MaxX ());
+  AddUnique (vs, rect.MinY ());
+  AddUnique (vs, rect.MaxY ());
+  for (size_t i = 0 ; i < holes.GetSize () ; i++)
+  {
+    AddUnique (us, holes[i].MinX ());
+    AddUnique (us, holes[i].MaxX ());
+    AddUnique (vs, holes[i].MinY ());
+    AddUnique (vs, holes[i].MaxY ());
+  }
+  us.Sort ();
+  vs.Sort ();
+
+  // For every row find the runs of uncovered cells and merge those
+  // with the identical run of the row below.
+  csArray<csBox2> open;
+  for (size_t j = 0 ; j+1 < vs.GetSize () ; j++)
+  {
+    csArray<csBox2> runs;
+    float runStart = 0.0f;
+    bool inRun = false;
+    for (size_t i = 0 ; i+1 < us.GetSize () ; i++)
+    {
+      csVector2 center ((us[i]+us[i+1]) / 2.0f, (vs[j]+vs[j+1]) / 2.0f);
+      bool covered = false;
+      for (size_t h = 0 ; h < holes.GetSize () ; h++)
+	if (holes[h].In (center)) { covered = true; break; }
+      if (!covered && !inRun) { runStart = us[i]; inRun = true; }
+      else if (covered && inRun)
+      {
+	runs.Push (csBox2 (runStart, vs[j], us[i], vs[j+1]));
+	inRun = false;
+      }
+    }
+    if (inRun)
+      runs.Push (csBox2 (runStart, vs[j], us[us.GetSize ()-1], vs[j+1]));
+
+    csArray<csBox2> newOpen;
+    for (size_t r = 0 ; r < runs.GetSize () ; r++)
+    {
+      csBox2 run = runs[r];
+      for (size_t o = 0 ; o < open.GetSize () ; o++)
+	if (fabs (open[o].MinX ()-run.MinX ()) < ROOM_EPSILON
+	    && fabs (open[o].MaxX ()-run.MaxX ()) < ROOM_EPSILON)
+	{
+	  run.AddBoundingVertex (open[o].MinX (), open[o].MinY ());
+	  open.DeleteIndex (o);
+	  break;
+	}
+      newOpen.Push (run);
+    }
+    for (size_t o = 0 ; o < open.GetSize () ; o++)
+      result.Push (open[o]);
+    open = newOpen;
+  }
+  for (size_t o = 0 ; o < open.GetSize () ; o++)
+    result.Push (open[o]);
+}
+
+void RoomFactory::CollectWalls (size_t i, bool merged, RoomGeometry& geom,
+    csArray<RoomOpening>* openings)
+{
+  const csBox3& box = anchorRooms[i].box;
+  if (box.Volume () <= ROOM_EPSILON) return;
+
+  // Only rooms that touch this room can hide part of its walls.
+  csArray<size_t> candidates;
+  tree.FindOverlap (box, candidates);
+  for (int axis = 0 ; axis < 3 ; axis++)
+  {
+    int u = (axis+1) % 3;
+    int v = (axis+2) % 3;
+    csBox2 rect (box.Min (u), box.Min (v), box.Max (u), box.Max (v));
+    for (int maxSide = 0 ; maxSide <= 1 ; maxSide++)
+    {
+      float plane = maxSide ? box.Max (axis) : box.Min (axis);
+      // The walls face the inside of the room.
+      csVector3 normal (0);
+      normal[axis] = maxSide ? -1.0f : 1.0f;
+
+      // When merging, every part of this wall that has another room
+      // behind it is not a wall of the merged rooms. If a previous room
+      // has a wall at the same spot then that part was already done.
+      // Otherwise only the parts where another room touches this wall
+      // are left open.
+      csArray<csBox2> holes;
+      for (size_t c = 0 ; c < candidates.GetSize () ; c++)
+      {
+	size_t j = candidates[c];
+	const csBox3& other = anchorRooms[j].box;
+	if (j == i || other.Volume () <= ROOM_EPSILON) continue;
+	bool behind, same;
+	if (maxSide)
+	{
+	  behind = merged
+	    ? other.Min (axis) <= plane + ROOM_EPSILON
+	    : fabs (other.Min (axis) - plane) < ROOM_EPSILON;
+	  behind = behind && other.Max (axis) > plane + ROOM_EPSILON;
+	  same = merged && j < i && fabs (other.Max (axis) - plane) < ROOM_EPSILON;
+	}
+	else
+	{
+	  behind = merged
+	    ? other.Max (axis) >= plane - ROOM_EPSILON
+	    : fabs (other.Max (axis) - plane) < ROOM_EPSILON;
+	  behind = behind && other.Min (axis) < plane - ROOM_EPSILON;
+	  same = merged && j < i && fabs (other.Min (axis) - plane) < ROOM_EPSILON;
+	}
+	if (!behind && !same) continue;
+	csBox2 otherRect (other.Min (u), other.Min (v), other.Max (u), other.Max (v));
+	csBox2 hole = rect * otherRect;
+	if (hole.Empty () || hole.Area () < ROOM_EPSILON) continue;
+	holes.Push (hole);
+	if (openings && behind)
+	{
+	  RoomOpening opening;
+	  opening.axis = axis;
+	  opening.plane = plane;
+	  opening.normal = normal;
+	  opening.rect = hole;
+	  opening.room = j;
+	  openings->Push (opening);
+	}
+      }
+
+      csArray<csBox2> walls;
+      if (holes.GetSize () == 0)
+	walls.Push (rect);
+      else
+	SubtractRects (rect, holes, walls);
+      for (size_t w = 0 ; w < walls.GetSize () ; w++)
+	geom.AddRect (axis, plane, normal, axis*2+maxSide, walls[w]);
+    }
+  }
+}
+
 void RoomFactory::GenerateGeometry (iMeshWrapper* thisMesh)
 {
+  UpdateTree ();
+  RoomGeometry geom;
+  for (size_t i = 0 ; i < anchorRooms.GetSize () ; i++)
+    CollectWalls (i, true, geom, 0);
+  geom.Write (state);
+  factory->GetMeshObjectFactory ()->SetMaterialWrapper (material);
+}
+
+void RoomFactory::CreateSectors (const char* prefix,
+    const csReversibleTransform& trans, csRefArray<iSector>& sectors)
+{
+  UpdateTree ();
+  iEngine* engine = creator->engine;
+  size_t first = sectors.GetSize ();
+  for (size_t i = 0 ; i < anchorRooms.GetSize () ; i++)
+  {
+    csString sectorName;
+    sectorName.Format ("%s_%d", prefix, int (i));
+    csRef<iSector> sector = engine->CreateSector (sectorName);
+    sectors.Push (sector);
+  }
+
+  for (size_t i = 0 ; i < anchorRooms.GetSize () ; i++)
+  {
+    iSector* sector = sectors[first+i];
+    RoomGeometry geom;
+    csArray<RoomOpening> openings;
+    CollectWalls (i, false, geom, &openings);
+    csArray<size_t> adjacent;
+    FindAdjacentRooms (i, adjacent);
+
+    const char* sectorName = sector->QueryObject ()->GetName ();
+    csRef<iMeshFactoryWrapper> fact = engine->CreateMeshFactory (
+	"crystalspace.mesh.object.genmesh", sectorName);
+    csRef<iGeneralFactoryState> factState = scfQueryInterface<iGeneralFactoryState> (
+	fact->GetMeshObjectFactory ());
+    geom.Write (factState);
+    fact->GetMeshObjectFactory ()->SetMaterialWrapper (material);
+    csRef<iMeshWrapper> mesh = engine->CreateMeshWrapper (fact, sectorName, sector);
+    mesh->GetMovable ()->SetTransform (trans);
+    mesh->GetMovable ()->UpdateMove ();
+
+    // Every opening to a room that shares a wall with this one gets a
+    // portal to its sector.
+    for (size_t o = 0 ; o < openings.GetSize () ; o++)
+    {
+      const RoomOpening& opening = openings[o];
+      if (adjacent.Find (opening.room) == csArrayItemNotFound) continue;
+      csVector3 verts[4];
+      RoomGeometry::RectCorners (opening.axis, opening.plane, opening.normal,
+	  opening.rect, verts);
+      for (int k = 0 ; k < 4 ; k++)
+	verts[k] = trans.This2Other (verts[k]);
+      csString portalName;
+      portalName.Format ("%s_to_%d", sectorName, int (opening.room));
+      iPortal* portal;
+      csRef<iMeshWrapper> portalMesh = engine->CreatePortal (portalName, sector,
+	  csVector3 (0), sectors[first+opening.room], verts, 4, portal);
+    }
+  }
 }
 
 void RoomFactory::SetMaterial (const char* materialName)
@@ -82,14 +514,66 @@ void RoomFactory::SetMaterial (const char* materialName)
 
 size_t RoomFactory::AddRoom (const csVector3& tl, const csVector3& br)
 {
+  treeValid = false;
   return anchorRooms.Push (RoomEntry (tl, br));
 }
 
 void RoomFactory::DeleteRoom (size_t idx)
 {
+  treeValid = false;
   anchorRooms.DeleteIndex (idx);
 }
 
+void RoomFactory::UpdateTree ()
+{
+  if (treeValid) return;
+  tree.Build (anchorRooms);
+  treeValid = true;
+}
+
+size_t RoomFactory::FindRoom (const csVector3& pos)
+{
+  UpdateTree ();
+  return tree.FindPoint (pos);
+}
+
+void RoomFactory::FindRooms (const csBox3& box, csArray<size_t>& rooms)
+{
+  UpdateTree ();
+  tree.FindOverlap (box, rooms);
+}
+
+void RoomFactory::FindAdjacentRooms (size_t idx, csArray<size_t>& rooms)
+{
+  UpdateTree ();
+  const csBox3& box = anchorRooms[idx].box;
+  csArray<size_t> candidates;
+  tree.FindOverlap (box, candidates);
+  for (size_t i = 0 ; i < candidates.GetSize () ; i++)
+  {
+    size_t j = candidates[i];
+    if (j == idx) continue;
+    const csBox3& other = anchorRooms[j].box;
+    // Two rooms share a wall if they touch on one axis and overlap
+    // with some area on the two others.
+    for (int axis = 0 ; axis < 3 ; axis++)
+    {
+      if (fabs (box.Max (axis) - other.Min (axis)) > ROOM_EPSILON
+	  && fabs (box.Min (axis) - other.Max (axis)) > ROOM_EPSILON)
+	continue;
+      int u = (axis+1) % 3;
+      int v = (axis+2) % 3;
+      float du = csMin (box.Max (u), other.Max (u)) - csMax (box.Min (u), other.Min (u));
+      float dv = csMin (box.Max (v), other.Max (v)) - csMax (box.Min (v), other.Min (v));
+      if (du > ROOM_EPSILON && dv > ROOM_EPSILON)
+      {
+	rooms.Push (j);
+	break;
+      }
+    }
+  }
+}
+
 void RoomFactory::Save (iDocumentNode* node, iSyntaxService* syn)
 {
   node->SetAttribute ("name", name);
@@ -134,6 +618,34 @@ bool RoomFactory::Load (iDocumentNode* node, iSyntaxService* syn)
   return true;
 }
 
+void RoomFactory::SaveBinary (BinaryLevelWriter& writer)
+{
+  writer.WriteString (name);
+  writer.WriteString (material->QueryObject ()->GetName ());
+  writer.WriteUInt32 (uint32 (anchorRooms.GetSize ()));
+  for (size_t i = 0 ; i < anchorRooms.GetSize () ; i++)
+  {
+    writer.WriteVector3 (anchorRooms[i].tl);
+    writer.WriteVector3 (anchorRooms[i].br);
+  }
+}
+
+bool RoomFactory::LoadBinary (BinaryLevelReader& reader)
+{
+  csString materialName = reader.ReadString ();
+  SetMaterial (materialName);
+  anchorRooms.DeleteAll ();
+  size_t count = reader.ReadCount (6 * sizeof (float));
+  anchorRooms.SetCapacity (count);
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    csVector3 tl = reader.ReadVector3 ();
+    csVector3 br = reader.ReadVector3 ();
+    AddRoom (tl, br);
+  }
+  return reader.IsOk ();
+}
+
 //---------------------------------------------------------------------------------------
 
 RoomFactoryTemplate::RoomFactoryTemplate (RoomMeshCreator* creator,
@@ -281,6 +793,33 @@ csRef<iString> RoomMeshCreator::Load (iDocumentNode* node)
   return 0;
 }
 
+void RoomMeshCreator::SaveBinary (BinaryLevelWriter& writer)
+{
+  writer.WriteUInt32 (uint32 (factories.GetSize ()));
+  for (size_t i = 0 ; i < factories.GetSize () ; i++)
+    factories[i]->SaveBinary (writer);
+}
+
+csRef<iString> RoomMeshCreator::LoadBinary (BinaryLevelReader& reader)
+{
+  size_t count = reader.ReadCount (sizeof (uint32));
+  for (size_t i = 0 ; i < count ; i++)
+  {
+    csRef<RoomFactory> cfact;
+    csString name = reader.ReadString ();
+    cfact.AttachNew (new RoomFactory (this, name));
+    if (!cfact->LoadBinary (reader))
+    {
+      csRef<iString> str;
+      str.AttachNew (new scfString ("Error loading factory!"));
+      return str;
+    }
+    factories.Push (cfact);
+    factory_hash.Put (name, cfact);
+  }
+  return 0;
+}
+
 }
 CS_PLUGIN_NAMESPACE_END(RoomMesh)
 
@@ -33,12 +33,14 @@ THE SOFTWARE.
 #include "csutil/eventhandlers.h"
 #include "csutil/refarr.h"
 #include "csutil/parray.h"
+#include "csutil/dirtyaccessarray.h"
 #include "iutil/comp.h"
 #include "iutil/virtclk.h"
 
 #include "csgeom/vector3.h"
 #include "csgeom/math3d.h"
 #include "csgeom/path.h"
+#include "csgeom/box.h"
 
 #include "imesh/genmesh.h"
 #include "iengine/material.h"
@@ -55,11 +57,67 @@ CS_PLUGIN_NAMESPACE_BEGIN(RoomMesh)
 struct RoomEntry
 {
   csVector3 tl, br;
+  /// The box of the room (tl and br are not necessarily min and max).
+  csBox3 box;
   RoomEntry () { }
   RoomEntry (const csVector3& tl, const csVector3& br) :
-    tl (tl), br (br) { }
+    tl (tl), br (br), box (tl)
+  {
+    box.AddBoundingVertex (br);
+  }
+};
+
+/**
+ * A bounding volume hierarchy over the boxes of the rooms of a factory.
+ */
+class RoomTree
+{
+private:
+  struct Node
+  {
+    csBox3 box;
+    /// Index of the room for a leaf or csArrayItemNotFound otherwise.
+    size_t room;
+    size_t left, right;
+  };
+  csArray<Node> nodes;
+
+  struct RoomRef
+  {
+    float key;
+    size_t room;
+  };
+  static int CompareRefs (const void* a, const void* b);
+  size_t Build (const csArray<RoomEntry>& rooms, RoomRef* refs, size_t count);
+
+public:
+  /// Build the tree for the given rooms.
+  void Build (const csArray<RoomEntry>& rooms);
+
+  /// Find a room containing a point.
+  size_t FindPoint (const csVector3& pos) const;
+
+  /**
+   * Find all rooms overlapping with a box. Touching rooms are also
+   * returned.
+   */
+  void FindOverlap (const csBox3& box, csArray<size_t>& result) const;
 };
 
+/**
+ * An opening in the wall of a room where it touches another room.
+ */
+struct RoomOpening
+{
+  int axis;
+  float plane;
+  csVector3 normal;
+  csBox2 rect;
+  /// The room on the other side.
+  size_t room;
+};
+
+struct RoomGeometry;
 class RoomMeshCreator;
 
 class RoomFactory : public scfImplementation2<RoomFactory, iRoomFactory,
@@ -75,6 +133,21 @@ private:
 
   csArray<RoomEntry> anchorRooms;
 
+  /// Index for the rooms. Only valid if treeValid is true.
+  RoomTree tree;
+  bool treeValid;
+  void UpdateTree ();
+
+  /**
+   * Add the walls of a room to the geometry. If 'merged' is true all
+   * the walls that have another room behind them are removed (so that
+   * all rooms together form one space). Otherwise only the parts where
+   * another room touches this wall are removed and those are returned
+   * in 'openings' (if given).
+   */
+  void CollectWalls (size_t i, bool merged, RoomGeometry& geom,
+      csArray<RoomOpening>* openings);
+
 public:
   RoomFactory (RoomMeshCreator* creator, const char* name);
   virtual ~RoomFactory ();
@@ -88,9 +161,20 @@ public:
   {
     return anchorRooms.GetSize ();
   }
+  virtual const csBox3& GetRoomBox (size_t idx) const
+  {
+    return anchorRooms[idx].box;
+  }
+  virtual size_t FindRoom (const csVector3& pos);
+  virtual void FindRooms (const csBox3& box, csArray<size_t>& rooms);
+  virtual void FindAdjacentRooms (size_t idx, csArray<size_t>& rooms);
+  virtual void CreateSectors (const char* prefix,
+      const csReversibleTransform& trans, csRefArray<iSector>& sectors);
 
   void Save (iDocumentNode* node, iSyntaxService* syn);
   bool Load (iDocumentNode* node, iSyntaxService* syn);
+  void SaveBinary (BinaryLevelWriter& writer);
+  bool LoadBinary (BinaryLevelReader& reader);
 
   virtual void GenerateGeometry (iMeshWrapper* mesh);
 };
@@ -168,6 +252,8 @@ public:
 
   virtual void Save (iDocumentNode* node);
   virtual csRef<iString> Load (iDocumentNode* node);
+  virtual void SaveBinary (BinaryLevelWriter& writer);
+  virtual csRef<iString> LoadBinary (BinaryLevelReader& reader);
 };
 
 }